@@ -0,0 +1,213 @@
+#include "catalog.h"
+#include "files.h"
+#ifdef _WIN32
+#include <io.h>
+#define fsync(fd) _commit(fd)
+#define fileno(f) _fileno(f)
+#else
+#include <unistd.h>
+#endif
+
+begin_c
+
+enum { catalog_max_shards = 4096 };
+
+typedef struct catalog_s {
+    FILE* file;
+} catalog_t_;
+
+static catalog_t catalog_open(const char* folder, int32_t shard, int32_t shards,
+        int32_t files, uint64_t tree, bool truncate) {
+    char pathname[260];
+    snprintf(pathname, countof(pathname), "%s/catalog.%dof%d.txt", folder, shard, shards);
+    catalog_t_* c = (catalog_t_*)calloc(1, sizeof(catalog_t_));
+    if (c != null) {
+        c->file = fopen(pathname, truncate ? "wb" : "ab");
+        if (c->file == null) {
+            traceln("catalog: failed to open %s", pathname);
+            free(c);
+            return null;
+        }
+        fprintf(c->file, "# shard %d %d files %d tree %016llX\n", shard, shards,
+            files, (unsigned long long)tree);
+    }
+    return (catalog_t)c;
+}
+
+static int catalog_append(catalog_t handle, int32_t seq, uint64_t key, int64_t bytes,
+        const char* output, const char* source) {
+    catalog_t_* c = (catalog_t_*)handle;
+    return fprintf(c->file, "%d\t%016llX\t%lld\t%s\t%s\n", seq, (unsigned long long)key,
+        (long long)bytes, output, source) < 0 || fflush(c->file) != 0 ? errno : 0;
+}
+
+static int catalog_sync(catalog_t handle) {
+    catalog_t_* c = (catalog_t_*)handle;
+    int r = fflush(c->file) == 0 ? 0 : errno;
+    if (r == 0) { r = fsync(fileno(c->file)) == 0 ? 0 : errno; }
+    return r;
+}
+
+static int catalog_close(catalog_t handle) {
+    catalog_t_* c = (catalog_t_*)handle;
+    int r = fclose(c->file) == 0 ? 0 : errno;
+    free(c);
+    return r;
+}
+
+typedef struct catalog_record_s {
+    int32_t seq;
+    int32_t order; // position in merge input: later record of a seq wins
+    char* line;    // as read from the shard catalog including '\n'
+} catalog_record_t;
+
+typedef struct catalog_merge_s {
+    catalog_record_t* records;
+    int32_t count;
+    int32_t allocated;
+    int32_t shards;   // common N of all shard catalogs
+    int32_t files;    // common number of files in the tree
+    uint64_t tree;    // common tree fingerprint
+    bool* seen;       // seen[i] shard i catalog was read
+} catalog_merge_t;
+
+static int catalog_compare(const void* a, const void* b) {
+    const catalog_record_t* ra = (const catalog_record_t*)a;
+    const catalog_record_t* rb = (const catalog_record_t*)b;
+    if (ra->seq != rb->seq) { return ra->seq < rb->seq ? -1 : 1; }
+    return ra->order < rb->order ? -1 : ra->order > rb->order ? 1 : 0;
+}
+
+static int catalog_read(catalog_merge_t* m, const char* pathname, char* reply, int count) {
+    FILE* f = fopen(pathname, "rb");
+    if (f == null) {
+        snprintf(reply, count, "failed to open %s", pathname);
+        return errno;
+    }
+    int r = 0;
+    char line[1024];
+    while (r == 0 && fgets(line, countof(line), f) != null) {
+        const int n = (int)strlen(line);
+        if (n == 0 || line[n - 1] != '\n') { break; } // torn last line
+        int32_t shard = 0;
+        int32_t shards = 0;
+        int32_t files = 0;
+        unsigned long long tree = 0;
+        int32_t seq = 0;
+        if (sscanf(line, "# shard %d %d files %d tree %llX", &shard, &shards,
+                   &files, &tree) == 4) {
+            if (shards <= 0 || shards > catalog_max_shards || shard < 0 || shard >= shards) {
+                snprintf(reply, count, "%s: invalid shard %d/%d", pathname, shard, shards);
+                r = EINVAL;
+            } else if (m->shards == 0) {
+                m->shards = shards;
+                m->files = files;
+                m->tree = tree;
+                m->seen = (bool*)calloc(shards, sizeof(bool));
+                if (m->seen == null) { r = ENOMEM; }
+            } else if (m->shards != shards || m->files != files || m->tree != tree) {
+                snprintf(reply, count, "%s: shard %d/%d of different tree "
+                    "(%d files %016llX, others %d files %016llX)",
+                    pathname, shard, shards, files, tree, m->files,
+                    (unsigned long long)m->tree);
+                r = EINVAL;
+            }
+            if (r == 0) { m->seen[shard] = true; }
+        } else if (sscanf(line, "%d\t", &seq) == 1 && seq > 0 && m->shards > 0) {
+            if (m->count == m->allocated) {
+                const int32_t a = m->allocated == 0 ? 4096 : m->allocated * 2;
+                catalog_record_t* records = (catalog_record_t*)realloc(m->records,
+                    a * sizeof(catalog_record_t));
+                if (records == null) { r = ENOMEM; break; }
+                m->records = records;
+                m->allocated = a;
+            }
+            catalog_record_t* rec = &m->records[m->count];
+            rec->line = (char*)malloc(n + 1);
+            if (rec->line == null) { r = ENOMEM; break; }
+            memcpy(rec->line, line, n + 1);
+            rec->seq = seq;
+            rec->order = m->count;
+            m->count++;
+        }
+    }
+    fclose(f);
+    return r;
+}
+
+static int catalog_write(catalog_merge_t* m, const char* folder, int32_t* outputs) {
+    char pathname[260];
+    snprintf(pathname, countof(pathname), "%s/catalog.txt", folder);
+    FILE* f = fopen(pathname, "wb");
+    if (f == null) { return errno; }
+    fprintf(f, "# shard 0 1 files %d tree %016llX\n", m->files, (unsigned long long)m->tree);
+    int r = 0;
+    *outputs = 0;
+    for (int32_t i = 0; i < m->count && r == 0; i++) {
+        // sorted by (seq, order): only the last record of each seq is written
+        if (i + 1 < m->count && m->records[i + 1].seq == m->records[i].seq) { continue; }
+        if (fputs(m->records[i].line, f) < 0) { r = errno; }
+        (*outputs)++;
+    }
+    if (fclose(f) != 0 && r == 0) { r = errno; }
+    return r;
+}
+
+static int catalog_merge(const char* folder, char* reply, int count) {
+    catalog_merge_t m = {0};
+    folders_t dir = folders.open();
+    int r = dir == null ? ENOMEM : folders.enumerate(dir, folder);
+    const int n = r == 0 ? folders.count(dir) : 0;
+    int32_t catalogs = 0;
+    for (int i = 0; i < n && r == 0; i++) {
+        const char* name = folders.name(dir, i);
+        int32_t shard = 0;
+        int32_t shards = 0;
+        char tail[8] = {0};
+        if (!folders.is_folder(dir, i) &&
+            sscanf(name, "catalog.%dof%d.%4s", &shard, &shards, tail) == 3 &&
+            strcmp(tail, "txt") == 0) {
+            char pathname[260];
+            snprintf(pathname, countof(pathname), "%s/%s", folder, name);
+            r = catalog_read(&m, pathname, reply, count);
+            catalogs++;
+        }
+    }
+    if (dir != null) { folders.close(dir); }
+    for (int32_t i = 0; i < m.shards && r == 0; i++) {
+        if (!m.seen[i]) {
+            snprintf(reply, count, "shard %d/%d catalog is missing", i, m.shards);
+            r = ENOENT;
+        }
+    }
+    if (r == 0 && catalogs == 0) {
+        snprintf(reply, count, "no shard catalogs in %s", folder);
+        r = ENOENT;
+    }
+    int32_t outputs = 0;
+    if (r == 0) {
+        qsort(m.records, m.count, sizeof(catalog_record_t), catalog_compare);
+        r = catalog_write(&m, folder, &outputs);
+        if (r != 0) {
+            snprintf(reply, count, "failed to write %s/catalog.txt %s", folder, crt.error(r));
+        }
+    }
+    if (r == 0) {
+        snprintf(reply, count, "merged %d shards: %d outputs of %d files",
+            m.shards, outputs, m.files);
+    }
+    for (int32_t i = 0; i < m.count; i++) { free(m.records[i].line); }
+    free(m.records);
+    free(m.seen);
+    return r;
+}
+
+catalog_if catalog = {
+    .open   = catalog_open,
+    .append = catalog_append,
+    .sync   = catalog_sync,
+    .close  = catalog_close,
+    .merge  = catalog_merge
+};
+
+end_c
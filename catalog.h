@@ -0,0 +1,39 @@
+#pragma once
+#include "crt.h"
+
+begin_c
+
+// Catalog of outputs produced by one shard of a library (--shard i/N).
+// Text file "catalog.<i>of<N>.txt" in the output folder:
+//     "# shard <i> <N> files <count> tree <fingerprint>\n"  (each run)
+//     "<seq>\t<key>\t<bytes>\t<output>\t<source>\n"         (each output)
+// seq is the logical (listing order) number over the whole source tree,
+// thus all shards that enumerated the same tree agree on numbering and
+// the fingerprint of the tree proves that they did. Outputs and sources
+// are relative to output and source folders.
+// merge() combines shard catalogs copied into one folder into a single
+// "catalog.txt" in global seq order (later records of a seq win, as
+// written by resumed runs) after checking that all N shards are present
+// and saw the same tree.
+// Each line is flushed as appended and written before the journal record
+// of the same output, sync() is called before the journal is fsync()ed:
+// a seq the journal calls done always has its catalog line.
+
+typedef struct catalog_s* catalog_t;
+
+typedef struct {
+    // opens folder/catalog.<shard>of<shards>.txt for append (or truncated)
+    catalog_t (*open)(const char* folder, int32_t shard, int32_t shards,
+        int32_t files, uint64_t tree, bool truncate);
+    int (*append)(catalog_t c, int32_t seq, uint64_t key, int64_t bytes,
+        const char* output, const char* source);
+    int (*sync)(catalog_t c); // fsync()
+    int (*close)(catalog_t c);
+    // merges shard catalogs in folder into folder/catalog.txt, single line
+    // summary or problem description in reply, returns 0 or error
+    int (*merge)(const char* folder, char* reply, int count);
+} catalog_if;
+
+extern catalog_if catalog;
+
+end_c
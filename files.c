@@ -2,6 +2,7 @@
 
 #include <Windows.h>
 #include "Shlwapi.h"
+#include <winioctl.h>
 #include <fcntl.h>
 #include <io.h>
 #include <sys/stat.h>
@@ -132,6 +133,112 @@ static bool files_exists(const char* path) { return PathFileExistsA(path); }
 
 static bool files_is_folder(const char* path) { return PathIsDirectoryA(path); }
 
+static uint64_t files_updated(const char* pathname) {
+    WIN32_FILE_ATTRIBUTE_DATA fa = {0};
+    if (!GetFileAttributesExA(pathname, GetFileExInfoStandard, &fa)) { return 0; }
+    return (((uint64_t)fa.ftLastWriteTime.dwHighDateTime) << 32 |
+                       fa.ftLastWriteTime.dwLowDateTime) * 100;
+}
+
+static uint64_t files_location(const char* pathname) {
+    uint64_t location = 0;
+    // FILE_READ_ATTRIBUTES access is enough for both ioctl and file index
+    HANDLE file = CreateFileA(pathname, FILE_READ_ATTRIBUTES,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, null,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, null);
+    if (file == INVALID_HANDLE_VALUE) { return 0; }
+    STARTING_VCN_INPUT_BUFFER vcn = {0};
+    RETRIEVAL_POINTERS_BUFFER rp = {0}; // room for the first extent only
+    DWORD bytes = 0;
+    bool ok = DeviceIoControl(file, FSCTL_GET_RETRIEVAL_POINTERS, &vcn, sizeof(vcn),
+        &rp, sizeof(rp), &bytes, null) || GetLastError() == ERROR_MORE_DATA;
+    if (ok && rp.ExtentCount > 0 && rp.Extents[0].Lcn.QuadPart >= 0) {
+        location = (uint64_t)rp.Extents[0].Lcn.QuadPart;
+    } else {
+        // resident in MFT, compressed, or remote: file index approximates
+        // allocation order and sorts after all files with known clusters
+        BY_HANDLE_FILE_INFORMATION fi = {0};
+        if (GetFileInformationByHandle(file, &fi)) {
+            location = (1ULL << 63) | ((uint64_t)fi.nFileIndexHigh << 32) | fi.nFileIndexLow;
+        }
+    }
+    CloseHandle(file);
+    return location;
+}
+
+// file system of the volume `pathname` is on, the last answer is cached:
+// sources of a run are almost always on the same volume
+static bool files_on_refs(const char* pathname) {
+    static char volume[MAX_PATH];
+    static bool refs;
+    char root[MAX_PATH];
+    if (!GetVolumePathNameA(pathname, root, countof(root))) { return false; }
+    if (strcmp(root, volume) != 0) {
+        char fs[MAX_PATH] = {0};
+        refs = GetVolumeInformationA(root, null, 0, null, null, null, fs, countof(fs)) &&
+               strcmp(fs, "ReFS") == 0;
+        snprintf(volume, countof(volume), "%s", root);
+    }
+    return refs;
+}
+
+// ReFS (and Dev Drive) block cloning: destination shares source clusters
+// copy-on-write, no data is read or written
+static int files_clone_extents(const char* from, const char* to) {
+    if (!files_on_refs(from)) { return ERROR_NOT_SUPPORTED; } // dst untouched
+    HANDLE src = CreateFileA(from, GENERIC_READ, FILE_SHARE_READ, null,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, null);
+    if (src == INVALID_HANDLE_VALUE) { return GetLastError(); }
+    FSCTL_GET_INTEGRITY_INFORMATION_BUFFER integrity = {0};
+    LARGE_INTEGER size = {0};
+    DWORD bytes = 0;
+    int r = DeviceIoControl(src, FSCTL_GET_INTEGRITY_INFORMATION, null, 0,
+            &integrity, sizeof(integrity), &bytes, null) ? 0 : GetLastError();
+    if (r == 0 && !GetFileSizeEx(src, &size)) { r = GetLastError(); }
+    HANDLE dst = INVALID_HANDLE_VALUE;
+    if (r == 0) {
+        dst = CreateFileA(to, GENERIC_READ | GENERIC_WRITE | DELETE, 0, null,
+            CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, null);
+        r = dst == INVALID_HANDLE_VALUE ? GetLastError() : 0;
+    }
+    if (r == 0) {
+        FILE_END_OF_FILE_INFO eof = { .EndOfFile = size };
+        r = SetFileInformationByHandle(dst, FileEndOfFileInfo, &eof, sizeof(eof)) ?
+            0 : GetLastError();
+    }
+    // byte count is rounded up to cluster size, end of file stays as set above
+    const int64_t cluster = integrity.ClusterSizeInBytes;
+    const int64_t chunk = 1024LL * 1024 * 1024; // must be < 4GB
+    for (int64_t offset = 0; r == 0 && offset < size.QuadPart; offset += chunk) {
+        int64_t n = size.QuadPart - offset < chunk ? size.QuadPart - offset : chunk;
+        DUPLICATE_EXTENTS_DATA dup = { .FileHandle = src };
+        dup.SourceFileOffset.QuadPart = offset;
+        dup.TargetFileOffset.QuadPart = offset;
+        dup.ByteCount.QuadPart = (n + cluster - 1) / cluster * cluster;
+        r = DeviceIoControl(dst, FSCTL_DUPLICATE_EXTENTS_TO_FILE, &dup, sizeof(dup),
+            null, 0, &bytes, null) ? 0 : GetLastError();
+    }
+    if (r != 0 && dst != INVALID_HANDLE_VALUE) {
+        FILE_DISPOSITION_INFO dispose = { .DeleteFile = true };
+        SetFileInformationByHandle(dst, FileDispositionInfo, &dispose, sizeof(dispose));
+    }
+    if (dst != INVALID_HANDLE_VALUE) { CloseHandle(dst); }
+    CloseHandle(src);
+    return r;
+}
+
+static int files_clone(const char* from, const char* to, bool hardlink, bool* linked) {
+    int r = ERROR_NOT_SUPPORTED;
+    if (hardlink) {
+        DeleteFileA(to); // CreateHardLinkA() does not overwrite
+        r = CreateHardLinkA(to, from, null) ? 0 : GetLastError();
+    }
+    if (linked != null) { *linked = r == 0; }
+    if (r != 0) { r = files_clone_extents(from, to); }
+    if (r != 0) { r = CopyFileA(from, to, false) ? 0 : GetLastError(); }
+    return r;
+}
+
 files_if files = {
     .write_fully = files_write_fully,
     .exists = files_exists,
@@ -139,7 +246,10 @@ files_if files = {
     .mkdirs = files_create_folder,
     .rmdirs = files_remove_folder,
     .create_temp_folder = files_create_temp_folder,
-    .remove = files_remove_file_or_folder
+    .remove = files_remove_file_or_folder,
+    .updated = files_updated,
+    .location = files_location,
+    .clone = files_clone
 };
 
 // folders enumarator
@@ -35,6 +35,17 @@ typedef struct {
     int (*rmdirs)(const char* pathname); // tries to remove folder and its subtree
     int (*create_temp_folder)(char* folder, int count);
     int (*remove)(const char* pathname); // delete file or empty folder
+    // last write time in absolute nanoseconds since start of OS epoch or 0
+    uint64_t (*updated)(const char* pathname);
+    // on-disk position of the file first extent (volume cluster number),
+    // file index if clusters are not available, 0 if failed; sorting reads
+    // by location turns random seeks into a sweep on spinning disks
+    uint64_t (*location)(const char* pathname);
+    // makes `to` a copy of `from` with the least I/O available: hardlink
+    // (only if allowed: shares attributes and times with `from`), block
+    // clone on ReFS, buffered copy otherwise; linked (may be null) tells
+    // whether `to` became a hardlink: its times must not be changed then
+    int (*clone)(const char* from, const char* to, bool hardlink, bool* linked);
 } files_if;
 
 extern files_if files;
@@ -0,0 +1,484 @@
+#include "grid.h"
+
+begin_c
+
+static int32_t grid_pow2(int32_t n) {
+    int32_t p = 8;
+    while (p < n) { p <<= 1; }
+    return p;
+}
+
+static uint32_t grid_hash_of(int32_t index) { // Knuth multiplicative
+    return (uint32_t)index * 2654435761U;
+}
+
+static int32_t grid_lookup(const grid_t* g, int32_t index) {
+    uint32_t i = grid_hash_of(index) & g->hash_mask;
+    for (;;) {
+        const int32_t s = g->hash[i];
+        if (s < 0) { return -1; }
+        if (g->thumbs[s].index == index) { return s; }
+        i = (i + 1) & g->hash_mask;
+    }
+}
+
+static void grid_hash_put(grid_t* g, int32_t slot) {
+    uint32_t i = grid_hash_of(g->thumbs[slot].index) & g->hash_mask;
+    while (g->hash[i] >= 0) { i = (i + 1) & g->hash_mask; }
+    g->hash[i] = slot;
+}
+
+static void grid_hash_remove(grid_t* g, int32_t slot) {
+    uint32_t i = grid_hash_of(g->thumbs[slot].index) & g->hash_mask;
+    while (g->hash[i] != slot) {
+        assert(g->hash[i] >= 0, "slot %d is not in the hash", slot);
+        i = (i + 1) & g->hash_mask;
+    }
+    // backward shift deletion keeps probe sequences intact without tombstones
+    uint32_t j = i;
+    for (;;) {
+        g->hash[i] = -1;
+        for (;;) {
+            j = (j + 1) & g->hash_mask;
+            if (g->hash[j] < 0) { return; }
+            uint32_t k = grid_hash_of(g->thumbs[g->hash[j]].index) & g->hash_mask;
+            // entry at j may move to i only if its home k is not in ]i..j]
+            bool stays = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+            if (!stays) { break; }
+        }
+        g->hash[i] = g->hash[j];
+        i = j;
+    }
+}
+
+static void grid_unlink(grid_t* g, int32_t s) {
+    grid_thumb_t* t = &g->thumbs[s];
+    if (t->prev >= 0) { g->thumbs[t->prev].next = t->next; } else { g->mru = t->next; }
+    if (t->next >= 0) { g->thumbs[t->next].prev = t->prev; } else { g->lru = t->prev; }
+    t->prev = -1;
+    t->next = -1;
+}
+
+static void grid_push_front(grid_t* g, int32_t s) {
+    grid_thumb_t* t = &g->thumbs[s];
+    t->prev = -1;
+    t->next = g->mru;
+    if (g->mru >= 0) { g->thumbs[g->mru].prev = s; }
+    g->mru = s;
+    if (g->lru < 0) { g->lru = s; }
+}
+
+static void grid_push_back(grid_t* g, int32_t s) {
+    grid_thumb_t* t = &g->thumbs[s];
+    t->next = -1;
+    t->prev = g->lru;
+    if (g->lru >= 0) { g->thumbs[g->lru].next = s; }
+    g->lru = s;
+    if (g->mru < 0) { g->mru = s; }
+}
+
+static void grid_reset(grid_t* g) {
+    g->mru = -1;
+    g->lru = -1;
+    for (int32_t i = 0; i <= g->hash_mask; i++) { g->hash[i] = -1; }
+    for (int32_t s = 0; s < g->capacity; s++) {
+        grid_thumb_t* t = &g->thumbs[s];
+        assert(t->state != grid_decoding, "reset() while slot %d is decoding", s);
+        t->index = -1;
+        t->state = grid_free;
+        t->w = 0;
+        t->h = 0;
+        grid_push_front(g, s);
+    }
+    g->queued = 0;
+}
+
+static void grid_fini(grid_t* g) {
+    free(g->thumbs);
+    free(g->memory);
+    free(g->hash);
+    free(g->queue);
+    memset(g, 0, sizeof(*g));
+}
+
+static int grid_init(grid_t* g, int32_t capacity, int32_t thumb_w, int32_t thumb_h,
+        int32_t bpp, int32_t gap) {
+    assert(capacity > 0 && thumb_w > 0 && thumb_h > 0 && bpp > 0);
+    memset(g, 0, sizeof(*g));
+    g->capacity = capacity;
+    g->thumb_w = thumb_w;
+    g->thumb_h = thumb_h;
+    g->bpp = bpp;
+    g->gap = gap;
+    g->prefetch = 2;
+    g->columns = 1;
+    const int32_t hash_size = grid_pow2(capacity * 2);
+    const size_t thumb_bytes = (size_t)thumb_w * thumb_h * bpp;
+    g->thumbs = (grid_thumb_t*)calloc(capacity, sizeof(grid_thumb_t));
+    g->memory = (byte*)malloc(thumb_bytes * capacity);
+    g->hash   = (int32_t*)malloc(hash_size * sizeof(int32_t));
+    g->queue_capacity = capacity;
+    g->queue  = (grid_request_t*)malloc(capacity * sizeof(grid_request_t));
+    if (g->thumbs == null || g->memory == null || g->hash == null || g->queue == null) {
+        grid_fini(g);
+        return ENOMEM;
+    }
+    g->hash_mask = hash_size - 1;
+    for (int32_t s = 0; s < capacity; s++) {
+        g->thumbs[s].pixels = g->memory + thumb_bytes * s;
+    }
+    grid_reset(g);
+    return 0;
+}
+
+static bool grid_pinned(const grid_t* g) {
+    for (int32_t s = 0; s < g->capacity; s++) {
+        if (g->thumbs[s].state == grid_decoding) { return true; }
+    }
+    return false;
+}
+
+// Slots keep their numbers and cached thumbnails, new free slots are the
+// least recently used. thumbs[] and memory move: callers hold slot
+// pointers only while decoding, so it is never done while a slot is pinned.
+static int grid_grow(grid_t* g, int32_t capacity) {
+    assert(capacity > g->capacity && !grid_pinned(g));
+    const size_t thumb_bytes = (size_t)g->thumb_w * g->thumb_h * g->bpp;
+    const int32_t hash_size = grid_pow2(capacity * 2);
+    // on failure the arrays that did grow stay larger than capacity
+    grid_thumb_t* thumbs = (grid_thumb_t*)realloc(g->thumbs, capacity * sizeof(grid_thumb_t));
+    if (thumbs == null) { return ENOMEM; }
+    g->thumbs = thumbs;
+    byte* memory = (byte*)realloc(g->memory, thumb_bytes * capacity);
+    if (memory == null) { return ENOMEM; }
+    g->memory = memory;
+    for (int32_t s = 0; s < g->capacity; s++) {
+        g->thumbs[s].pixels = g->memory + thumb_bytes * s;
+    }
+    grid_request_t* queue = (grid_request_t*)realloc(g->queue,
+        capacity * sizeof(grid_request_t));
+    if (queue == null) { return ENOMEM; }
+    g->queue = queue;
+    int32_t* hash = (int32_t*)malloc(hash_size * sizeof(int32_t));
+    if (hash == null) { return ENOMEM; }
+    free(g->hash);
+    g->hash = hash;
+    g->hash_mask = hash_size - 1;
+    for (int32_t i = 0; i <= g->hash_mask; i++) { g->hash[i] = -1; }
+    for (int32_t s = 0; s < g->capacity; s++) {
+        if (g->thumbs[s].index >= 0) { grid_hash_put(g, s); }
+    }
+    for (int32_t s = g->capacity; s < capacity; s++) {
+        grid_thumb_t* t = &g->thumbs[s];
+        memset(t, 0, sizeof(*t));
+        t->index = -1;
+        t->state = grid_free;
+        t->pixels = g->memory + thumb_bytes * s;
+        grid_push_back(g, s);
+    }
+    g->capacity = capacity;
+    g->queue_capacity = capacity;
+    return 0;
+}
+
+static int64_t grid_height(const grid_t* g) {
+    return (int64_t)g->rows * (g->thumb_h + g->gap) + g->gap;
+}
+
+static bool grid_scroll(grid_t* g, int64_t delta) {
+    const int64_t limit = grid_height(g) - g->view_h;
+    int64_t s = g->scroll + delta;
+    if (s > limit) { s = limit; }
+    if (s < 0) { s = 0; }
+    const bool changed = s != g->scroll;
+    g->scroll = s;
+    return changed;
+}
+
+static int grid_layout(grid_t* g, int32_t count, int32_t view_w, int32_t view_h) {
+    g->count = count;
+    g->view_w = view_w;
+    g->view_h = view_h;
+    const int32_t cw = g->thumb_w + g->gap;
+    const int32_t ch = g->thumb_h + g->gap;
+    g->columns = view_w > g->gap ? (view_w - g->gap) / cw : 1;
+    if (g->columns < 1) { g->columns = 1; }
+    g->rows = (count + g->columns - 1) / g->columns;
+    // visible rows including partially visible at top and bottom:
+    const int32_t visible_rows = (view_h + ch - 1) / ch + 1;
+    // cache holds at least all visible cells and one prefetch row above
+    // and below them, it grows with the viewport and never shrinks
+    int r = 0;
+    const int32_t needed = (visible_rows + 2) * g->columns;
+    if (needed > g->capacity && !grid_pinned(g)) { r = grid_grow(g, needed); }
+    const int32_t cache_rows = g->capacity / g->columns;
+    g->prefetch = (cache_rows - visible_rows) / 2;
+    if (g->prefetch > 2) { g->prefetch = 2; }
+    if (g->prefetch < 0) { g->prefetch = 0; }
+    grid_scroll(g, 0); // clamp
+    return r;
+}
+
+static void grid_cell(const grid_t* g, int32_t index, int32_t* x, int32_t* y) {
+    const int32_t row = index / g->columns;
+    const int32_t col = index % g->columns;
+    *x = g->gap + col * (g->thumb_w + g->gap);
+    *y = (int32_t)(g->gap + (int64_t)row * (g->thumb_h + g->gap) - g->scroll);
+}
+
+static void grid_queue_push(grid_t* g, int32_t index, int32_t priority) {
+    if (g->queued >= g->queue_capacity) { return; } // cache can not hold more
+    int32_t i = g->queued++;
+    while (i > 0) {
+        const int32_t parent = (i - 1) / 2;
+        if (g->queue[parent].priority <= priority) { break; }
+        g->queue[i] = g->queue[parent];
+        i = parent;
+    }
+    g->queue[i].index = index;
+    g->queue[i].priority = priority;
+}
+
+static grid_request_t grid_queue_pop(grid_t* g) {
+    assert(g->queued > 0);
+    const grid_request_t top = g->queue[0];
+    const grid_request_t last = g->queue[--g->queued];
+    int32_t i = 0;
+    for (;;) {
+        int32_t c = i * 2 + 1;
+        if (c >= g->queued) { break; }
+        if (c + 1 < g->queued && g->queue[c + 1].priority < g->queue[c].priority) { c++; }
+        if (last.priority <= g->queue[c].priority) { break; }
+        g->queue[i] = g->queue[c];
+        i = c;
+    }
+    if (g->queued > 0) { g->queue[i] = last; }
+    return top;
+}
+
+static void grid_range(const grid_t* g, int32_t* lo, int32_t* hi) {
+    const int32_t pre = g->prefetch * g->columns;
+    *lo = g->first - pre < 0 ? 0 : g->first - pre;
+    *hi = g->last + pre > g->count ? g->count : g->last + pre;
+}
+
+static void grid_update(grid_t* g) {
+    const int32_t ch = g->thumb_h + g->gap;
+    const int32_t top_row = (int32_t)(g->scroll / ch);
+    const int32_t bottom_row = (int32_t)((g->scroll + g->view_h + ch - 1) / ch);
+    g->first = top_row * g->columns;
+    g->last  = bottom_row * g->columns;
+    if (g->first > g->count) { g->first = g->count; }
+    if (g->last  > g->count) { g->last  = g->count; }
+    // only until layout() could grow the cache (no slot decoding) or
+    // when growing failed: cells past capacity are not drawn
+    if (g->last - g->first > g->capacity) { g->last = g->first + g->capacity; }
+    int32_t lo = 0;
+    int32_t hi = 0;
+    grid_range(g, &lo, &hi);
+    for (int32_t i = 0; i < g->queued; i++) {
+        if (g->queue[i].index < lo || g->queue[i].index >= hi) { g->cancelled++; }
+    }
+    g->queued = 0;
+    // visible cells first in reading order, then prefetch rows by distance
+    for (int32_t i = lo; i < hi; i++) {
+        if (grid_lookup(g, i) < 0) {
+            int32_t priority = 0;
+            if (i < g->first) {
+                priority = g->count + (g->first - i);
+            } else if (i >= g->last) {
+                priority = g->count + (i - g->last + 1);
+            } else {
+                priority = i - g->first;
+            }
+            grid_queue_push(g, i, priority);
+        }
+    }
+}
+
+static const grid_thumb_t* grid_get(grid_t* g, int32_t index) {
+    const int32_t s = grid_lookup(g, index);
+    if (s >= 0 && g->thumbs[s].state == grid_ready) {
+        g->hits++;
+        grid_unlink(g, s);
+        grid_push_front(g, s);
+        return &g->thumbs[s];
+    }
+    return null;
+}
+
+static int32_t grid_victim(grid_t* g) {
+    int32_t lo = 0;
+    int32_t hi = 0;
+    grid_range(g, &lo, &hi);
+    for (int32_t s = g->lru; s >= 0; s = g->thumbs[s].prev) {
+        const grid_thumb_t* t = &g->thumbs[s];
+        if (t->state == grid_free) { return s; }
+        if (t->state != grid_decoding && (t->index < lo || t->index >= hi)) {
+            return s;
+        }
+    }
+    return -1;
+}
+
+static grid_thumb_t* grid_next(grid_t* g) {
+    while (g->queued > 0) {
+        const grid_request_t r = grid_queue_pop(g);
+        if (grid_lookup(g, r.index) >= 0) { continue; } // decoding or cached
+        const int32_t s = grid_victim(g);
+        if (s < 0) { return null; } // every slot is pinned or on screen
+        grid_thumb_t* t = &g->thumbs[s];
+        if (t->state != grid_free) {
+            grid_hash_remove(g, s);
+            g->evictions++;
+        }
+        g->misses++;
+        t->index = r.index;
+        t->state = grid_decoding;
+        t->w = 0;
+        t->h = 0;
+        grid_hash_put(g, s);
+        grid_unlink(g, s);
+        grid_push_front(g, s);
+        return t;
+    }
+    return null;
+}
+
+static void grid_done(grid_t* g, grid_thumb_t* t, int32_t w, int32_t h) {
+    (void)g;
+    assert(t->state == grid_decoding);
+    assert(0 <= w && w <= g->thumb_w && 0 <= h && h <= g->thumb_h);
+    t->w = w;
+    t->h = h;
+    t->state = w > 0 && h > 0 ? grid_ready : grid_failed;
+}
+
+static bool grid_expect(bool ok, const char* what) {
+    if (!ok) { traceln("grid: %s", what); }
+    return ok;
+}
+
+// every cached slot is found through the hash and nothing else is in it
+static bool grid_consistent(const grid_t* g) {
+    int32_t cached = 0;
+    for (int32_t s = 0; s < g->capacity; s++) {
+        const grid_thumb_t* t = &g->thumbs[s];
+        if (t->index >= 0) {
+            cached++;
+            if (grid_lookup(g, t->index) != s) { return false; }
+        }
+    }
+    int32_t hashed = 0;
+    for (int32_t i = 0; i <= g->hash_mask; i++) { hashed += g->hash[i] >= 0; }
+    int32_t listed = 0; // LRU list links all slots
+    for (int32_t s = g->mru; s >= 0 && listed <= g->capacity; s = g->thumbs[s].next) {
+        listed++;
+    }
+    return hashed == cached && listed == g->capacity;
+}
+
+// decodes every queued request (1x1 thumbnails), returns number decoded
+static int32_t grid_test_drain(grid_t* g, int32_t max) {
+    int32_t n = 0;
+    grid_thumb_t* t = null;
+    while (n < max && (t = grid_next(g)) != null) {
+        grid_done(g, t, 1, 1);
+        n++;
+    }
+    return n;
+}
+
+static int grid_test(void) {
+    grid_t g = {0};
+    int r = grid_init(&g, 8, 10, 10, 1, 0);
+    bool ok = r == 0;
+    // 3 columns, 4 visible rows (partial bottom row): 18 slots with one
+    // prefetch row above and below
+    ok = ok && grid_expect(grid_layout(&g, 1000, 30, 30) == 0 && g.capacity == 18 &&
+        g.columns == 3 && g.prefetch == 1, "cache did not grow to the viewport");
+    ok = ok && grid_expect(grid_consistent(&g), "inconsistent after grow");
+    if (ok) { grid_update(&g); }
+    ok = ok && grid_expect(g.first == 0 && g.last == 9 && g.queued == 12,
+        "visible cells and prefetch row not queued");
+    ok = ok && grid_expect(grid_test_drain(&g, 100) == 12 && g.misses == 12,
+        "queued cells not decoded");
+    for (int32_t i = 0; i < 12 && ok; i++) {
+        ok = grid_expect(grid_get(&g, i) != null, "decoded cell not cached");
+    }
+    // scroll away: 15 requests, only two decoded before scrolling back
+    if (ok) {
+        grid_scroll(&g, 600);
+        grid_update(&g);
+    }
+    ok = ok && grid_expect(g.first == 180 && g.queued == 15, "scrolled cells not queued");
+    ok = ok && grid_expect(grid_test_drain(&g, 2) == 2 && g.evictions == 0,
+        "free slots not used first");
+    if (ok) {
+        grid_scroll(&g, -600);
+        grid_update(&g);
+    }
+    ok = ok && grid_expect(g.cancelled == 13 && g.queued == 0,
+        "off-screen requests not cancelled on scroll");
+    // LRU: cells 0..11 used in order after 180 and 181 were decoded
+    for (int32_t i = 0; i < 12 && ok; i++) { grid_get(&g, i); }
+    if (ok) {
+        grid_scroll(&g, 600);
+        grid_update(&g);
+    }
+    // 180 and 181 are still cached: 13 requests fill 4 free slots and
+    // evict 9 least recently used cells
+    ok = ok && grid_expect(g.queued == 13, "cached cells queued again");
+    ok = ok && grid_expect(grid_test_drain(&g, 100) == 13 && g.evictions == 9,
+        "unexpected number of evictions");
+    for (int32_t i = 0; i < 12 && ok; i++) { // least recently used went first
+        ok = grid_expect((grid_lookup(&g, i) >= 0) == (i >= 9), "eviction not in LRU order");
+    }
+    ok = ok && grid_expect(grid_consistent(&g), "inconsistent after eviction");
+    // random scrolling: backward shift deletion keeps every probe sequence
+    uint32_t seed = 1;
+    for (int32_t i = 0; i < 10000 && ok; i++) {
+        seed = seed * 1664525U + 1013904223U;
+        grid_scroll(&g, (int64_t)((seed >> 8) % 2001) - 1000);
+        grid_update(&g);
+        grid_test_drain(&g, (int32_t)((seed >> 24) % 20));
+        ok = grid_expect(grid_consistent(&g), "hash lost a slot on delete");
+    }
+    // taller view while a slot is decoding: growth waits for done()
+    grid_thumb_t* pinned = null;
+    if (ok) {
+        grid_scroll(&g, -INT32_MAX);
+        grid_update(&g);
+        grid_scroll(&g, 3005); // 7 partially visible rows at 60 pixels
+        grid_update(&g);
+        pinned = grid_next(&g);
+    }
+    ok = ok && grid_expect(pinned != null && grid_layout(&g, 1000, 30, 60) == 0 &&
+        g.capacity == 18, "grew while a slot was pinned");
+    if (ok) { grid_done(&g, pinned, 1, 1); }
+    ok = ok && grid_expect(grid_layout(&g, 1000, 30, 60) == 0 && g.capacity == 27 &&
+        grid_consistent(&g), "did not grow after done()");
+    if (ok) { grid_update(&g); }
+    ok = ok && grid_expect(g.last - g.first == 21, "visible cells clamped");
+    if (g.thumbs != null) { grid_fini(&g); }
+    if (r == 0 && !ok) { r = EINVAL; }
+    traceln("grid: test %s", r == 0 ? "passed" : "FAILED");
+    return r;
+}
+
+grid_if grid = {
+    .init   = grid_init,
+    .layout = grid_layout,
+    .scroll = grid_scroll,
+    .height = grid_height,
+    .cell   = grid_cell,
+    .update = grid_update,
+    .get    = grid_get,
+    .next   = grid_next,
+    .done   = grid_done,
+    .reset  = grid_reset,
+    .fini   = grid_fini,
+    .test   = grid_test
+};
+
+end_c
@@ -0,0 +1,106 @@
+#pragma once
+#include "crt.h"
+
+begin_c
+
+// Headless virtualized thumbnail grid.
+// Only cells intersecting the viewport (plus a few prefetch rows) are
+// ever requested. Decoded thumbnails live in a pool of `capacity` slots
+// recycled in LRU order so memory use does not depend on the number of
+// items in the library. layout() grows the pool to hold every visible
+// cell of the viewport. Pending decodes are kept in a priority
+// queue that is rebuilt on every update() so scrolling implicitly cancels
+// requests for cells that went off-screen.
+// Not thread safe: callers serialize access (e.g. with a mutex) and
+// decode outside of the lock into the pinned slot returned by next().
+
+typedef struct grid_thumb_s {
+    int32_t index; // item index or -1 if slot is free
+    int32_t w;     // decoded thumbnail width  (<= grid.thumb_w)
+    int32_t h;     // decoded thumbnail height (<= grid.thumb_h)
+    int32_t state; // grid_free, grid_decoding, grid_ready, grid_failed
+    byte* pixels;  // thumb_w * thumb_h * bpp bytes
+    int32_t prev;  // LRU list links (slot numbers)
+    int32_t next;
+} grid_thumb_t;
+
+enum {
+    grid_free     = 0,
+    grid_decoding = 1, // pinned: slot can not be evicted
+    grid_ready    = 2,
+    grid_failed   = 3  // remembered so broken files are not retried
+};
+
+typedef struct grid_request_s {
+    int32_t index;
+    int32_t priority; // lower value is more urgent
+} grid_request_t;
+
+typedef struct grid_s {
+    int32_t count;    // number of items in the library
+    int32_t thumb_w;  // thumbnail box
+    int32_t thumb_h;
+    int32_t bpp;      // bytes per pixel of decoded thumbnails
+    int32_t gap;      // pixels between cells
+    int32_t view_w;   // viewport
+    int32_t view_h;
+    int32_t columns;
+    int32_t rows;     // total rows for count items
+    int64_t scroll;   // vertical scroll position in pixels
+    int32_t first;    // visible items [first..last[
+    int32_t last;
+    int32_t prefetch; // rows prefetched above and below viewport
+    // LRU cache of decoded thumbnails:
+    grid_thumb_t* thumbs;
+    int32_t capacity;
+    int32_t mru;      // most recently used slot or -1
+    int32_t lru;      // least recently used slot or -1
+    byte* memory;     // capacity * thumb_w * thumb_h * bpp
+    // open addressing hash: item index -> slot, 2 * capacity rounded up to pow2
+    int32_t* hash;
+    int32_t hash_mask;
+    // priority queue (binary min heap) of pending decode requests:
+    grid_request_t* queue;
+    int32_t queued;
+    int32_t queue_capacity;
+    // statistics:
+    int64_t hits;
+    int64_t misses;
+    int64_t evictions;
+    int64_t cancelled;
+} grid_t;
+
+typedef struct {
+    // returns 0 or ENOMEM, capacity is the initial number of slots
+    int (*init)(grid_t* g, int32_t capacity, int32_t thumb_w, int32_t thumb_h,
+        int32_t bpp, int32_t gap);
+    // sets number of items and viewport size, recomputes columns/rows and
+    // grows capacity to the viewport (slots and their pixels move, deferred
+    // while any slot is decoding), returns 0 or ENOMEM
+    int (*layout)(grid_t* g, int32_t count, int32_t view_w, int32_t view_h);
+    // scroll by delta pixels (clamped to content), returns true if changed
+    bool (*scroll)(grid_t* g, int64_t delta);
+    // total content height in pixels
+    int64_t (*height)(const grid_t* g);
+    // cell rectangle of item in viewport coordinates (may be off-screen)
+    void (*cell)(const grid_t* g, int32_t index, int32_t* x, int32_t* y);
+    // recomputes visible range and rebuilds decode queue
+    void (*update)(grid_t* g);
+    // ready thumbnail for item or null; marks the slot most recently used
+    const grid_thumb_t* (*get)(grid_t* g, int32_t index);
+    // pops the most urgent request, pins a slot for it and returns
+    // the slot or null if there is nothing to decode
+    grid_thumb_t* (*next)(grid_t* g);
+    // unpins slot after decode; w == 0 || h == 0 marks failure
+    void (*done)(grid_t* g, grid_thumb_t* t, int32_t w, int32_t h);
+    // drops all cached thumbnails (e.g. library changed)
+    void (*reset)(grid_t* g);
+    void (*fini)(grid_t* g);
+    // headless self check of LRU eviction, hash deletion, cancellation of
+    // off-screen requests on scroll and growth, returns 0 or error
+    int (*test)(void);
+} grid_if;
+
+extern grid_if grid;
+
+end_c
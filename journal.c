@@ -0,0 +1,210 @@
+#include "journal.h"
+#ifdef _WIN32
+#include <io.h>
+#define fsync(fd) _commit(fd)
+#define fileno(f) _fileno(f)
+#else
+#include <unistd.h>
+#define _fseeki64 fseeko
+#define _ftelli64 ftello
+#endif
+
+begin_c
+
+static const double journal_sync_seconds = 2.0;
+
+typedef struct journal_s {
+    FILE* file;
+    uint64_t* keys;    // keys[seq] != 0 for completed seq
+    int32_t allocated; // number of keys[]
+    int32_t completed;
+    int32_t unsynced;  // records appended since last sync
+    double synced;     // time of last sync
+    int (*flush)(void* that); // before each fsync() of the journal
+    void* that;
+} journal_t_;
+
+static int journal_reserve(journal_t_* j, int32_t seq) {
+    if (seq >= j->allocated) {
+        int32_t n = j->allocated == 0 ? 4096 : j->allocated;
+        while (n <= seq) { n *= 2; }
+        uint64_t* k = (uint64_t*)realloc(j->keys, n * sizeof(uint64_t));
+        if (k == null) { return ENOMEM; }
+        memset(k + j->allocated, 0, (n - j->allocated) * sizeof(uint64_t));
+        j->keys = k;
+        j->allocated = n;
+    }
+    return 0;
+}
+
+static void journal_mark(journal_t_* j, int32_t seq, uint64_t key) {
+    if (j->keys[seq] == 0) { j->completed++; }
+    j->keys[seq] = key | 1; // never zero
+}
+
+// complete output has the recorded size and ends with JPEG EOI marker,
+// video clones (ISO base media "ftyp" first, possibly multi-GB) have no
+// end marker to check
+static bool journal_verify(const char* output, int64_t bytes) {
+    FILE* f = fopen(output, "rb");
+    bool ok = f != null;
+    if (ok) {
+        uint8_t head[8] = {0};
+        uint8_t eoi[2] = {0};
+        ok = fread(head, 1, 8, f) == 8 && _fseeki64(f, 0, SEEK_END) == 0 &&
+             _ftelli64(f) == bytes;
+        if (ok && memcmp(head + 4, "ftyp", 4) != 0) {
+            ok = _fseeki64(f, -2, SEEK_END) == 0 && fread(eoi, 1, 2, f) == 2 &&
+                 eoi[0] == 0xFF && eoi[1] == 0xD9;
+        }
+        fclose(f);
+    }
+    return ok;
+}
+
+typedef struct journal_record_s {
+    int32_t seq;
+    uint64_t key;
+    int64_t bytes;
+    char output[260];
+} journal_record_t;
+
+static bool journal_parse(const char* line, journal_record_t* r) {
+    const int n = (int)strlen(line);
+    if (n == 0 || line[n - 1] != '\n') { return false; } // torn write
+    unsigned long long key = 0;
+    long long bytes = 0;
+    int pos = 0;
+    if (sscanf(line, "%d %llX %lld %n", &r->seq, &key, &bytes, &pos) != 3 ||
+        r->seq <= 0 || pos <= 0 || n - pos - 1 >= countof(r->output)) {
+        return false;
+    }
+    r->key = key;
+    r->bytes = bytes;
+    memcpy(r->output, line + pos, n - pos - 1);
+    r->output[n - pos - 1] = 0;
+    return true;
+}
+
+static void journal_close(journal_t handle) {
+    journal_t_* j = (journal_t_*)handle;
+    if (j != null) {
+        if (j->file != null) {
+            if (j->flush != null) { j->flush(j->that); }
+            fflush(j->file);
+            fsync(fileno(j->file));
+            fclose(j->file);
+        }
+        free(j->keys);
+        free(j);
+    }
+}
+
+static journal_t journal_open(const char* pathname, int32_t verify,
+        int (*flush)(void* that), void* that) {
+    journal_t_* j = (journal_t_*)calloc(1, sizeof(journal_t_));
+    if (j == null) { return null; }
+    j->flush = flush;
+    j->that = that;
+    journal_record_t* tail = (journal_record_t*)calloc(verify > 0 ? verify : 1,
+        sizeof(journal_record_t));
+    int32_t records = 0;
+    int64_t valid = 0; // bytes of valid prefix
+    FILE* f = fopen(pathname, "rb");
+    if (f != null) {
+        char line[512];
+        journal_record_t r = {0};
+        while (tail != null && fgets(line, countof(line), f) != null && journal_parse(line, &r)) {
+            if (journal_reserve(j, r.seq) != 0) { break; }
+            journal_mark(j, r.seq, r.key);
+            if (verify > 0) { tail[records % verify] = r; }
+            records++;
+            valid = ftell(f);
+        }
+        fclose(f);
+    }
+    // last records may refer to outputs that did not reach the disk
+    const int32_t n = records < verify ? records : verify;
+    for (int32_t i = 0; i < n; i++) {
+        const journal_record_t* r = &tail[(records - 1 - i) % verify];
+        bool superseded = false; // by a later record for the same seq
+        for (int32_t k = 0; k < i && !superseded; k++) {
+            superseded = tail[(records - 1 - k) % verify].seq == r->seq;
+        }
+        if (!superseded && !journal_verify(r->output, r->bytes)) {
+            traceln("journal: %06d %s incomplete, will redo", r->seq, r->output);
+            j->keys[r->seq] = 0;
+            j->completed--;
+        }
+    }
+    free(tail);
+    // reopen for update and continue after the last valid record
+    j->file = fopen(pathname, f != null ? "r+b" : "w+b");
+    if (j->file == null || fseek(j->file, (long)valid, SEEK_SET) != 0) {
+        traceln("journal: failed to open %s", pathname);
+        journal_close((journal_t)j);
+        return null;
+    }
+    if (records > 0) {
+        traceln("journal: %s %d completed of %d records", pathname, j->completed, records);
+    }
+    j->synced = crt.seconds();
+    return (journal_t)j;
+}
+
+static bool journal_done(journal_t handle, int32_t seq, uint64_t key) {
+    journal_t_* j = (journal_t_*)handle;
+    if (seq >= j->allocated || j->keys[seq] == 0) { return false; }
+    if (j->keys[seq] != (key | 1)) {
+        traceln("journal: %06d source changed since last run", seq);
+        return false;
+    }
+    return true;
+}
+
+static int journal_sync(journal_t handle) {
+    journal_t_* j = (journal_t_*)handle;
+    int r = j->flush != null ? j->flush(j->that) : 0;
+    if (fflush(j->file) != 0 && r == 0) { r = errno; }
+    if (fsync(fileno(j->file)) != 0 && r == 0) { r = errno; }
+    j->unsynced = 0;
+    j->synced = crt.seconds();
+    return r;
+}
+
+static int journal_append(journal_t handle, int32_t seq, uint64_t key,
+        const char* output, int64_t bytes) {
+    journal_t_* j = (journal_t_*)handle;
+    int r = journal_reserve(j, seq);
+    if (r == 0) {
+        if (fprintf(j->file, "%d %016llX %lld %s\n", seq, (unsigned long long)key,
+                (long long)bytes, output) < 0 || fflush(j->file) != 0) {
+            r = errno;
+        }
+    }
+    if (r == 0) {
+        journal_mark(j, seq, key);
+        j->unsynced++;
+        if (j->unsynced >= journal_sync_records ||
+            crt.seconds() - j->synced >= journal_sync_seconds) {
+            r = journal_sync(handle);
+        }
+    }
+    return r;
+}
+
+static int32_t journal_completed(journal_t handle) {
+    journal_t_* j = (journal_t_*)handle;
+    return j->completed;
+}
+
+journal_if journal = {
+    .open      = journal_open,
+    .done      = journal_done,
+    .append    = journal_append,
+    .sync      = journal_sync,
+    .completed = journal_completed,
+    .close     = journal_close
+};
+
+end_c
@@ -0,0 +1,41 @@
+#pragma once
+#include "crt.h"
+
+begin_c
+
+// Crash-safe checkpoint journal of completed work.
+// Append-only text file, one line per completed sequence number:
+//     "<seq> <source key> <bytes> <output pathname>\n"
+// Lines are flushed as written and fsync()ed periodically, so after
+// power loss at most the records since the last sync are lost and
+// their outputs are simply produced again with the same numbering.
+// A torn last line is ignored. The last few records found at open()
+// are re-verified against the outputs on disk because their data may
+// not have reached the disk before the journal record did. The flush
+// callback given to open() runs before every fsync() of the journal and
+// makes what records refer to (catalog lines, outputs) durable first.
+// Records appended after the last fsync() may reach the disk before their
+// outputs do: open() should verify at least journal_sync_records.
+
+enum { journal_sync_records = 64 }; // fsync() at least every 64 records
+
+typedef struct journal_s* journal_t;
+
+typedef struct {
+    // opens (or creates) journal at pathname and re-verifies
+    // the last `verify` outputs it refers to, flush may be null
+    journal_t (*open)(const char* pathname, int32_t verify,
+        int (*flush)(void* that), void* that);
+    // true if seq was completed for the same source key
+    bool (*done)(journal_t j, int32_t seq, uint64_t key);
+    // records completed seq, fsync()s every sync_records or sync_seconds
+    int (*append)(journal_t j, int32_t seq, uint64_t key, const char* output,
+        int64_t bytes);
+    int (*sync)(journal_t j);
+    int32_t (*completed)(journal_t j); // number of completed records
+    void (*close)(journal_t j);
+} journal_if;
+
+extern journal_if journal;
+
+end_c
@@ -0,0 +1,468 @@
+#include "meta.h"
+#include <Windows.h>
+#include <math.h>
+
+begin_c
+
+enum { meta_segment_max = 0xFFFF + 2 }; // including FF Ex marker
+
+static const char meta_xmp_ns[] = "http://ns.adobe.com/xap/1.0/"; // with '\0'
+
+// marks XMP packets written by meta_xmp_packet(): only such files are edited
+static const char meta_tool[] = " xmp:CreatorTool=\"photos\"";
+
+// writes into out while it fits and always counts: the same code measures
+// (out == null) and serializes, so precomputed sizes cannot disagree
+typedef struct meta_writer_s {
+    uint8_t* out;
+    int64_t count;
+    int64_t n;
+} meta_writer_t;
+
+static void meta_put(meta_writer_t* w, const void* data, int64_t bytes) {
+    if (w->out != null && w->n + bytes <= w->count) { memcpy(w->out + w->n, data, bytes); }
+    w->n += bytes;
+}
+
+static void meta_str(meta_writer_t* w, const char* s) { meta_put(w, s, strlen(s)); }
+
+static void meta_be16(meta_writer_t* w, uint32_t v) {
+    const uint8_t b[2] = { (uint8_t)(v >> 8), (uint8_t)v };
+    meta_put(w, b, sizeof(b));
+}
+
+static void meta_be32(meta_writer_t* w, uint32_t v) {
+    const uint8_t b[4] = { (uint8_t)(v >> 24), (uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v };
+    meta_put(w, b, sizeof(b));
+}
+
+static void meta_escaped(meta_writer_t* w, const char* s) {
+    for (const char* c = s; *c != 0; c++) {
+        switch (*c) {
+            case '&': meta_str(w, "&amp;");  break;
+            case '<': meta_str(w, "&lt;");   break;
+            case '>': meta_str(w, "&gt;");   break;
+            case '"': meta_str(w, "&quot;"); break;
+            default : meta_put(w, c, 1);     break;
+        }
+    }
+}
+
+enum { tiff_byte = 1, tiff_ascii = 2, tiff_long = 4, tiff_rational = 5 };
+
+static void meta_entry(meta_writer_t* w, uint16_t tag, uint16_t type, uint32_t count,
+        uint32_t value) {
+    meta_be16(w, tag);
+    meta_be16(w, type);
+    meta_be32(w, count);
+    meta_be32(w, value);
+}
+
+// value of up to 4 bytes is stored in the entry itself, left justified
+static void meta_entry_inline(meta_writer_t* w, uint16_t tag, uint16_t type,
+        uint32_t count, const void* value) {
+    uint8_t inline_value[4] = {0};
+    memcpy(inline_value, value, count);
+    meta_be16(w, tag);
+    meta_be16(w, type);
+    meta_be32(w, count);
+    meta_put(w, inline_value, 4);
+}
+
+// TIFF ASCII entry: count includes '\0', values up to 4 bytes are inline
+static void meta_ascii(meta_writer_t* w, uint16_t tag, const char* s, uint32_t offset) {
+    const uint32_t count = (uint32_t)strlen(s) + 1;
+    if (count <= 4) {
+        meta_entry_inline(w, tag, tiff_ascii, count, s);
+    } else {
+        meta_entry(w, tag, tiff_ascii, count, offset);
+    }
+}
+
+static uint32_t meta_ascii_area(const char* s) { // word aligned value bytes
+    const uint32_t count = (uint32_t)strlen(s) + 1;
+    return count <= 4 ? 0 : (count + 1) & ~1U;
+}
+
+static void meta_ascii_value(meta_writer_t* w, const char* s) {
+    const uint32_t area = meta_ascii_area(s);
+    if (area > 0) {
+        const uint32_t count = (uint32_t)strlen(s) + 1;
+        meta_put(w, s, count);
+        if (area > count) { meta_put(w, "", 1); }
+    }
+}
+
+static void meta_rational(meta_writer_t* w, double v, uint32_t denominator) {
+    meta_be32(w, (uint32_t)(v * denominator + 0.5));
+    meta_be32(w, denominator);
+}
+
+// degrees as three rationals: d/1 m/1 s/10000
+static void meta_dms(meta_writer_t* w, double degrees) {
+    const double d = floor(degrees);
+    const double m = floor((degrees - d) * 60);
+    meta_rational(w, d, 1);
+    meta_rational(w, m, 1);
+    meta_rational(w, (degrees - d) * 3600 - m * 60, 10000);
+}
+
+static bool meta_gps_date(const meta_t* m) { return strlen(m->gps.date) == 10; }
+
+static uint32_t meta_gps_entries(const meta_t* m) {
+    return 5 + (m->gps.has_altitude ? 2 : 0) + (m->gps.has_time ? 1 : 0) +
+        (meta_gps_date(m) ? 1 : 0);
+}
+
+static uint32_t meta_gps_bytes(const meta_t* m) { // GPS IFD and its values
+    if (!m->gps.has_position) { return 0; }
+    return 2 + meta_gps_entries(m) * 12 + 4 + 2 * 24 +
+        (m->gps.has_altitude ? 8 : 0) + (m->gps.has_time ? 24 : 0) +
+        (meta_gps_date(m) ? 12 : 0);
+}
+
+// GPS IFD at offset ifd (relative to TIFF header) followed by its values
+static void meta_gps(meta_writer_t* w, const meta_t* m, uint32_t ifd) {
+    const uint32_t n = meta_gps_entries(m);
+    uint32_t at = ifd + 2 + n * 12 + 4;
+    meta_be16(w, n);
+    // entries in ascending tag order
+    meta_entry_inline(w, 0x0000, tiff_byte, 4, "\x02\x03\x00\x00"); // GPSVersionID 2.3
+    meta_entry_inline(w, 0x0001, tiff_ascii, 2, m->gps.latitude < 0 ? "S" : "N");
+    meta_entry(w, 0x0002, tiff_rational, 3, at);
+    at += 24;
+    meta_entry_inline(w, 0x0003, tiff_ascii, 2, m->gps.longitude < 0 ? "W" : "E");
+    meta_entry(w, 0x0004, tiff_rational, 3, at);
+    at += 24;
+    if (m->gps.has_altitude) {
+        const uint8_t below_sea_level = m->gps.altitude < 0;
+        meta_entry_inline(w, 0x0005, tiff_byte, 1, &below_sea_level);
+        meta_entry(w, 0x0006, tiff_rational, 1, at);
+        at += 8;
+    }
+    if (m->gps.has_time) {
+        meta_entry(w, 0x0007, tiff_rational, 3, at);
+        at += 24;
+    }
+    if (meta_gps_date(m)) {
+        meta_entry(w, 0x001D, tiff_ascii, 11, at);
+        at += 12;
+    }
+    meta_be32(w, 0); // no next IFD
+    meta_dms(w, fabs(m->gps.latitude));
+    meta_dms(w, fabs(m->gps.longitude));
+    if (m->gps.has_altitude) { meta_rational(w, fabs(m->gps.altitude), 1000); }
+    if (m->gps.has_time) {
+        const double t = m->gps.time;
+        meta_rational(w, floor(t / 3600), 1);
+        meta_rational(w, floor(fmod(t, 3600) / 60), 1);
+        meta_rational(w, fmod(t, 60), 1000);
+    }
+    if (meta_gps_date(m)) {
+        meta_put(w, m->gps.date, 11); // with '\0'
+        meta_put(w, "", 1);           // word alignment
+    }
+}
+
+// padding: zero bytes reserved after the values inside the TIFF block
+static void meta_exif(meta_writer_t* w, const meta_t* m, int32_t padding) {
+    const bool gps = m->gps.has_position;
+    const uint32_t entries = gps ? 3 : 2;
+    const uint32_t ifd_bytes = 2 + entries * 12 + 4;
+    const uint32_t description = 8 + ifd_bytes; // offsets relative to TIFF header
+    const uint32_t date_time = description + meta_ascii_area(m->ImageDescription);
+    const uint32_t gps_ifd = date_time + meta_ascii_area(m->DateTimeOriginal);
+    const uint32_t tiff_bytes = gps_ifd + meta_gps_bytes(m) + padding;
+    meta_be16(w, 0xFFE1);
+    meta_be16(w, 2 + 6 + tiff_bytes); // length excludes the marker
+    meta_put(w, "Exif\0\0", 6);
+    meta_put(w, "MM\0\x2A", 4);
+    meta_be32(w, 8); // IFD0
+    meta_be16(w, entries);
+    // entries in ascending tag order
+    meta_ascii(w, 0x010E, m->ImageDescription, description);
+    if (gps) { meta_entry(w, 0x8825, tiff_long, 1, gps_ifd); } // GPSInfo IFD pointer
+    meta_ascii(w, 0x9003, m->DateTimeOriginal, date_time);
+    meta_be32(w, 0); // no next IFD
+    meta_ascii_value(w, m->ImageDescription);
+    meta_ascii_value(w, m->DateTimeOriginal);
+    if (gps) { meta_gps(w, m, gps_ifd); }
+    static const uint8_t zeros[256];
+    for (int32_t i = 0; i < padding; i += countof(zeros)) {
+        meta_put(w, zeros, padding - i < countof(zeros) ? padding - i : countof(zeros));
+    }
+}
+
+// padding: whitespace before the packet trailer
+static void meta_xmp_packet(meta_writer_t* w, const meta_t* m, int32_t padding) {
+    meta_str(w, "<?xpacket begin=\"\xEF\xBB\xBF\" id=\"W5M0MpCehiHzreSzNTczkc9d\"?>"
+        "<x:xmpmeta xmlns:x=\"adobe:ns:meta/\">"
+        "<rdf:RDF xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\">"
+        "<rdf:Description rdf:about=\"\""
+        " xmlns:xmp=\"http://ns.adobe.com/xap/1.0/\""
+        " xmlns:dc=\"http://purl.org/dc/elements/1.1/\"");
+    meta_str(w, meta_tool);
+    if (m->motion.bytes > 0) {
+        char motion[256];
+        snprintf(motion, countof(motion),
+            " xmlns:GCamera=\"http://ns.google.com/photos/1.0/camera/\""
+            " xmlns:Container=\"http://ns.google.com/photos/1.0/container/\""
+            " xmlns:Item=\"http://ns.google.com/photos/1.0/container/item/\""
+            " GCamera:MotionPhoto=\"1\" GCamera:MotionPhotoVersion=\"1\"");
+        meta_str(w, motion);
+        if (m->motion.timestamp_us >= 0) {
+            snprintf(motion, countof(motion),
+                " GCamera:MotionPhotoPresentationTimestampUs=\"%lld\"",
+                (long long)m->motion.timestamp_us);
+            meta_str(w, motion);
+        }
+        // video is the last thing in the file: for readers that predate
+        // Container:Directory the offset from the end is its length
+        snprintf(motion, countof(motion), " GCamera:MicroVideo=\"1\""
+            " GCamera:MicroVideoVersion=\"1\" GCamera:MicroVideoOffset=\"%d\"",
+            m->motion.bytes);
+        meta_str(w, motion);
+    }
+    int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+    if (sscanf(m->DateTimeOriginal, "%d:%d:%d %d:%d:%d",
+               &year, &month, &day, &hour, &minute, &second) == 6) {
+        char date[64];
+        snprintf(date, countof(date), " xmp:CreateDate=\"%04d-%02d-%02dT%02d:%02d:%02d\"",
+            year, month, day, hour, minute, second);
+        meta_str(w, date);
+    }
+    meta_str(w, ">");
+    if (m->ImageDescription[0] != 0) {
+        meta_str(w, "<dc:description><rdf:Alt><rdf:li xml:lang=\"x-default\">");
+        meta_escaped(w, m->ImageDescription);
+        meta_str(w, "</rdf:li></rdf:Alt></dc:description>");
+    }
+    if (m->subjects > 0) {
+        meta_str(w, "<dc:subject><rdf:Bag>");
+        for (int32_t i = 0; i < m->subjects; i++) {
+            meta_str(w, "<rdf:li>");
+            meta_escaped(w, m->subject[i]);
+            meta_str(w, "</rdf:li>");
+        }
+        meta_str(w, "</rdf:Bag></dc:subject>");
+    }
+    if (m->motion.bytes > 0) {
+        char item[256];
+        snprintf(item, countof(item), "<rdf:li rdf:parseType=\"Resource\"><Container:Item"
+            " Item:Mime=\"video/mp4\" Item:Semantic=\"MotionPhoto\" Item:Length=\"%d\"/>"
+            "</rdf:li>", m->motion.bytes);
+        meta_str(w, "<Container:Directory><rdf:Seq>"
+            "<rdf:li rdf:parseType=\"Resource\"><Container:Item"
+            " Item:Mime=\"image/jpeg\" Item:Semantic=\"Primary\""
+            " Item:Length=\"0\" Item:Padding=\"0\"/></rdf:li>");
+        meta_str(w, item);
+        meta_str(w, "</rdf:Seq></Container:Directory>");
+    }
+    meta_str(w, "</rdf:Description></rdf:RDF></x:xmpmeta>");
+    for (int32_t i = 0; i < padding; i++) { // XMP spec: newline every 100 bytes
+        meta_put(w, i % 100 == 99 ? "\n" : " ", 1);
+    }
+    meta_str(w, "<?xpacket end=\"w\"?>");
+}
+
+static void meta_xmp(meta_writer_t* w, const meta_t* m, int32_t padding) {
+    meta_writer_t packet = {0};
+    meta_xmp_packet(&packet, m, padding);
+    meta_be16(w, 0xFFE1);
+    meta_be16(w, (uint32_t)(2 + sizeof(meta_xmp_ns) + packet.n));
+    meta_put(w, meta_xmp_ns, sizeof(meta_xmp_ns));
+    meta_xmp_packet(w, m, padding);
+}
+
+static int32_t meta_bytes(const meta_t* m) {
+    meta_writer_t exif = {0};
+    meta_exif(&exif, m, m->padding);
+    meta_writer_t xmp = {0};
+    meta_xmp(&xmp, m, m->padding);
+    const int32_t video = m->motion.data != null ? m->motion.bytes : 0;
+    return exif.n > meta_segment_max || xmp.n > meta_segment_max ?
+        0 : (int32_t)(exif.n + xmp.n) + video;
+}
+
+static int32_t meta_insert(const uint8_t* data, int64_t bytes, const meta_t* m,
+        uint8_t* output, int64_t count) {
+    if (bytes < 4 || data[0] != 0xFF || data[1] != 0xD8) { return 0; } // SOI
+    const int32_t inserted = meta_bytes(m);
+    if (inserted == 0 || bytes + inserted > count) { return 0; }
+    meta_writer_t w = { .out = output, .count = count };
+    meta_put(&w, data, 2);
+    meta_exif(&w, m, m->padding);
+    meta_xmp(&w, m, m->padding);
+    meta_put(&w, data + 2, bytes - 2);
+    if (m->motion.data != null) { meta_put(&w, m->motion.data, m->motion.bytes); }
+    assert(w.n == bytes + inserted);
+    return (int32_t)w.n;
+}
+
+// finds EXIF and XMP APP1 among APPn segments that follow SOI, offset 0: absent
+static void meta_segments(const uint8_t* data, int64_t bytes,
+        int32_t* exif, int32_t* exif_bytes, int32_t* xmp, int32_t* xmp_bytes) {
+    *exif = 0;
+    *xmp = 0;
+    int64_t at = 2;
+    while (at + 4 <= bytes && data[at] == 0xFF && (data[at + 1] & 0xF0) == 0xE0) {
+        const int32_t n = 2 + ((data[at + 2] << 8) | data[at + 3]); // with marker
+        if (n < 4 || at + n > bytes) { break; }
+        if (data[at + 1] == 0xE1 && n >= 4 + 6 && memcmp(data + at + 4, "Exif\0\0", 6) == 0) {
+            *exif = (int32_t)at;
+            *exif_bytes = n;
+        } else if (data[at + 1] == 0xE1 && n >= 4 + (int32_t)sizeof(meta_xmp_ns) &&
+                   memcmp(data + at + 4, meta_xmp_ns, sizeof(meta_xmp_ns)) == 0) {
+            *xmp = (int32_t)at;
+            *xmp_bytes = n;
+        }
+        at += n;
+    }
+}
+
+// insert() puts EXIF and XMP right after SOI and marks the XMP packet:
+// anything else came from a camera or another tool and carries metadata
+// (Make, Model, exposure, other XMP namespaces) that edit() would lose
+static bool meta_ours(const uint8_t* data, int32_t exif, int32_t exif_bytes,
+        int32_t xmp, int32_t xmp_bytes) {
+    if (exif != 2 || xmp != exif + exif_bytes) { return false; }
+    const int32_t n = (int32_t)strlen(meta_tool);
+    for (int32_t i = xmp; i + n <= xmp + xmp_bytes; i++) {
+        if (memcmp(data + i, meta_tool, n) == 0) { return true; }
+    }
+    return false;
+}
+
+// serializes segments into exactly the bytes they occupied before taking
+// the difference out of the padding, false if content has outgrown them
+static bool meta_fit(uint8_t* head, int32_t exif, int32_t exif_bytes,
+        int32_t xmp, int32_t xmp_bytes, const meta_t* m) {
+    meta_writer_t e = {0};
+    meta_exif(&e, m, 0);
+    meta_writer_t x = {0};
+    meta_xmp(&x, m, 0);
+    if (e.n > exif_bytes || x.n > xmp_bytes) { return false; }
+    meta_writer_t we = { .out = head + exif, .count = exif_bytes };
+    meta_exif(&we, m, exif_bytes - (int32_t)e.n);
+    meta_writer_t wx = { .out = head + xmp, .count = xmp_bytes };
+    meta_xmp(&wx, m, xmp_bytes - (int32_t)x.n);
+    assert(we.n == exif_bytes && wx.n == xmp_bytes);
+    return true;
+}
+
+// rewritten output keeps creation and write time of the file it replaces
+static int meta_times(const char* from, const char* to) {
+    FILETIME created = {0};
+    FILETIME written = {0};
+    void* file = CreateFileA(from, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+        null, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, null);
+    int r = file == INVALID_HANDLE_VALUE ? GetLastError() : 0;
+    if (r == 0) {
+        if (!GetFileTime(file, &created, null, &written)) { r = GetLastError(); }
+        CloseHandle(file);
+    }
+    if (r == 0) {
+        file = CreateFileA(to, FILE_WRITE_ATTRIBUTES, 0, null, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, null);
+        r = file == INVALID_HANDLE_VALUE ? GetLastError() : 0;
+    }
+    if (r == 0) {
+        if (!SetFileTime(file, &created, null, &written)) { r = GetLastError(); }
+        CloseHandle(file);
+    }
+    return r;
+}
+
+// whole file is read, old EXIF and XMP segments dropped and new ones
+// inserted with m->padding reserved for the next edit. Output goes to a
+// temporary file next to the original and replaces it only when complete:
+// a failed write or a crash never leaves a truncated original behind.
+static int meta_rewrite(FILE* f, const char* pathname, const meta_t* m) {
+    int r = fseek(f, 0, SEEK_END) == 0 ? 0 : errno;
+    const int64_t bytes = r == 0 ? ftell(f) : 0;
+    if (r == 0 && (bytes < 4 || bytes > INT32_MAX / 2)) { r = EINVAL; }
+    uint8_t* data = r == 0 ? (uint8_t*)malloc(bytes) : null;
+    if (r == 0 && data == null) { r = ENOMEM; }
+    if (r == 0 && (fseek(f, 0, SEEK_SET) != 0 || fread(data, 1, bytes, f) != (size_t)bytes)) {
+        r = ferror(f) ? errno : EIO;
+    }
+    fclose(f);
+    int64_t stripped = 0;
+    if (r == 0) {
+        int32_t exif = 0, exif_bytes = 0, xmp = 0, xmp_bytes = 0;
+        meta_segments(data, bytes, &exif, &exif_bytes, &xmp, &xmp_bytes);
+        for (int64_t i = 0; i < bytes; i++) { // segments are removed in place
+            const bool dropped = (exif > 0 && exif <= i && i < exif + exif_bytes) ||
+                                 (xmp  > 0 && xmp  <= i && i < xmp  + xmp_bytes);
+            if (!dropped) { data[stripped++] = data[i]; }
+        }
+    }
+    const int64_t count = stripped + 2 * meta_segment_max;
+    uint8_t* output = r == 0 ? (uint8_t*)malloc(count) : null;
+    if (r == 0 && output == null) { r = ENOMEM; }
+    const int32_t n = r == 0 ? meta_insert(data, stripped, m, output, count) : 0;
+    if (r == 0 && n == 0) { r = E2BIG; }
+    char temp[1024];
+    if (r == 0 && snprintf(temp, countof(temp), "%s.meta~", pathname) >= countof(temp)) {
+        r = ENAMETOOLONG;
+    }
+    if (r == 0) {
+        FILE* o = fopen(temp, "wb");
+        if (o == null) {
+            r = errno;
+        } else {
+            if (fwrite(output, 1, n, o) != (size_t)n) { r = errno; }
+            if (fclose(o) != 0 && r == 0) { r = errno; }
+            if (r == 0) { r = meta_times(pathname, temp); }
+            if (r == 0 && !MoveFileExA(temp, pathname,
+                    MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+                r = GetLastError();
+            }
+            if (r != 0) { remove(temp); }
+        }
+    }
+    free(output);
+    free(data);
+    return r;
+}
+
+static int meta_edit(const char* pathname, const meta_t* m, bool* rewritten) {
+    enum { head_bytes = 2 + 2 * meta_segment_max }; // SOI and two segments at most
+    *rewritten = false;
+    FILE* f = fopen(pathname, "r+b");
+    if (f == null) { return errno; }
+    setvbuf(f, null, _IONBF, 0); // patch goes out as a single write
+    uint8_t* head = (uint8_t*)malloc(head_bytes);
+    if (head == null) { fclose(f); return ENOMEM; }
+    const int64_t bytes = (int64_t)fread(head, 1, head_bytes, f);
+    int32_t exif = 0, exif_bytes = 0, xmp = 0, xmp_bytes = 0;
+    if (bytes >= 4 && head[0] == 0xFF && head[1] == 0xD8) {
+        meta_segments(head, bytes, &exif, &exif_bytes, &xmp, &xmp_bytes);
+    }
+    int r = 0;
+    if (!meta_ours(head, exif, exif_bytes, xmp, xmp_bytes)) {
+        r = EPERM;
+        fclose(f);
+    } else if (meta_fit(head, exif, exif_bytes, xmp, xmp_bytes, m)) {
+        const int32_t from = exif < xmp ? exif : xmp;
+        const int32_t to = exif < xmp ? xmp + xmp_bytes : exif + exif_bytes;
+        if (fseek(f, from, SEEK_SET) != 0 ||
+            fwrite(head + from, 1, to - from, f) != (size_t)(to - from)) {
+            r = errno;
+        }
+        if (fclose(f) != 0 && r == 0) { r = errno; }
+    } else {
+        *rewritten = true;
+        r = meta_rewrite(f, pathname, m);
+    }
+    free(head);
+    return r;
+}
+
+meta_if meta = {
+    .bytes  = meta_bytes,
+    .insert = meta_insert,
+    .edit   = meta_edit
+};
+
+end_c
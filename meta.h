@@ -0,0 +1,63 @@
+#pragma once
+#include "crt.h"
+
+begin_c
+
+// Metadata segments inserted into output JPEG right after SOI:
+//     APP1 "Exif\0\0"  big endian TIFF with IFD0: ImageDescription,
+//                      DateTimeOriginal and GPS IFD (position, altitude,
+//                      UTC time and date) when position is known
+//     APP1 XMP packet  xmp:CreatorTool="photos" (marks segments edit() may
+//                      replace), dc:description, dc:subject, xmp:CreateDate and
+//                      for motion photos GCamera: and Container:Directory
+//                      describing the video that follows the image
+// Both segments are measured before anything is written so the whole
+// output (segments and encoded image) is assembled in one buffer and goes
+// out in a single write. Segments are compact unless padding is asked
+// for: zero bytes after the TIFF values and whitespace before the XMP
+// "<?xpacket end='w'?>" let edit() patch metadata of an existing output
+// with a single write without moving the image data. Only when new
+// content outgrows a segment is the whole file rewritten.
+
+typedef struct meta_s {
+    char DateTimeOriginal[20];   // "YYYY:MM:DD HH:MM:SS"
+    char ImageDescription[1024]; // also dc:description
+    const char* subject[32];     // dc:subject keywords
+    int32_t subjects;
+    int32_t padding;             // bytes reserved in each segment (0: none)
+    struct {                     // from source EXIF, sidecar or inferred
+        bool has_position;
+        bool has_altitude;
+        bool has_time;
+        double latitude;         // degrees, negative: south
+        double longitude;        // degrees, negative: west
+        double altitude;         // meters, negative: below sea level
+        double time;             // UTC seconds since midnight
+        char date[12];           // UTC "YYYY:MM:DD" or ""
+    } gps;
+    struct {                     // motion photo: MP4 after EOI
+        const uint8_t* data;     // appended by insert(), null if already there
+        int32_t bytes;           // 0: still photo
+        int64_t timestamp_us;    // of the still frame in the video, -1: unknown
+    } motion;
+} meta_t;
+
+typedef struct {
+    // bytes that insert() adds to JPEG (segments and motion.data) or 0 if
+    // a segment would exceed 64KB
+    int32_t (*bytes)(const meta_t* m);
+    // copies JPEG data into output with metadata segments after SOI and
+    // motion.data after EOI verbatim, returns bytes written or 0 if data is
+    // not JPEG or does not fit into count
+    int32_t (*insert)(const uint8_t* data, int64_t bytes, const meta_t* m,
+        uint8_t* output, int64_t count);
+    // replaces EXIF and XMP segments of JPEG file in place when they fit
+    // the space they occupy, otherwise rewrites the file (rewritten = true).
+    // Files whose segments were not written by insert() are left untouched
+    // and EPERM is returned: their camera metadata would be lost.
+    int (*edit)(const char* pathname, const meta_t* m, bool* rewritten);
+} meta_if;
+
+extern meta_if meta;
+
+end_c
@@ -1,6 +1,16 @@
 /* Copyright (c) Dmitry "Leo" Kuznetsov 2021 see LICENSE for details         */
 #include "quick.h"
 #include "files.h"
+#include "grid.h"
+#include "thumbs.h"
+#include "tiles.h"
+#include "journal.h"
+#include "tar.h"
+#include "service.h"
+#include "catalog.h"
+#include "pool.h"
+#include "meta.h"
+#include "video.h"
 #include "stb_image.h"
 #include "stb_image_write.h"
 #include "stb_image_resize.h"
@@ -13,111 +23,295 @@ begin_c
 
 const char* title = "Photos";
 
+// library browser: virtualized grid over processed output folder
+
+enum { thumb_size = 160, thumb_gap = 8, thumbs_cached = 512 };
+
+static grid_t thumbnails;
+static image_t* images;   // gdi images of grid slots
+static int32_t* image_of; // item index images[] were made for
+static int32_t images_count; // follows thumbnails.capacity
+typedef struct library_item_s {
+    char* pathname;
+    uint64_t mtime; // last write time of the file (thumbnail cache key)
+} library_item_t;
+
+static library_item_t* library; // browsed images
+static int32_t library_count;
+static int32_t library_allocated;
+static mutex_t browse_lock;
+static event_t browse_wake;
+static thread_t browse_thread;
+static thumbs_t thumbnails_pack; // encoded thumbnails of output_folder
+
 static void layout(uic_t* ui) {
     layouts.center(ui);
 }
 
+// slots keep their numbers when the grid grows: images[] only extends
+static void browse_images(void) {
+    const int32_t n = thumbnails.capacity;
+    if (n > images_count) {
+        image_t* i = (image_t*)realloc(images, n * sizeof(image_t));
+        fatal_if_null(i);
+        images = i;
+        int32_t* o = (int32_t*)realloc(image_of, n * sizeof(int32_t));
+        fatal_if_null(o);
+        image_of = o;
+        for (int32_t s = images_count; s < n; s++) { image_of[s] = -1; }
+        images_count = n;
+    }
+}
+
+static void browse_paint(uic_t* ui) {
+    mutexes.lock(&browse_lock);
+    int r = grid.layout(&thumbnails, library_count, ui->w, ui->h);
+    if (r != 0) { traceln("grid.layout() failed %s", crt.error(r)); }
+    browse_images();
+    grid.update(&thumbnails);
+    for (int32_t i = thumbnails.first; i < thumbnails.last; i++) {
+        const grid_thumb_t* t = grid.get(&thumbnails, i);
+        if (t != null) {
+            const int32_t slot = (int32_t)(t - thumbnails.thumbs);
+            if (image_of[slot] != t->index) {
+                if (image_of[slot] >= 0) { gdi.image_dispose(&images[slot]); }
+                gdi.image_init(&images[slot], t->w, t->h, thumbnails.bpp, t->pixels);
+                image_of[slot] = t->index;
+            }
+            int32_t x = 0;
+            int32_t y = 0;
+            grid.cell(&thumbnails, i, &x, &y);
+            x += (thumbnails.thumb_w - t->w) / 2;
+            y += (thumbnails.thumb_h - t->h) / 2;
+            gdi.draw_image(x, y, t->w, t->h, &images[slot]);
+        }
+    }
+    const bool pending = thumbnails.queued > 0;
+    mutexes.unlock(&browse_lock);
+    if (pending) { events.set(browse_wake); }
+}
+
 static void paint(uic_t* ui) {
     // all UIC are transparent and expect parent to paint background
     // UI control paint is always called with a hollow brush
     gdi.set_brush(gdi.brush_color);
     gdi.set_brush_color(colors.black);
     gdi.fill(0, 0, ui->w, ui->h);
+    if (library != null) { browse_paint(ui); }
+}
+
+static void browse_mouse_wheel(uic_t* ui, int32_t dx, int32_t dy) {
+    (void)ui; (void)dx;
+    mutexes.lock(&browse_lock);
+    const bool changed = grid.scroll(&thumbnails, -dy);
+    mutexes.unlock(&browse_lock);
+    if (changed) { app.redraw(); }
+}
+
+typedef struct thumb_writer_s {
+    byte memory[256 * 1024];
+    int32_t written;
+} thumb_writer_t;
+
+static void thumb_writer(void *context, void* data, int bytes) {
+    thumb_writer_t* tw = (thumb_writer_t*)context;
+    if (tw->written + bytes <= (int32_t)sizeof(tw->memory)) {
+        memcpy(tw->memory + tw->written, data, bytes);
+    }
+    tw->written += bytes; // overflow detected by caller
+}
+
+// scales pixels to fit thumbnail box, returns malloc()ed pixels
+static byte* thumbnail_scale(const byte* pixels, int w, int h, int c, int* tw, int* th) {
+    const double sx = (double)thumb_size / w;
+    const double sy = (double)thumb_size / h;
+    const double s = sx < sy ? sx : sy;
+    *tw = (int)(w * s + 0.5);
+    *th = (int)(h * s + 0.5);
+    if (*tw < 1) { *tw = 1; }
+    if (*th < 1) { *th = 1; }
+    byte* scaled = (byte*)malloc((size_t)*tw * *th * c);
+    if (scaled != null) {
+        stbir_resize_uint8(pixels, w, h, 0, scaled, *tw, *th, *tw * c, c);
+    }
+    return scaled;
+}
+
+// encodes scaled down pixels into the thumbnails pack
+static void thumbnail_put(thumbs_t pack, const char* pathname, uint64_t mtime,
+        const byte* pixels, int w, int h, int c) {
+    int tw = 0;
+    int th = 0;
+    byte* scaled = thumbnail_scale(pixels, w, h, c, &tw, &th);
+    if (scaled != null) {
+        static thumb_writer_t writer; // callers are single threaded
+        writer.written = 0;
+        if (stbi_write_jpg_to_func(thumb_writer, &writer, tw, th, c, scaled, 80) &&
+            writer.written <= (int32_t)sizeof(writer.memory)) {
+            int r = thumbs.put(pack, thumbs.key(pathname), mtime,
+                writer.memory, writer.written);
+            if (r != 0) { traceln("thumbs.put(%s) failed %s", pathname, crt.error(r)); }
+        }
+        free(scaled);
+    }
+}
+
+// Returns decoded thumbnail of library[index] from the pack or, on miss,
+// from the EXIF embedded thumbnail, the MPF large preview or a scaled
+// decode of the image itself.
+// The encoded thumbnail is added to the pack so the next start needs
+// no decode of library images at all.
+static uint8_t* browse_thumbnail(int32_t index, int* w, int* h) {
+    const library_item_t* it = &library[index];
+    const int bpp = thumbnails.bpp;
+    int c = 0;
+    int32_t bytes = 0;
+    const byte* jpeg = thumbnails_pack == null ? null :
+        thumbs.get(thumbnails_pack, thumbs.key(it->pathname), it->mtime, &bytes);
+    if (jpeg != null) { return stbi_load_from_memory(jpeg, bytes, w, h, &c, bpp); }
+    void* data = null;
+    int64_t size = 0;
+    if (crt.memmap_read(it->pathname, &data, &size) != 0) { return null; }
+    uint8_t* pixels = null;
+    static exif_info_t exif; // decoder thread only
+    if (exif_from_memory(&exif, data, (uint32_t)size) == 0 && exif.Thumbnail != null) {
+        pixels = stbi_load_from_memory(exif.Thumbnail, exif.ThumbnailBytes, w, h, &c, bpp);
+        if (pixels != null && thumbnails_pack != null) {
+            thumbs.put(thumbnails_pack, thumbs.key(it->pathname), it->mtime,
+                exif.Thumbnail, exif.ThumbnailBytes);
+        }
+    }
+    if (pixels == null && exif.has_mpf) { // phone large preview: no full decode
+        exif_mpf_image_t images[8];
+        int32_t n = 0;
+        exif_mpf_from_jpeg(data, (uint32_t)size, images, countof(images), &n);
+        const exif_mpf_image_t* preview = null;
+        for (int32_t i = 0; i < n; i++) {
+            const bool large_thumbnail = exif_mpf_preview_vga <= images[i].type &&
+                                         images[i].type <= exif_mpf_preview_4k;
+            if (large_thumbnail && (preview == null || images[i].bytes < preview->bytes)) {
+                preview = &images[i];
+            }
+        }
+        if (preview != null) {
+            pixels = stbi_load_from_memory(preview->data, preview->bytes, w, h, &c, bpp);
+        }
+        if (pixels != null && thumbnails_pack != null) {
+            thumbnail_put(thumbnails_pack, it->pathname, it->mtime, pixels, *w, *h, bpp);
+        }
+    }
+    if (pixels == null) {
+        pixels = stbi_load_from_memory(data, (int)size, w, h, &c, bpp);
+        if (pixels != null && thumbnails_pack != null) {
+            thumbnail_put(thumbnails_pack, it->pathname, it->mtime, pixels, *w, *h, bpp);
+        }
+    }
+    crt.memunmap(data, size);
+    return pixels;
+}
+
+// decodes library[index] scaled to fit thumbnail box into pixels
+static bool browse_decode(int32_t index, byte* pixels, int32_t* tw, int32_t* th) {
+    int w = 0, h = 0;
+    uint8_t* data = browse_thumbnail(index, &w, &h);
+    if (data != null) {
+        const double sx = (double)thumbnails.thumb_w / w;
+        const double sy = (double)thumbnails.thumb_h / h;
+        const double s = sx < sy ? sx : sy;
+        *tw = (int32_t)(w * s + 0.5);
+        *th = (int32_t)(h * s + 0.5);
+        if (*tw < 1) { *tw = 1; }
+        if (*th < 1) { *th = 1; }
+        stbir_resize_uint8(data, w, h, 0, pixels, *tw, *th, *tw * thumbnails.bpp,
+            thumbnails.bpp);
+        stbi_image_free(data);
+    }
+    return data != null;
+}
+
+static void browse_decoder(void* unused) {
+    (void)unused;
+    threads.name("decoder");
+    for (;;) { // lives as long as the process
+        mutexes.lock(&browse_lock);
+        grid_thumb_t* t = grid.next(&thumbnails);
+        const int32_t index = t != null ? t->index : -1;
+        mutexes.unlock(&browse_lock);
+        if (t == null) {
+            events.wait(browse_wake);
+        } else {
+            int32_t w = 0;
+            int32_t h = 0;
+            if (!browse_decode(index, t->pixels, &w, &h)) {
+                traceln("failed to decode %s", library[index].pathname);
+                w = 0; h = 0;
+            }
+            mutexes.lock(&browse_lock);
+            grid.done(&thumbnails, t, w, h);
+            mutexes.unlock(&browse_lock);
+            app.redraw();
+        }
+    }
+}
+
+static void browse_collect(const char* folder) {
+    folders_t dir = folders.open();
+    if (folders.enumerate(dir, folder) == 0) {
+        const int count = folders.count(dir);
+        for (int i = 0; i < count; i++) {
+            const char* name = folders.name(dir, i);
+            const int n = (int)(strlen(folder) + strlen(name) + 2);
+            char* pathname = (char*)malloc(n);
+            fatal_if_null(pathname);
+            snprintf(pathname, n, "%s/%s", folder, name);
+            const int k = (int)strlen(name);
+            if (folders.is_folder(dir, i)) {
+                browse_collect(pathname);
+                free(pathname);
+            } else if (k > 4 && stricmp(name + k - 4, ".jpg") == 0) {
+                if (library_count == library_allocated) {
+                    library_allocated = library_allocated == 0 ? 1024 : library_allocated * 2;
+                    library = (library_item_t*)realloc(library,
+                        library_allocated * sizeof(library_item_t));
+                    fatal_if_null(library);
+                }
+                library[library_count].pathname = pathname;
+                library[library_count].mtime = folders.updated(dir, i);
+                library_count++;
+            } else {
+                free(pathname);
+            }
+        }
+    }
+    folders.close(dir);
 }
 
-typedef struct exif_extra_s {
-    char DateTimeOriginal[1024];   // 0x9003
-    char ImageDescription[1024];   // 0x010e
-} exif_extra_t;
+static void browse(const char* folder) {
+    browse_collect(folder);
+    traceln("%s: %d photos", folder, library_count);
+    if (library_count > 0) {
+        fatal_if_not_zero(grid.init(&thumbnails, thumbs_cached, thumb_size,
+            thumb_size, 4, thumb_gap));
+        browse_images();
+        thumbnails_pack = thumbs.open(folder, "thumbs");
+        mutexes.init(&browse_lock);
+        browse_wake = events.create();
+        browse_thread = threads.start(browse_decoder, null);
+        app.ui->mouse_wheel = browse_mouse_wheel;
+        app.ui->children = null;
+    }
+}
 
 static int total;
 static int total_yy;
 static int total_yy_mm;
 static int total_yy_mm_dd;
+static int total_written;
+static int total_cloned;
+static int total_resumed; // already done according to journal
+static int total_failed;
 
 
-static void big_endian_32(uint8_t* p, uint32_t v) {
-    for (int i = 0; i < 4; i++) {
-        p[3 - i] = (uint8_t)(v & 0xFF);
-        v >>= 8;
-    }
-}
-
-static int32_t append_exif_description(const uint8_t* data, int64_t bytes,
-        const exif_extra_t* extra, uint8_t* output, int64_t max_output_bytes) {
-    // Check if there is enough space to add the EXIF data
-memset(output, 0xFF, 256);
-    int64_t required_bytes = bytes + 43 + strlen(extra->DateTimeOriginal) + strlen(extra->ImageDescription);
-    fatal_if(required_bytes > max_output_bytes);
-    fatal_if(data[0] != 0xFF || data[1] != 0xD8); // SOI
-    uint8_t* out = output;
-    memcpy(out, data, 2);
-    out += 2;
-    uint8_t app1_marker[] = {
-        0xFF, 0xE1, // APP1 marker
-        0x00, 0x00, // Length of APP1 segment (44 bytes)
-        0x45, 0x78, 0x69, 0x66, // "Exif" ASCII characters
-        0x00, 0x00, // Null terminator (required for some EXIF parsers)
-        0x4D, 0x4D, // "MM" (Big-endian) identifier
-        0x00, 0x2A, // TIFF header (42 bytes)
-        0x00, 0x00, 0x00, 0x08, // IFD0 offset (8 bytes)
-    };
-    uint8_t* app1 = out;
-    memcpy(out, app1_marker, sizeof(app1_marker));
-    out += sizeof(app1_marker);
-    // num_entries = 2
-    memcpy(out, "\x00\x02", 2);
-    out += 2;
-    // Append DateTimeOriginal tag (0x9003)
-    uint8_t datetime_original_tag[] = {
-        0x90, 0x03, // Tag ID (0x9003)
-        0x00, 0x02, // Data type (ASCII string)
-        0x00, 0x00, 0x00, 0x14, // Data length (20 bytes)
-        0x00, 0x00, 0x00, 0x00, // Offset (because length > 4) or value
-    };
-    static_assertion(sizeof(datetime_original_tag) == 12);
-    uint8_t* datetime_original = out;
-    memcpy(out, datetime_original_tag, sizeof(datetime_original_tag));
-    out += sizeof(datetime_original_tag);
-    // Append ImageDescription tag (0x010E)
-    uint8_t image_description_tag[] = {
-        0x01, 0x0E, // Tag ID (0x010E)
-        0x00, 0x02, // Data type (ASCII string)
-        0x00, 0x00, 0x00, 0x00, // Data length (initialized to placeholder for now, will be updated later)
-        0x00, 0x00, 0x00, 0x00, // Offset (if length > 4) or value
-    };
-    static_assertion(sizeof(image_description_tag) == 12);
-    uint8_t* image_description = out;
-    memcpy(out, image_description_tag, sizeof(image_description_tag));
-    out += sizeof(image_description_tag);
-    // DateTimeOriginal
-    size_t datetime_original_len = strlen(extra->DateTimeOriginal) + 1;
-    assert(datetime_original_len == 0x14);
-    // offset to the data:
-    big_endian_32(datetime_original + 8, (uint32_t)(out - (app1 + 10)));
-    memcpy(out, extra->DateTimeOriginal, datetime_original_len);
-    out += datetime_original_len;
-
-    // ImageDescription
-    size_t image_description_len = strlen(extra->ImageDescription) + 1;
-    big_endian_32(image_description + 4, (uint32_t)image_description_len);
-    if (image_description_len < 4) {
-        memcpy(image_description + 8, extra->ImageDescription, image_description_len);
-    } else {
-        memcpy(out, extra->ImageDescription, image_description_len);
-        big_endian_32(image_description + 8, (uint32_t)(out - (app1 + 10)));
-        out += image_description_len;
-    }
-    big_endian_32(out, 0); // last IFD record
-    out += 4;
-    size_t app_len = out - app1;
-    app1[3] = (uint8_t)((app_len >> 0) & 0xFF);
-    app1[2] = (uint8_t)((app_len >> 8) & 0xFF);
-    memcpy(out, data + 2, bytes - 2);
-    out += bytes - 2;
-    return (int32_t)(out - output);
-}
-
 static void yymmdd(const char* fn, int verify, int* year, int* month, int* day) {
     int n = (int)strlen(fn);
     int y = -1;
@@ -209,11 +403,11 @@ static void yymmdd(const char* fn, int verify, int* year, int* month, int* day)
     }
 }
 
-static void change_file_creation_and_write_time(const char* fn, int year, int month, int day,
+static int change_file_creation_and_write_time(const char* fn, int year, int month, int day,
         int hour, int minute, int second) {
     void* file = CreateFileA(fn, GENERIC_READ | FILE_WRITE_ATTRIBUTES, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-    fatal_if_null(file);
-    if (file != INVALID_HANDLE_VALUE) {
+    int r = file == null || file == INVALID_HANDLE_VALUE ? GetLastError() : 0;
+    if (r == 0) {
         FILETIME ft = {0};
         SYSTEMTIME st = {0};
         GetFileTime(file, &ft, null, null); // creation, access, write
@@ -226,12 +420,14 @@ static void change_file_creation_and_write_time(const char* fn, int year, int mo
         if (minute > 0)  { st.wMinute = (uint16_t)minute; }
         if (second > 0)  { st.wSecond = (uint16_t)second; }
         if (SystemTimeToFileTime(&st, &ft)) {
-            fatal_if_false(SetFileTime(file, &ft, NULL, &ft));
+            if (!SetFileTime(file, &ft, NULL, &ft)) { r = GetLastError(); }
         } else {
             traceln("bad time: %s", fn);
         }
-        fatal_if_false(CloseHandle(file));
+        if (!CloseHandle(file) && r == 0) { r = GetLastError(); }
     }
+    if (r != 0) { traceln("%s: failed to set time %s", fn, crt.error(r)); }
+    return r;
 }
 
 // STBIRDEF int stbir_resize_uint8(const unsigned char *input_pixels , int input_w , int input_h , int input_stride_in_bytes,
@@ -247,18 +443,27 @@ typedef struct writer_context_s {
 
 static writer_context_t writer_context;
 static byte jpeg_memory[16 * 1024 * 1024];
+// motion photos with long videos outgrow jpeg_memory: grown on demand and
+// kept for the next one
+static byte* jpeg_large;
+static int64_t jpeg_large_bytes;
 
 void jpeg_writer(void *context, void* data, int bytes) {
     writer_context_t* wc = (writer_context_t*)context;
-    fatal_if(wc->written + bytes > sizeof(wc->memory));
-    memcpy(wc->memory + wc->written, data, bytes);
-    wc->written += bytes;
+    if (wc->written + bytes <= sizeof(wc->memory)) {
+        memcpy(wc->memory + wc->written, data, bytes);
+    }
+    wc->written += bytes; // overflow detected by jpeg_write()
 }
 
-static bool jpeg_write(uint8_t* data, int w, int h, int c) {
+static int jpeg_quality = 85; // --quality
+
+static int jpeg_write(uint8_t* data, int w, int h, int c) {
     writer_context.written = 0;
-    int r = stbi_write_jpg_to_func(jpeg_writer, &writer_context, w, h, c, data, 85);
+    int r = stbi_write_jpg_to_func(jpeg_writer, &writer_context, w, h, c, data, jpeg_quality) ?
+        0 : EINVAL;
 //  traceln("r: %d written: %d", r, writer_context.written);
+    if (r == 0 && writer_context.written > sizeof(writer_context.memory)) { r = E2BIG; }
     return r;
 }
 
@@ -279,8 +484,54 @@ static const char* months[13] = {
 };
 
 
-static const char* output_folder = "c:/tmp/photos";
+static const char* source_folder;
+static char output_folder[260] = "c:/tmp/photos";
 static char output_path[260];
+static thumbs_t output_thumbs; // thumbnails of outputs for the browser
+static thumbs_t output_tiles;  // tile pyramids of large outputs for zooming
+static bool generate_tiles;    // --tiles
+static journal_t output_journal; // completed outputs for resuming interrupted runs
+static bool output_hardlink;   // --hardlink: clones may be hardlinks to sources
+static tar_t output_tar;       // --tar pathname: outputs streamed into archive
+static catalog_t output_catalog; // --shard i/N: outputs of this shard
+static pool_t output_pool;     // --workers N: decode and encode out of process
+static int output_workers;
+static int64_t output_budget;  // --memory-budget MB: decodes in flight
+static bool output_tune;       // --tune: active workers follow throughput
+static int32_t output_meta_padding; // --meta-padding bytes: room for in place edits
+
+// Verification of outputs before they are written (--verify):
+//     none
+//     structural  APP1 offsets and lengths against what was just serialized
+//     full[:rate] and EXIF of the output re-parsed
+//     psnr[:rate] and output decoded and compared with source pixels
+// full and psnr apply to a deterministic sample of files (rate 0..1) so
+// that a re-run checks the same files. Outputs that fail are quarantined
+// instead of written.
+
+typedef enum { verify_none, verify_structural, verify_full, verify_psnr } verify_t;
+
+static verify_t output_verify = verify_structural;
+static double output_verify_rate = 1.0;
+static const double verify_psnr_min = 30.0; // dB: quality 85 is usually 36..42
+
+// seconds since 1970-01-01 for the output date, unknown parts as in EXIF
+static int64_t unix_seconds(int year, int month, int day, int hour, int minute,
+        int second) {
+    const int m  = month  < 1 ?  6 : month;
+    const int d  = day    < 1 ? 15 : day;
+    const int hr = hour   < 1 ? 11 : hour;
+    const int mn = minute < 1 ? 58 : minute;
+    const int sc = second < 1 ? 29 : second;
+    // days from civil date (proleptic Gregorian calendar)
+    const int y = m <= 2 ? year - 1 : year;
+    const int era = (y >= 0 ? y : y - 399) / 400;
+    const int yoe = y - era * 400;
+    const int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    const int64_t days = (int64_t)era * 146097 + doe - 719468;
+    return days * 86400 + hr * 3600 + mn * 60 + sc;
+}
 
 static void append_pathname(const char* relative) {
     int n = (int)strlen(relative);
@@ -297,6 +548,65 @@ static void append_pathname(const char* relative) {
     }
 }
 
+// Output layout (--layout flat|date|hash) keeps directories small:
+//   date: output_folder/YYYY/MM/ (YYYY/ or undated/ when not known)
+//   hash: output_folder/XX/ 256 buckets by hash of source relative pathname
+typedef enum { layout_flat, layout_date, layout_hash } layout_t;
+
+static layout_t output_layout;
+static uint64_t output_created[4096]; // open addressing set of created folders
+static int output_created_count;
+
+static int output_mkdirs(const char* folder) {
+    const uint64_t key = thumbs.key(folder) | 1; // never zero
+    int i = (int)(key % countof(output_created));
+    while (output_created[i] != 0) {
+        if (output_created[i] == key) { return 0; }
+        i = (i + 1) % countof(output_created);
+    }
+    int r = files.mkdirs(folder);
+    // when the set is 3/4 full, keep creating without caching
+    if (r == 0 && output_created_count < countof(output_created) * 3 / 4) {
+        output_created[i] = key;
+        output_created_count++;
+    }
+    return r;
+}
+
+// output_path = "<output_folder>[/<layout>]/img<seq>_<date>_<relative>"
+// returns pointer to the file name inside output_path
+static const char* output_pathname(int seq, int year, int month, int day,
+        const char* relative) {
+    char folder[260];
+    if (output_layout == layout_date && year > 1990 && month > 0) {
+        snprintf(folder, countof(folder), "%s/%04d/%02d", output_folder, year, month);
+    } else if (output_layout == layout_date && year > 1990) {
+        snprintf(folder, countof(folder), "%s/%04d", output_folder, year);
+    } else if (output_layout == layout_date) {
+        snprintf(folder, countof(folder), "%s/undated", output_folder);
+    } else if (output_layout == layout_hash) {
+        snprintf(folder, countof(folder), "%s/%02X", output_folder,
+            (int)(thumbs.key(relative) >> 56));
+    } else {
+        snprintf(folder, countof(folder), "%s", output_folder);
+    }
+    int r = output_tar != null ? 0 : output_mkdirs(folder);
+    if (r != 0) { traceln("mkdirs(%s) failed %s", folder, crt.error(r)); }
+    const int n = (int)strlen(folder) + 1;
+    if (year > 1990 && month > 0 && day > 0) {
+        snprintf(output_path, countof(output_path), "%s/img%06d_%04d-%s-%02d_",
+            folder, seq, year, months[month], day);
+    } else if (year > 1990 && month > 0) {
+        snprintf(output_path, countof(output_path), "%s/img%06d_%04d-%s_", folder, seq, year, months[month]);
+    } else if (year > 1990) {
+        snprintf(output_path, countof(output_path), "%s/img%06d_%04d_", folder, seq, year);
+    } else {
+        snprintf(output_path, countof(output_path), "%s/img%06d_", folder, seq);
+    }
+    append_pathname(relative);
+    return output_path + n;
+}
+
 
 static const char* words(const char* fn) {
     static char desc[1024];
@@ -314,147 +624,960 @@ static const char* words(const char* fn) {
     return desc;
 }
 
-static void process(const char* pathname) {
-    total++;
-    void* data = null;
-    int64_t bytes = 0;
-    crt.memmap_read(pathname, &data, &bytes);
-    int w = 0, h = 0, c = 0;
-    uint8_t* pixels = data == null ? null : stbi_load(pathname, &w, &h, &c, 0);
-    if (pixels != null) {
-        exif_info_t exif = {0};
-        bool has_exif = exif_from_memory(&exif, data, (uint32_t)bytes) == 0;
-        has_exif = has_exif && exif.ImageHeight > 0 && exif.ImageHeight > 0;
-    //  traceln("%s %d %dx%d:%d exif: %d", pathname, bytes, w, h, c, has_exif);
-        const char* relative = pathname + strlen(app.argv[1]) + 1;
-        int folder_year = -1;
-        int year = -1;
-        int month = -1;
-        int day = -1;
-        int hour = -1;
-        int minute = -1;
-        int second = -1;
-        if (sscanf(relative, "%d/", &folder_year) != 1) {
-            folder_year = -1;
-            traceln("NO folder_year");
+// dc:subject keywords: names of source folders that are not just numbers
+// (years, dates), the same name only once
+static void keywords(const char* relative, meta_t* m) {
+    static char text[1024];
+    int k = 0;
+    const char* s = relative;
+    const char* slash = strchr(s, '/');
+    while (slash != null && m->subjects < countof(m->subject)) {
+        const int n = (int)(slash - s);
+        bool letters = false;
+        for (int i = 0; i < n; i++) { letters = letters || isalpha((uint8_t)s[i]); }
+        if (letters && k + n + 1 <= countof(text)) {
+            char* keyword = text + k;
+            for (int i = 0; i < n; i++) { keyword[i] = s[i] == '_' ? 0x20 : s[i]; }
+            keyword[n] = 0;
+            bool seen = false;
+            for (int i = 0; i < m->subjects && !seen; i++) {
+                seen = stricmp(m->subject[i], keyword) == 0;
+            }
+            if (!seen) {
+                m->subject[m->subjects++] = keyword;
+                k += n + 1;
+            }
+        }
+        s = slash + 1;
+        slash = strchr(s, '/');
+    }
+}
+
+// position, altitude and UTC time of the source as parsed from its EXIF
+// GPS IFD or XMP (DBL_MAX: not present)
+static void gps_from_exif(const exif_info_t* exif, meta_t* m) {
+    const double latitude = exif->GeoLocation.Latitude;
+    const double longitude = exif->GeoLocation.Longitude;
+    if (fabs(latitude) <= 90 && fabs(longitude) <= 180) {
+        m->gps.has_position = true;
+        m->gps.latitude = latitude;
+        m->gps.longitude = longitude;
+        const double altitude = exif->GeoLocation.Altitude;
+        m->gps.has_altitude = fabs(altitude) < 100000;
+        m->gps.altitude = m->gps.has_altitude ? altitude : 0;
+        double h = 0, mn = 0, s = 0;
+        if (sscanf(exif->GeoLocation.GPSTimeStamp, "%lf %lf %lf", &h, &mn, &s) == 3 &&
+            0 <= h && h < 24 && 0 <= mn && mn < 60 && 0 <= s && s < 61) {
+            m->gps.has_time = true;
+            m->gps.time = h * 3600 + mn * 60 + s;
+        }
+        int year = 0, month = 0, day = 0;
+        if (sscanf(exif->GeoLocation.GPSDateStamp, "%d:%d:%d", &year, &month, &day) == 3 &&
+            1900 < year && year < 10000 && 1 <= month && month <= 12 && 1 <= day && day <= 31) {
+            snprintf(m->gps.date, countof(m->gps.date), "%04d:%02d:%02d", year, month, day);
+        }
+    }
+}
+
+// motion photo video (span of the source or null) and the time of the
+// still frame in it: the source XMP is not copied, output XMP describes both
+static void motion_from_exif(const exif_info_t* exif, const uint8_t* video,
+        int32_t video_bytes, meta_t* m) {
+    m->motion.data = video;
+    m->motion.bytes = video != null ? video_bytes : 0;
+    m->motion.timestamp_us = -1;
+    const char* us = exif->xmp.GCamera.MotionPhotoPresentationTimestampUs;
+    if (video != null && us != null && us[0] != 0) {
+        m->motion.timestamp_us = strtoll(us, null, 10);
+    }
+}
+
+// outputs written since the last fsync() of the journal: their data is
+// flushed to disk before it so a synced record never refers to an output
+// still in the file cache
+static char output_unsynced[journal_sync_records][260];
+static int32_t output_unsynced_count;
+
+static int output_flush_file(const char* pathname) {
+    void* file = CreateFileA(pathname, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+        null, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, null);
+    int r = file == INVALID_HANDLE_VALUE ? GetLastError() : 0;
+    if (r == 0) {
+        if (!FlushFileBuffers(file)) { r = GetLastError(); }
+        CloseHandle(file);
+    }
+    // quarantined outputs are removed before they are journaled
+    return r == ERROR_FILE_NOT_FOUND ? 0 : r;
+}
+
+static int output_flush_files(void) {
+    int r = 0;
+    for (int32_t i = 0; i < output_unsynced_count; i++) {
+        int e = output_flush_file(output_unsynced[i]);
+        if (e != 0) {
+            traceln("FlushFileBuffers(%s) failed %s", output_unsynced[i], crt.error(e));
+            if (r == 0) { r = e; }
+        }
+    }
+    output_unsynced_count = 0;
+    return r;
+}
+
+// output_path has new data (not a hardlink) to be flushed before the
+// journal record that refers to it is synced
+static void output_written(void) {
+    if (output_journal == null) { return; }
+    if (output_unsynced_count == countof(output_unsynced)) { output_flush_files(); }
+    snprintf(output_unsynced[output_unsynced_count++], countof(output_unsynced[0]),
+        "%s", output_path);
+}
+
+// records completed output_path of source in catalog and journal. Catalog
+// line goes out first: a seq the journal calls done is never redone, so
+// a line lost after it would be missing from the merged catalog for good.
+static void output_done(int seq, uint64_t key, int64_t bytes, const char* source) {
+    if (output_catalog != null) {
+        int r = catalog.append(output_catalog, seq, key, bytes,
+            output_path + strlen(output_folder) + 1, source + strlen(source_folder) + 1);
+        if (r != 0) {
+            traceln("catalog.append(%s) failed %s", output_path, crt.error(r));
+            return;
+        }
+    }
+    if (output_journal != null) {
+        int r = journal.append(output_journal, seq, key, output_path, bytes);
+        if (r != 0) { traceln("journal.append(%s) failed %s", output_path, crt.error(r)); }
+    }
+}
+
+// journal flush callback: runs before each fsync() of the journal
+static int output_flush(void* that) {
+    (void)that;
+    int r = output_flush_files();
+    int e = output_catalog != null ? catalog.sync(output_catalog) : 0;
+    if (e != 0) { traceln("catalog.sync() failed %s", crt.error(e)); }
+    return r != 0 ? r : e;
+}
+
+// Sources that failed are listed in output_folder/quarantine.txt with the
+// reason and counted per stage ("read", "encode", "write"... the reason up
+// to ':') for the summary at the end of the job.
+
+typedef struct quarantined_s {
+    char stage[32];
+    int count;
+} quarantined_t;
+
+static quarantined_t quarantined[16];
+static int quarantined_count;
+
+static void quarantine_count(const char* reason) {
+    const char* colon = strchr(reason, ':');
+    const int n = colon != null ? (int)(colon - reason) : (int)strlen(reason);
+    char stage[countof(quarantined[0].stage)];
+    snprintf(stage, countof(stage), "%.*s", n, reason);
+    int i = 0;
+    while (i < quarantined_count && strcmp(quarantined[i].stage, stage) != 0) { i++; }
+    if (i == quarantined_count && quarantined_count < countof(quarantined) - 1) {
+        memcpy(quarantined[quarantined_count++].stage, stage, sizeof(stage));
+    } else if (i == quarantined_count) {
+        i = countof(quarantined) - 1; // everything else
+        snprintf(quarantined[i].stage, countof(quarantined[i].stage), "other");
+        quarantined_count = countof(quarantined);
+    }
+    quarantined[i].count++;
+}
+
+// single line "<stage> <count>, ..." of this job
+static void quarantine_summary(char* text, int count) {
+    text[0] = 0;
+    for (int i = 0, k = 0; i < quarantined_count && k < count; i++) {
+        if (quarantined[i].count > 0) {
+            k += snprintf(text + k, count - k, "%s%s %d", k > 0 ? ", " : "",
+                quarantined[i].stage, quarantined[i].count);
+        }
+    }
+}
+
+static void quarantine(const char* pathname, int seq, const char* reason) {
+    char pathname_quarantine[260];
+    snprintf(pathname_quarantine, countof(pathname_quarantine), "%s/quarantine.txt", output_folder);
+    FILE* f = fopen(pathname_quarantine, "ab");
+    if (f != null) {
+        fprintf(f, "%06d\t%s\t%s\n", seq, reason, pathname);
+        fclose(f);
+    }
+    traceln("quarantined %06d %s: %s", seq, pathname, reason);
+    quarantine_count(reason);
+    total_failed++;
+}
+
+static void quarantine_error(const char* pathname, int seq, const char* stage, int r) {
+    char reason[128];
+    snprintf(reason, countof(reason), "%s: %s", stage, crt.error(r));
+    quarantine(pathname, seq, reason);
+}
+
+// Transient I/O errors (sharing violation by an indexer or antivirus,
+// NAS or USB hiccup) are retried with exponential backoff before a file
+// is quarantined. Full disk or missing path are not retried.
+
+enum { io_retries = 3 };
+
+// crt.memmap_read() reports Win32 GetLastError() codes
+static bool io_transient_win32(int r) {
+    return r == ERROR_SHARING_VIOLATION || r == ERROR_LOCK_VIOLATION ||
+           r == ERROR_NETNAME_DELETED || r == ERROR_SEM_TIMEOUT;
+}
+
+// fopen(), fwrite() and fclose() report errno
+static bool io_transient_errno(int r) {
+    return r == EACCES || r == EAGAIN || r == EBUSY || r == EINTR || r == EIO ||
+           r == ETIMEDOUT;
+}
+
+static bool io_retry(const char* pathname, int r, int attempt, bool transient) {
+    if (attempt >= io_retries || !transient) { return false; }
+    traceln("%s: %s, retry %d", pathname, crt.error(r), attempt + 1);
+    crt.sleep(0.05 * (1 << attempt));
+    return true;
+}
+
+static int source_read(const char* pathname, void** data, int64_t* bytes) {
+    int r = 0;
+    for (int attempt = 0; ; attempt++) {
+        *data = null;
+        *bytes = 0;
+        r = crt.memmap_read(pathname, data, bytes);
+        if (r == 0 && *data == null) { r = ERROR_READ_FAULT; }
+        if (r == 0 || !io_retry(pathname, r, attempt, io_transient_win32(r))) { break; }
+    }
+    return r;
+}
+
+// torn output is removed: a re-run must not mistake it for a result
+static int output_write(const char* pathname, const void* data, int32_t bytes) {
+    int r = 0;
+    for (int attempt = 0; ; attempt++) {
+        FILE* file = fopen(pathname, "wb");
+        r = file == null ? errno : 0;
+        if (r == 0 && fwrite(data, 1, bytes, file) != (size_t)bytes) {
+            r = errno != 0 ? errno : EIO;
+        }
+        if (file != null && fclose(file) != 0 && r == 0) { r = errno; }
+        if (r != 0 && file != null) { files.remove(pathname); }
+        if (r == 0 || !io_retry(pathname, r, attempt, io_transient_errno(r))) { break; }
+    }
+    return r;
+}
+
+// JPEG source with EXIF DateTimeOriginal consistent with its folder year
+// needs no changes: output is a clone of the source without decode, encode
+// or (on ReFS or with --hardlink) any data I/O at all.
+static bool process_clone(const char* pathname, int seq, uint64_t key,
+        const void* data, int64_t bytes, const exif_info_t* exif) {
+    const char* relative = pathname + strlen(source_folder) + 1;
+    const int n = (int)strlen(pathname);
+    if (n < 4 || stricmp(pathname + n - 4, ".jpg") != 0) { return false; }
+    int year = -1, month = -1, day = -1, hour = -1, minute = -1, second = -1;
+    if (exif->DateTimeOriginal == null ||
+        sscanf(exif->DateTimeOriginal, "%d:%d:%d %d:%d:%d",
+            &year, &month, &day, &hour, &minute, &second) != 6) {
+        return false;
+    }
+    if (year <= 1990 || month < 1 || month > 12 || day < 1 || day > 31) { return false; }
+    int folder_year = -1;
+    if (sscanf(relative, "%d/", &folder_year) == 1) {
+        if (folder_year < 100) { folder_year += 1900; };
+        if (folder_year > 1900 && abs(year - folder_year) > 2) { return false; }
+    }
+    output_pathname(seq, year, month, day, relative);
+    if (output_tar != null) { // source bytes go into the archive as they are
+        int r = tar.append(output_tar, output_path + strlen(output_folder) + 1,
+            data, bytes, unix_seconds(year, month, day, hour, minute, second));
+        if (r != 0) {
+            quarantine_error(pathname, seq, "tar", r);
         } else {
-            if (folder_year < 100) { folder_year += 1900; };
-            yymmdd(relative, folder_year, &year, &month, &day);
-    //      traceln("%06d %s %04d %s", total, relative, folder_year, has_exif ? "EXIF" : "");
-        }
-        int exif_year = -1;
-        int exif_month = -1;
-        int exif_day = -1;
-        int exif_hour = -1;
-        int exif_minute = -1;
-        int exif_second = -1;
-        if (exif.DateTimeOriginal != null && strlen(exif.DateTimeOriginal) > 0) {
-            if (sscanf(exif.DateTimeOriginal, "%d:%d:%d %d:%d:%d",
-                &exif_year, &exif_month,  &exif_day,
-                &exif_hour, &exif_minute, &exif_second) != 6) {
-    //          traceln("exif.DateTimeOriginal: %s", exif.DateTimeOriginal);
-                exif_year = -1; exif_month = -1; exif_day = -1;
-                exif_hour = -1; exif_minute = -1; exif_second = -1;
+            output_done(seq, key, bytes, pathname);
+            total_cloned++;
+        }
+        return true;
+    }
+    bool linked = false;
+    int r = files.clone(pathname, output_path, output_hardlink, &linked);
+    if (r != 0) {
+        traceln("files.clone(%s) failed %s", output_path, crt.error(r));
+        return false;
+    }
+    traceln("%s (clone)", output_path);
+    if (!linked) { output_written(); }
+    // hardlink shares times with the source: changing them would alter the
+    // source and its source_key() so the next run would redo it
+    if (!linked) {
+        r = change_file_creation_and_write_time(output_path, year, month, day, hour, minute, second);
+        if (r != 0) {
+            files.remove(output_path); // not journaled: would be left behind
+            quarantine_error(pathname, seq, "time", r);
+            return true;
+        }
+    }
+    output_done(seq, key, bytes, pathname);
+    total_cloned++;
+    if (output_thumbs == null) { output_thumbs = thumbs.open(output_folder, "thumbs"); }
+    if (output_thumbs != null && exif->Thumbnail != null) {
+        thumbs.put(output_thumbs, thumbs.key(output_path), files.updated(output_path),
+            exif->Thumbnail, exif->ThumbnailBytes);
+    }
+    if (generate_tiles) { // the only case that still needs a decode
+        int w = 0, h = 0, c = 0;
+        uint8_t* pixels = stbi_load_from_memory(data, (int)bytes, &w, &h, &c, 0);
+        if (pixels != null && (w > tile_size * 2 || h > tile_size * 2)) {
+            if (output_tiles == null) { output_tiles = thumbs.open(output_folder, "tiles"); }
+            if (output_tiles != null) {
+                r = tiles.generate(output_tiles, output_path,
+                    files.updated(output_path), pixels, w, h, c, 85);
+                if (r != 0) { traceln("tiles.generate(%s) failed %s", output_path, crt.error(r)); }
             }
         }
-        if (exif_year < 0 && exif.DateTime != null  && strlen(exif.DateTime) > 0) {
-            if (sscanf(exif.DateTime, "%d:%d:%d %d:%d:%d",
-                &exif_year, &exif_month,  &exif_day,
-                &exif_hour, &exif_minute, &exif_second) != 6) {
-    //          traceln("exif.DateTime: %s", exif.DateTime);
-                exif_year = -1; exif_month = -1; exif_day = -1;
-                exif_hour = -1; exif_minute = -1; exif_second = -1;
+        stbi_image_free(pixels);
+    }
+    return true;
+}
+
+static bool is_video(const char* name) {
+    const int n = (int)strlen(name);
+    if (n <= 4) { return false; }
+    const char* ext = name + n - 4;
+    return stricmp(ext, ".mp4") == 0 || stricmp(ext, ".mov") == 0 ||
+           stricmp(ext, ".m4v") == 0 || stricmp(ext, ".3gp") == 0;
+}
+
+// UTC to the local clock that EXIF DateTimeOriginal of photos shows, in
+// the time zone of this machine: mvhd does not record the one the video
+// was taken in
+static void utc_to_local(int* year, int* month, int* day,
+        int* hour, int* minute, int* second) {
+    SYSTEMTIME utc = {
+        .wYear = (uint16_t)*year, .wMonth = (uint16_t)*month, .wDay = (uint16_t)*day,
+        .wHour = (uint16_t)*hour, .wMinute = (uint16_t)*minute, .wSecond = (uint16_t)*second
+    };
+    SYSTEMTIME local = {0};
+    if (SystemTimeToTzSpecificLocalTime(null, &utc, &local)) {
+        *year   = local.wYear;
+        *month  = local.wMonth;
+        *day    = local.wDay;
+        *hour   = local.wHour;
+        *minute = local.wMinute;
+        *second = local.wSecond;
+    }
+}
+
+// Videos are never decoded or re-encoded: output is a clone of the source
+// named and timed by the creation date video.info() finds in the movie
+// header (box headers only, no media reads), checked against the folder
+// year the same way as photos. Apple keys are local time already, mvhd
+// dates are UTC and converted to local time.
+static void process_video(const char* pathname, int seq, uint64_t key) {
+    const char* relative = pathname + strlen(source_folder) + 1;
+    video_info_t vi = {0};
+    int r = video.info(pathname, &vi);
+    if (r != 0) { quarantine_error(pathname, seq, "video", r); return; }
+    int year = -1, month = -1, day = -1, hour = -1, minute = -1, second = -1;
+    if (sscanf(vi.created, "%d:%d:%d %d:%d:%d",
+            &year, &month, &day, &hour, &minute, &second) != 6 || year <= 1990) {
+        year = -1; month = -1; day = -1; hour = -1; minute = -1; second = -1;
+    } else if (vi.utc) {
+        utc_to_local(&year, &month, &day, &hour, &minute, &second);
+    }
+    int folder_year = -1;
+    if (sscanf(relative, "%d/", &folder_year) == 1) {
+        if (folder_year < 100) { folder_year += 1900; };
+        if (folder_year > 1900 && (year < 0 || abs(year - folder_year) > 2)) {
+            year = folder_year;
+        }
+    }
+    output_pathname(seq, year, month, day, relative);
+    if (output_tar != null) { // archive needs the data: mapped, not read
+        void* data = null;
+        int64_t bytes = 0;
+        r = source_read(pathname, &data, &bytes);
+        if (r != 0) { quarantine_error(pathname, seq, "read", r); return; }
+        r = tar.append(output_tar, output_path + strlen(output_folder) + 1, data, bytes,
+            year > 1900 ? unix_seconds(year, month, day, hour, minute, second) : 0);
+        crt.memunmap(data, bytes);
+        if (r != 0) { quarantine_error(pathname, seq, "tar", r); return; }
+        output_done(seq, key, bytes, pathname);
+        total_cloned++;
+        return;
+    }
+    bool linked = false;
+    r = files.clone(pathname, output_path, output_hardlink, &linked);
+    if (r != 0) { quarantine_error(pathname, seq, "clone", r); return; }
+    traceln("%s (video %.1fs)", output_path, vi.duration);
+    if (!linked) { output_written(); }
+    // hardlink shares times with the source (see process_clone)
+    if (year > 1900 && !linked) {
+        r = change_file_creation_and_write_time(output_path, year, month, day, hour, minute, second);
+        if (r != 0) {
+            files.remove(output_path);
+            quarantine_error(pathname, seq, "time", r);
+            return;
+        }
+    }
+    output_done(seq, key, vi.bytes, pathname);
+    total_cloned++;
+}
+
+static uint32_t big_endian(const uint8_t* p, int bytes) {
+    uint32_t v = 0;
+    for (int i = 0; i < bytes; i++) { v = (v << 8) | p[i]; }
+    return v;
+}
+
+// IFD at offset ifd of the types written by meta.insert(): BYTE, ASCII,
+// LONG and RATIONAL with values inside the TIFF block, GPS IFD is followed
+static const char* verify_ifd(const uint8_t* tiff, uint32_t tiff_bytes, uint32_t ifd,
+        bool gps) {
+    static const uint32_t type_bytes[] = { 0, 1, 1, 2, 4, 8 };
+    if (ifd > tiff_bytes - 2) { return gps ? "GPS IFD offset" : "IFD0 offset"; }
+    const uint32_t n = big_endian(tiff + ifd, 2);
+    if (ifd + 2 + n * 12 + 4 > tiff_bytes) { return gps ? "GPS IFD entries" : "IFD0 entries"; }
+    for (uint32_t i = 0; i < n; i++) {
+        const uint8_t* e = tiff + ifd + 2 + i * 12;
+        const uint32_t tag = big_endian(e, 2);
+        const uint32_t type = big_endian(e + 2, 2);
+        const uint32_t count = big_endian(e + 4, 4);
+        const uint32_t offset = big_endian(e + 8, 4);
+        if (type == 0 || type >= countof(type_bytes)) { return "IFD type"; }
+        const uint64_t bytes = (uint64_t)count * type_bytes[type];
+        if (bytes > 4 && (offset > tiff_bytes || bytes > tiff_bytes - offset)) {
+            return "IFD value offset";
+        }
+        const uint8_t* value = bytes <= 4 ? e + 8 : tiff + offset;
+        if (type == 2 && (count == 0 || value[count - 1] != 0)) { return "IFD string"; }
+        if (!gps && tag == 0x8825) {
+            const char* failed = type == 4 && count == 1 ?
+                verify_ifd(tiff, tiff_bytes, offset, true) : "GPS IFD pointer";
+            if (failed != null) { return failed; }
+        }
+    }
+    return null;
+}
+
+static const char* verify_exif(const uint8_t* tiff, uint32_t tiff_bytes) {
+    if (tiff_bytes < 8 + 2 || memcmp(tiff, "MM\0\x2A", 4) != 0) { return "TIFF header"; }
+    return verify_ifd(tiff, tiff_bytes, big_endian(tiff + 4, 4), false);
+}
+
+static const char* verify_xmp(const uint8_t* packet, uint32_t bytes) {
+    static const char begin[] = "<?xpacket begin=";
+    static const char end[] = "<?xpacket end=\"w\"?>";
+    if (bytes < sizeof(begin) + sizeof(end) ||
+        memcmp(packet, begin, sizeof(begin) - 1) != 0) {
+        return "XMP packet begin";
+    }
+    if (memcmp(packet + bytes - (sizeof(end) - 1), end, sizeof(end) - 1) != 0) {
+        return "XMP packet end";
+    }
+    return null;
+}
+
+// inserted: bytes of APP1 segments (EXIF, XMP) inserted after SOI by meta.insert()
+// video: bytes of motion photo video appended after EOI
+static const char* verify_structure(const uint8_t* data, int32_t bytes, int32_t inserted,
+        int32_t video) {
+    static const char xmp_ns[] = "http://ns.adobe.com/xap/1.0/"; // with '\0'
+    if (bytes < 4 + video || data[0] != 0xFF || data[1] != 0xD8) { return "no SOI"; }
+    const int32_t eoi = bytes - video;
+    if (data[eoi - 2] != 0xFF || data[eoi - 1] != 0xD9) { return "no EOI"; }
+    if (video > 0) {
+        const uint8_t* mp4 = null;
+        uint32_t mp4_bytes = 0;
+        if (exif_motion_photo(data, bytes, &mp4, &mp4_bytes) != 0 ||
+            mp4 != data + eoi || mp4_bytes != (uint32_t)video) {
+            return "motion photo";
+        }
+    }
+    if (inserted == 0) { return null; }
+    if (2 + inserted + 2 > bytes) { return "APP1 size"; }
+    int32_t at = 2;
+    while (at < 2 + inserted) {
+        const uint8_t* a = data + at;
+        if (2 + inserted - at < 4) { return "APP1 size"; }
+        if (a[0] != 0xFF || a[1] != 0xE1) { return "APP1 marker"; }
+        const int32_t length = (int32_t)big_endian(a + 2, 2); // excludes marker
+        if (length < 2 || at + 2 + length > 2 + inserted) { return "APP1 length"; }
+        const char* failed = null;
+        if (length >= 2 + 6 && memcmp(a + 4, "Exif\0\0", 6) == 0) {
+            failed = verify_exif(a + 10, length - 2 - 6);
+        } else if (length >= 2 + (int32_t)sizeof(xmp_ns) &&
+                   memcmp(a + 4, xmp_ns, sizeof(xmp_ns)) == 0) {
+            failed = verify_xmp(a + 4 + sizeof(xmp_ns), length - 2 - sizeof(xmp_ns));
+        } else {
+            failed = "APP1 unknown";
+        }
+        if (failed != null) { return failed; }
+        at += 2 + length;
+    }
+    if (data[at] != 0xFF) { return "no marker after APP1"; }
+    return null;
+}
+
+// -1.0 if output or source does not decode, INFINITY if identical
+static double verify_psnr_db(const char* pathname, const uint8_t* data, int32_t bytes,
+        const uint8_t* pixels, int w, int h, int c) {
+    uint8_t* source = null;
+    if (pixels == null) { // decoded by pool worker: decode source again
+        source = stbi_load(pathname, &w, &h, &c, 0);
+        if (source == null) { return -1.0; }
+        pixels = source;
+    }
+    int ow = 0, oh = 0, oc = 0;
+    uint8_t* output = stbi_load_from_memory(data, bytes, &ow, &oh, &oc, c);
+    double db = -1.0;
+    if (output != null && ow == w && oh == h) {
+        const int k = c >= 3 ? 3 : 1; // JPEG has no alpha
+        double sum = 0;
+        for (int64_t i = 0; i < (int64_t)w * h; i++) {
+            for (int j = 0; j < k; j++) {
+                const double d = (double)pixels[i * c + j] - output[i * c + j];
+                sum += d * d;
             }
         }
-        if (exif_year < 0 && exif.DateTimeDigitized != null && strlen(exif.DateTimeDigitized) > 0) {
-            if (sscanf(exif.DateTimeDigitized, "%d:%d:%d %d:%d:%d",
-                &exif_year, &exif_month,  &exif_day,
-                &exif_hour, &exif_minute, &exif_second) != 6) {
-    //          traceln("exif.DateTimeDigitized: %s", exif.DateTimeDigitized);
-                exif_year = -1; exif_month = -1; exif_day = -1;
-                exif_hour = -1; exif_minute = -1; exif_second = -1;
+        const double mse = sum / ((double)w * h * k);
+        db = mse == 0 ? INFINITY : 10.0 * log10(255.0 * 255.0 / mse);
+    }
+    stbi_image_free(output);
+    stbi_image_free(source);
+    return db;
+}
+
+static bool verify_sampled(int seq) {
+    if (output_verify_rate >= 1.0) { return true; }
+    const uint32_t x = (uint32_t)seq * 2654435761U; // Knuth multiplicative hash
+    return (x >> 8) < output_verify_rate * (1U << 24);
+}
+
+// app1 > 0 when EXIF and XMP were inserted into encoded output
+static bool verify_output(const char* pathname, int seq, exif_info_t* exif,
+        const uint8_t* data, int32_t bytes, int32_t app1, int32_t video,
+        const uint8_t* pixels, int w, int h, int c, char* reason, int count) {
+    const char* failed = output_verify >= verify_structural ?
+        verify_structure(data, bytes, app1, video) : null;
+    const bool sampled = output_verify >= verify_full && verify_sampled(seq);
+    if (failed == null && sampled && app1 > 0) {
+        memset(exif, 0, sizeof(*exif));
+        if (exif_from_memory(exif, data, bytes) != EXIF_PARSE_SUCCESS) {
+            failed = "EXIF does not parse";
+        } else if (exif->ImageDescription[0] == 0 || exif->DateTimeOriginal[0] == 0) {
+            failed = "EXIF fields missing";
+        } else if (exif->xmp.dc.description == null || exif->xmp.dc.description[0] == 0) {
+            failed = "XMP fields missing";
+        }
+    }
+    if (failed == null && sampled && output_verify == verify_psnr) {
+        const double db = verify_psnr_db(pathname, data, bytes, pixels, w, h, c);
+        if (db < 0) {
+            snprintf(reason, count, "verify: does not decode");
+            return false;
+        } else if (db < verify_psnr_min) {
+            snprintf(reason, count, "verify: PSNR %.1f dB", db);
+            return false;
+        }
+    }
+    if (failed != null) { snprintf(reason, count, "verify: %s", failed); }
+    return failed == null;
+}
+
+// Everything after decode and re-encode: date, naming, EXIF, write,
+// journal, thumbnail and tiles. pixels are null when the image was decoded
+// and encoded by a pool worker process. video: motion photo span of the
+// source that is carried over verbatim (null for still photos).
+static void process_encoded(const char* pathname, int seq, uint64_t key,
+        exif_info_t* exif, bool has_exif, const byte* jpeg, int32_t jpeg_bytes,
+        const uint8_t* video, int32_t video_bytes,
+        const uint8_t* pixels, int w, int h, int c) {
+//  traceln("%s %d %dx%d:%d exif: %d", pathname, bytes, w, h, c, has_exif);
+    const char* relative = pathname + strlen(source_folder) + 1;
+    int folder_year = -1;
+    int year = -1;
+    int month = -1;
+    int day = -1;
+    int hour = -1;
+    int minute = -1;
+    int second = -1;
+    if (sscanf(relative, "%d/", &folder_year) != 1) {
+        folder_year = -1;
+        traceln("NO folder_year");
+    } else {
+        if (folder_year < 100) { folder_year += 1900; };
+        yymmdd(relative, folder_year, &year, &month, &day);
+//      traceln("%06d %s %04d %s", seq, relative, folder_year, has_exif ? "EXIF" : "");
+    }
+    int exif_year = -1;
+    int exif_month = -1;
+    int exif_day = -1;
+    int exif_hour = -1;
+    int exif_minute = -1;
+    int exif_second = -1;
+    if (exif->DateTimeOriginal != null && strlen(exif->DateTimeOriginal) > 0) {
+        if (sscanf(exif->DateTimeOriginal, "%d:%d:%d %d:%d:%d",
+            &exif_year, &exif_month,  &exif_day,
+            &exif_hour, &exif_minute, &exif_second) != 6) {
+//          traceln("exif->DateTimeOriginal: %s", exif->DateTimeOriginal);
+            exif_year = -1; exif_month = -1; exif_day = -1;
+            exif_hour = -1; exif_minute = -1; exif_second = -1;
+        }
+    }
+    if (exif_year < 0 && exif->DateTime != null  && strlen(exif->DateTime) > 0) {
+        if (sscanf(exif->DateTime, "%d:%d:%d %d:%d:%d",
+            &exif_year, &exif_month,  &exif_day,
+            &exif_hour, &exif_minute, &exif_second) != 6) {
+//          traceln("exif->DateTime: %s", exif->DateTime);
+            exif_year = -1; exif_month = -1; exif_day = -1;
+            exif_hour = -1; exif_minute = -1; exif_second = -1;
+        }
+    }
+    if (exif_year < 0 && exif->DateTimeDigitized != null && strlen(exif->DateTimeDigitized) > 0) {
+        if (sscanf(exif->DateTimeDigitized, "%d:%d:%d %d:%d:%d",
+            &exif_year, &exif_month,  &exif_day,
+            &exif_hour, &exif_minute, &exif_second) != 6) {
+//          traceln("exif->DateTimeDigitized: %s", exif->DateTimeDigitized);
+            exif_year = -1; exif_month = -1; exif_day = -1;
+            exif_hour = -1; exif_minute = -1; exif_second = -1;
+        }
+    }
+    if (exif_year > 1900 && 1 <= exif_month && exif_month <= 12 && exif_day > 0) {
+        year   = exif_year;
+        month  = exif_month;
+        day    = exif_day;
+        hour   = exif_hour;
+        minute = exif_minute;
+        second = exif_second;
+    }
+    if (year < 0) { year = folder_year; }
+    if (month > 12) { month = -1; }
+    if (day   > 31) { day   = -1; }
+    if (exif->ImageDescription != null && strlen(exif->ImageDescription) > 0) {
+        traceln("exif.ImageDescription: %s", exif->ImageDescription);
+    }
+    if (folder_year > 1900 && abs(year - folder_year) > 2) { year = folder_year; }
+    const char* output_name = output_pathname(seq, year, month, day, relative);
+    traceln("%s", output_path);
+    assert(year > 1900);
+    // re-encoded image has no metadata: date, description and GPS of the
+    // source (or derived from its name) are written into the output
+    meta_t extra = {0};
+    int m  =  month  < 1 ?  6 : month;
+    int d  =  day    < 1 ? 15 : day;
+    int hr =  hour   < 1 ? 11 : hour;
+    int mn =  minute < 1 ? 58 : minute;
+    int sc =  second < 1 ? 29  : second;
+    snprintf(extra.DateTimeOriginal, countof(extra.DateTimeOriginal),
+        "%04d:%02d:%02d %02d:%02d:%02d",
+        year, m, d, hr, mn, sc);
+    snprintf(extra.ImageDescription, countof(extra.ImageDescription),
+        "%s", has_exif && exif->ImageDescription[0] != 0 ?
+        exif->ImageDescription : words(output_name));
+    keywords(relative, &extra);
+    if (has_exif) { gps_from_exif(exif, &extra); }
+    extra.padding = output_meta_padding;
+    motion_from_exif(exif, video, video_bytes, &extra);
+    // segments are measured first: one buffer, one write of the output
+    byte* output = jpeg_memory;
+    int64_t output_bytes = sizeof(jpeg_memory);
+    const int64_t need = jpeg_bytes + meta.bytes(&extra);
+    if (need > output_bytes && need > jpeg_large_bytes) {
+        byte* large = (byte*)realloc(jpeg_large, need);
+        if (large != null) {
+            jpeg_large = large;
+            jpeg_large_bytes = need;
+        } else if (extra.motion.bytes > 0) {
+            traceln("%s: %lld bytes of motion photo do not fit, video dropped",
+                output_path, (long long)need);
+            memset(&extra.motion, 0, sizeof(extra.motion));
+        }
+    }
+    if (need > output_bytes && need <= jpeg_large_bytes) {
+        output = jpeg_large;
+        output_bytes = jpeg_large_bytes;
+    }
+    const int32_t write_bytes = meta.insert(jpeg, jpeg_bytes, &extra, output, output_bytes);
+    const void* write_data = output;
+    if (write_bytes == 0) {
+        quarantine(pathname, seq, "meta: does not fit");
+        return;
+    }
+    assert(write_bytes > jpeg_bytes + extra.motion.bytes);
+    char reason[128];
+    if (!verify_output(pathname, seq, exif, (const uint8_t*)write_data, write_bytes,
+            write_bytes - jpeg_bytes - extra.motion.bytes, extra.motion.bytes,
+            pixels, w, h, c, reason, countof(reason))) {
+        quarantine(pathname, seq, reason);
+        return;
+    }
+    if (output_tar != null) {
+        int r = tar.append(output_tar, output_path + strlen(output_folder) + 1,
+            write_data, write_bytes, unix_seconds(year, month, day, hour, minute, second));
+        if (r != 0) { quarantine_error(pathname, seq, "tar", r); return; }
+        output_done(seq, key, write_bytes, pathname);
+    } else {
+        int r = output_write(output_path, write_data, write_bytes);
+        if (r != 0) { quarantine_error(pathname, seq, "write", r); return; }
+        output_written();
+        // archive entries carry time in the header, files get it set here
+        r = change_file_creation_and_write_time(output_path, year, month, day, hour, minute, second);
+        if (r != 0) {
+            files.remove(output_path); // not journaled: would be left behind
+            quarantine_error(pathname, seq, "time", r);
+            return;
+        }
+        output_done(seq, key, write_bytes, pathname);
+    }
+    total_written++;
+    if (output_tar == null) {
+        if (output_thumbs == null) { output_thumbs = thumbs.open(output_folder, "thumbs"); }
+        // pixels decoded out of process are not available: browser makes
+        // the thumbnail on first view
+        if (output_thumbs != null && pixels != null) { // keyed by final mtime as the browser sees it
+            thumbnail_put(output_thumbs, output_path, files.updated(output_path),
+                pixels, w, h, c);
+        }
+        // pyramid is built from already decoded pixels, no second decode
+        if (generate_tiles && pixels != null && (w > tile_size * 2 || h > tile_size * 2)) {
+            if (output_tiles == null) { output_tiles = thumbs.open(output_folder, "tiles"); }
+            if (output_tiles != null) {
+                int r = tiles.generate(output_tiles, output_path,
+                    files.updated(output_path), pixels, w, h, c, 85);
+                if (r != 0) { traceln("tiles.generate(%s) failed %s", output_path, crt.error(r)); }
             }
         }
-        if (exif_year > 1900 && 1 <= exif_month && exif_month <= 12 && exif_day > 0) {
-            year   = exif_year;
-            month  = exif_month;
-            day    = exif_day;
-            hour   = exif_hour;
-            minute = exif_minute;
-            second = exif_second;
-        }
-        if (year < 0) { year = folder_year; }
-        if (month > 12) { month = -1; }
-        if (day   > 31) { day   = -1; }
-        if (exif.ImageDescription != null && strlen(exif.ImageDescription) > 0) {
-            traceln("exif.ImageDescription: %s", exif.ImageDescription);
-        }
-        files.mkdirs(output_folder);
-        if (folder_year > 1900 && abs(year - folder_year) > 2) { year = folder_year; }
-        if (year > 1990 && month > 0 && day > 0) {
-            snprintf(output_path, countof(output_path), "%s/img%06d_%04d-%s-%02d_",
-                output_folder, total, year, months[month], day);
-        } else if (year > 1990 && month > 0) {
-            snprintf(output_path, countof(output_path), "%s/img%06d_%04d-%s_", output_folder, total, year, months[month]);
-        } else if (year > 1990) {
-            snprintf(output_path, countof(output_path), "%s/img%06d_%04d_", output_folder, total, year);
-        } else {
-            snprintf(output_path, countof(output_path), "%s/img%06d_", output_folder, total);
-        }
-        append_pathname(relative);
-        traceln("%s", output_path);
-        jpeg_write(pixels, w, h, c);
-        assert(year > 1900);
-        void*   write_data = writer_context.memory;
-        int32_t write_bytes = writer_context.written;
-        if (has_exif) {
-    //      traceln("TODO: merge exifs?");
+    }
+//  https://www.awaresystems.be/imaging/tiff/tifftags/privateifd/exif/datetimeoriginal.html#:~:text=The%20format%20is%20%22YYYY%3AMM,blank%20character%20(hex%2020).
+//  extra.DateTimeOriginal = "2023:06:19 15:30:00";
+//  extra.ImageDescription = "Example description";
+//  https://www.awaresystems.be/imaging/tiff/tifftags/gpsifd.html
+//  https://www.awaresystems.be/imaging/tiff/tifftags/privateifd/gps/gpslatitude.html
+//  If latitude is expressed as degrees, minutes and seconds, a typical format would be dd/1,mm/1,ss/1.
+//  When degrees and minutes are used and, for example, fractions of minutes are given up to two decimal places, the format would be dd/1,mmmm/100,0/1.
+}
+
+// source is identified by its relative pathname and last write time
+static uint64_t source_key(const char* pathname) {
+    return thumbs.key(pathname + strlen(source_folder) + 1) ^ files.updated(pathname);
+}
+
+typedef struct encode_context_s {
+    byte* data;
+    int32_t capacity;
+    int32_t written;
+} encode_context_t;
+
+static void encode_writer(void* context, void* data, int bytes) {
+    encode_context_t* ec = (encode_context_t*)context;
+    if (ec->written + bytes <= ec->capacity) {
+        memcpy(ec->data + ec->written, data, bytes);
+    }
+    ec->written += bytes; // overflow detected by caller
+}
+
+// runs in pool worker process: a crash here only costs the worker
+static int pool_encode(const char* pathname, int quality, byte* jpeg,
+        int32_t capacity, int32_t* bytes, int* w, int* h, int* c) {
+    uint8_t* pixels = stbi_load(pathname, w, h, c, 0);
+    if (pixels == null) { return EINVAL; }
+    encode_context_t ec = { .data = jpeg, .capacity = capacity };
+    int r = stbi_write_jpg_to_func(encode_writer, &ec, *w, *h, *c, pixels, quality) ?
+        0 : EINVAL;
+    if (r == 0 && ec.written > capacity) { r = E2BIG; }
+    *bytes = ec.written;
+    stbi_image_free(pixels);
+    return r;
+}
+
+// true for SOF2, SOF6, SOF10 or SOF14 before the first scan
+static bool jpeg_progressive(const uint8_t* data, int64_t bytes) {
+    int64_t i = 2; // after SOI
+    while (i + 4 <= bytes && data[i] == 0xFF) {
+        const uint8_t m = data[i + 1];
+        if (m == 0xFF) { i++; continue; } // fill byte
+        if (m == 0xC2 || m == 0xC6 || m == 0xCA || m == 0xCE) { return true; }
+        if (m == 0xDA || (0xC0 <= m && m <= 0xCF && m != 0xC4 && m != 0xC8 && m != 0xCC)) {
+            return false; // start of scan or non progressive frame
+        }
+        i += 2 + (((int64_t)data[i + 2] << 8) | data[i + 3]);
+    }
+    return false;
+}
+
+// Estimated peak memory of decoding data with stb_image, from the image
+// header only: decoded pixels and, for progressive JPEG, 16-bit DCT
+// coefficients of all components that are kept until the last scan.
+static int64_t decode_footprint(const uint8_t* data, int64_t bytes) {
+    int w = 0, h = 0, c = 0;
+    if (!stbi_info_from_memory(data, (int)bytes, &w, &h, &c)) { return bytes; }
+    int64_t footprint = (int64_t)w * h * c;
+    if (bytes > 2 && data[0] == 0xFF && data[1] == 0xD8 && jpeg_progressive(data, bytes)) {
+        footprint += (int64_t)w * h * c * 2;
+    }
+    return footprint;
+}
+
+// supervisor side of pool_encode()
+static void process_pooled(const pool_result_t* result) {
+    if (result->r != 0) {
+        if (result->r == pool_crashed || result->r == pool_hung) {
+            quarantine(result->pathname, result->seq, result->r == pool_crashed ?
+                "decode: worker crashed" : "decode: worker hung");
+        } else if (result->r == pool_failed) {
+            quarantine(result->pathname, result->seq, "decode: worker pool failed");
         } else {
-            exif_extra_t extra = {0};
-            int m  =  month  < 1 ?  6 : month;
-            int d  =  day    < 1 ? 15 : day;
-            int hr =  hour   < 1 ? 11 : hour;
-            int mn =  minute < 1 ? 58 : minute;
-            int sc =  second < 1 ? 29  : second;
-            snprintf(extra.DateTimeOriginal, countof(extra.DateTimeOriginal),
-                "%04d:%02d:%02d %02d:%02d:%02d",
-                year, m, d, hr, mn, sc);
-            snprintf(extra.ImageDescription, countof(extra.ImageDescription),
-                "%s",
-                words(output_path + strlen(output_folder) + 1));
-            write_bytes = append_exif_description(writer_context.memory, writer_context.written,
-                &extra, jpeg_memory, sizeof(jpeg_memory));
-            write_data = jpeg_memory;
-            assert(write_bytes > writer_context.written);
-        }
-        FILE* file = fopen(output_path, "wb");
-        size_t k = fwrite(write_data, 1, write_bytes, file);
-        fatal_if(k != write_bytes);
-        fclose(file);
-        if (!has_exif) {
-            memset(&exif, 0, sizeof(exif));
-            int r = exif_from_memory(&exif, write_data, write_bytes);
-            fatal_if(r != EXIF_PARSE_SUCCESS);
-            assert(exif.ImageDescription[0] != 0);
-            assert(exif.DateTimeOriginal[0] != 0);
-        }
-        change_file_creation_and_write_time(output_path, year, month, day, hour, minute, second);
-    //  https://www.awaresystems.be/imaging/tiff/tifftags/privateifd/exif/datetimeoriginal.html#:~:text=The%20format%20is%20%22YYYY%3AMM,blank%20character%20(hex%2020).
-    //  extra.DateTimeOriginal = "2023:06:19 15:30:00";
-    //  extra.ImageDescription = "Example description";
-    //  https://www.awaresystems.be/imaging/tiff/tifftags/gpsifd.html
-    //  https://www.awaresystems.be/imaging/tiff/tifftags/privateifd/gps/gpslatitude.html
-    //  If latitude is expressed as degrees, minutes and seconds, a typical format would be dd/1,mm/1,ss/1.
-    //  When degrees and minutes are used and, for example, fractions of minutes are given up to two decimal places, the format would be dd/1,mmmm/100,0/1.
-        stbi_image_free(pixels);
+            quarantine_error(result->pathname, result->seq, "decode", result->r);
+        }
+        return;
+    }
+    void* data = null;
+    int64_t bytes = 0;
+    int r = source_read(result->pathname, &data, &bytes);
+    if (r != 0) { quarantine_error(result->pathname, result->seq, "read", r); return; }
+    exif_info_t exif = {0};
+    bool has_exif = data != null && exif_from_memory(&exif, data, (uint32_t)bytes) == 0;
+    has_exif = has_exif && exif.ImageHeight > 0 && exif.ImageHeight > 0;
+    const uint8_t* video = null;
+    uint32_t video_bytes = 0;
+    if (data != null) { exif_motion_photo(data, (uint32_t)bytes, &video, &video_bytes); }
+    process_encoded(result->pathname, result->seq, source_key(result->pathname),
+        &exif, has_exif, result->jpeg, result->bytes, video, (int32_t)video_bytes,
+        null, result->w, result->h, result->c);
+    crt.memunmap(data, bytes);
+}
+
+static void process(const char* pathname, int seq) {
+    total++;
+    const uint64_t key = source_key(pathname);
+    if (output_journal != null && journal.done(output_journal, seq, key)) {
+        total_resumed++;
+        return;
+    }
+    if (is_video(pathname)) { process_video(pathname, seq, key); return; }
+    void* data = null;
+    int64_t bytes = 0;
+    int r = source_read(pathname, &data, &bytes);
+    if (r != 0) { quarantine_error(pathname, seq, "read", r); return; }
+    exif_info_t exif = {0};
+    bool has_exif = exif_from_memory(&exif, data, (uint32_t)bytes) == 0;
+    has_exif = has_exif && exif.ImageHeight > 0 && exif.ImageHeight > 0;
+    if (has_exif && process_clone(pathname, seq, key, data, bytes, &exif)) {
+        crt.memunmap(data, bytes);
+        return;
+    }
+    if (output_pool != null) { // completes in process_pooled()
+        const int64_t footprint = decode_footprint(data, bytes);
+        crt.memunmap(data, bytes);
+        r = pool.submit(output_pool, pathname, seq, jpeg_quality, footprint);
+        if (r != 0) { quarantine_error(pathname, seq, "submit", r); }
+        return;
+    }
+    int w = 0, h = 0, c = 0;
+    uint8_t* pixels = stbi_load(pathname, &w, &h, &c, 0);
+    if (pixels == null) {
+        quarantine(pathname, seq, "decode: failed");
+    } else if ((r = jpeg_write(pixels, w, h, c)) != 0) {
+        quarantine_error(pathname, seq, "encode", r);
+    } else {
+        const uint8_t* video = null;
+        uint32_t video_bytes = 0;
+        exif_motion_photo(data, (uint32_t)bytes, &video, &video_bytes);
+        process_encoded(pathname, seq, key, &exif, has_exif,
+            writer_context.memory, writer_context.written, video, (int32_t)video_bytes,
+            pixels, w, h, c);
     }
+    stbi_image_free(pixels);
     crt.memunmap(data, bytes);
 }
 
+// Work list is collected in logical (listing) order which defines output
+// sequence numbers and then optionally processed in on-disk order (--locality)
+// so spinning disks read sources in a single sweep instead of random seeks.
+
+typedef struct work_s {
+    char* pathname;
+    int seq;           // logical order: output img%06d numbering
+    uint64_t location; // files.location() for --locality ordering
+} work_t;
+
+static work_t* work;
+static int work_count;
+static int work_allocated;
+
+static void work_add(char* pathname) {
+    if (work_count == work_allocated) {
+        work_allocated = work_allocated == 0 ? 1024 : work_allocated * 2;
+        work = (work_t*)realloc(work, work_allocated * sizeof(work_t));
+        fatal_if_null(work);
+    }
+    work[work_count].pathname = pathname;
+    work[work_count].seq = work_count + 1;
+    work[work_count].location = 0;
+    work_count++;
+}
+
+static int work_compare_location(const void* a, const void* b) {
+    const work_t* wa = (const work_t*)a;
+    const work_t* wb = (const work_t*)b;
+    if (wa->location != wb->location) { return wa->location < wb->location ? -1 : 1; }
+    return wa->seq - wb->seq;
+}
+
+// Keeps only work of shard i of N (by stable hash of source relative
+// pathname, sequence numbers stay global). Returns fingerprint of the
+// whole tree: shards that enumerated the same tree have the same one.
+static uint64_t work_partition(int shard, int shards) {
+    uint64_t tree = 0xCBF29CE484222325ULL;
+    int n = 0;
+    for (int i = 0; i < work_count; i++) {
+        const uint64_t key = thumbs.key(work[i].pathname + strlen(source_folder) + 1);
+        tree = (tree ^ key) * 0x100000001B3ULL;
+        if (key % (uint64_t)shards == (uint64_t)shard) {
+            work[n++] = work[i];
+        } else {
+            free(work[i].pathname);
+        }
+    }
+    if (shards > 1) { traceln("shard %d/%d: %d of %d files", shard, shards, n, work_count); }
+    work_count = n;
+    return tree;
+}
+
+static void work_process(bool locality) {
+    if (locality) {
+        double time = crt.seconds();
+        for (int i = 0; i < work_count; i++) {
+            work[i].location = files.location(work[i].pathname);
+        }
+        qsort(work, work_count, sizeof(work_t), work_compare_location);
+        traceln("locality: %d files ordered in %.3f seconds", work_count, crt.seconds() - time);
+    }
+    for (int i = 0; i < work_count; i++) {
+        process(work[i].pathname, work[i].seq);
+        free(work[i].pathname);
+    }
+    free(work);
+    work = null;
+    work_count = 0;
+    work_allocated = 0;
+}
+
 static void iterate(const char* folder) {
     const int n = (int)strlen(folder);
     folders_t dir = folders.open();
-    fatal_if_not_zero(folders.enumerate(dir, folder));
+    fatal_if_null(dir);
+    int r = folders.enumerate(dir, folder);
+    if (r != 0) { // files of unreadable folder are not numbered
+        quarantine_error(folder, 0, "enumerate", r);
+        folders.close(dir);
+        return;
+    }
     int count = folders.count(dir);
     for (int i = 0; i < count; i++) {
         const char* name = folders.name(dir, i);
@@ -468,8 +1591,9 @@ static void iterate(const char* folder) {
             iterate(pathname);
         } else if (k > 4) {
             const char* ext = name + k - 4;
-            if (stricmp(ext, ".jpg") == 0 || stricmp(ext, ".png") == 0) {
-                process(pathname);
+            if (stricmp(ext, ".jpg") == 0 || stricmp(ext, ".png") == 0 || is_video(name)) {
+                work_add(pathname);
+                pathname = null; // owned by work list
             }
         }
         free(pathname);
@@ -488,6 +1612,360 @@ static void exif_test(const char* pathname) {
     crt.memunmap(data, bytes);
 }
 
+// --bench-exif [file ...]: mean time of exif_from_memory() per file over
+// repeated parses of the same memory (IFD walk, XMP, no file I/O)
+static void exif_bench(const char* pathname) {
+    void* data = null;
+    int64_t bytes = 0;
+    int r = crt.memmap_read(pathname, &data, &bytes);
+    if (r != 0) {
+        traceln("%s: %s", pathname, crt.error(r));
+        return;
+    }
+    static exif_info_t exif;
+    enum { iterations = 1000 };
+    int parsed = 0;
+    const double time = crt.seconds();
+    for (int i = 0; i < iterations; i++) {
+        memset(&exif, 0, sizeof(exif));
+        parsed += exif_from_memory(&exif, data, (uint32_t)bytes) == 0;
+    }
+    const double seconds = crt.seconds() - time;
+    traceln("%s: %.3f us per parse (%d of %d parsed)", pathname,
+        seconds * 1e6 / iterations, parsed, iterations);
+    crt.memunmap(data, bytes);
+}
+
+// Job: source folder, output folder and options, from the command line
+// or from the service pipe as "<source> <output> [options]"
+
+typedef struct job_s {
+    char source[260];
+    char output[260];
+    char tar[260];  // --tar pathname or empty
+    int quality;    // --quality 1..100
+    layout_t layout; // --layout flat|date|hash
+    bool tiles;     // --tiles
+    bool restart;   // --restart
+    bool locality;  // --locality
+    bool hardlink;  // --hardlink
+    int shard;      // --shard i/N: this node processes part i of N
+    int shards;
+    int workers;    // --workers N: crash isolated worker processes (0: none)
+    int64_t budget; // --memory-budget MB: decode footprints in flight (0: unlimited)
+    bool tune;      // --tune: adapt active workers (up to --workers or CPUs)
+    int32_t meta_padding; // --meta-padding bytes: reserved in EXIF and XMP (0: compact)
+    verify_t verify; // --verify none|structural|full|psnr[:rate]
+    double verify_rate;
+} job_t;
+
+static int job_options(job_t* job, int* argc, const char** argv) {
+    job->quality = 85;
+    job->layout = layout_flat;
+    job->tiles = args.option_bool(argc, argv, "--tiles");
+    job->restart = args.option_bool(argc, argv, "--restart");
+    job->locality = args.option_bool(argc, argv, "--locality");
+    job->hardlink = args.option_bool(argc, argv, "--hardlink");
+    job->shard = 0;
+    job->shards = 1;
+    int64_t workers = 0;
+    if (args.option_int(argc, argv, "--workers", &workers)) {
+        if (workers < 0 || workers > 31) {
+            traceln("--workers %lld: expected 0..31", (long long)workers);
+            return EINVAL;
+        }
+        job->workers = (int)workers;
+    }
+    job->tune = args.option_bool(argc, argv, "--tune");
+    if (job->tune && job->workers == 0) {
+        SYSTEM_INFO si = {0};
+        GetSystemInfo(&si);
+        job->workers = si.dwNumberOfProcessors < 31 ? (int)si.dwNumberOfProcessors : 31;
+    }
+    int64_t budget = 0;
+    if (args.option_int(argc, argv, "--memory-budget", &budget)) {
+        if (budget < 0) {
+            traceln("--memory-budget %lld: expected megabytes", (long long)budget);
+            return EINVAL;
+        }
+        job->budget = budget * 1024 * 1024;
+    }
+    int64_t meta_padding = 0;
+    if (args.option_int(argc, argv, "--meta-padding", &meta_padding)) {
+        if (meta_padding < 0 || meta_padding > 32 * 1024) {
+            traceln("--meta-padding %lld: expected 0..32768 bytes", (long long)meta_padding);
+            return EINVAL;
+        }
+        job->meta_padding = (int32_t)meta_padding;
+    }
+    const char* shard = args.option_str(argc, argv, "--shard");
+    if (shard != null && (sscanf(shard, "%d/%d", &job->shard, &job->shards) != 2 ||
+        job->shards < 1 || job->shard < 0 || job->shard >= job->shards)) {
+        traceln("--shard %s: expected i/N with 0 <= i < N", shard);
+        return EINVAL;
+    }
+    int64_t quality = 0;
+    if (args.option_int(argc, argv, "--quality", &quality)) {
+        if (quality < 1 || quality > 100) {
+            traceln("--quality %lld: expected 1..100", (long long)quality);
+            return EINVAL;
+        }
+        job->quality = (int)quality;
+    }
+    const char* tar_pathname = args.option_str(argc, argv, "--tar");
+    if (tar_pathname != null) { snprintf(job->tar, countof(job->tar), "%s", tar_pathname); }
+    const char* folders_layout = args.option_str(argc, argv, "--layout");
+    if (folders_layout != null && strcmp(folders_layout, "date") == 0) {
+        job->layout = layout_date;
+    } else if (folders_layout != null && strcmp(folders_layout, "hash") == 0) {
+        job->layout = layout_hash;
+    } else if (folders_layout != null && strcmp(folders_layout, "flat") != 0) {
+        traceln("--layout %s: expected flat, date or hash", folders_layout);
+        return EINVAL;
+    }
+    job->verify = verify_structural;
+    job->verify_rate = 1.0;
+    const char* verify = args.option_str(argc, argv, "--verify");
+    if (verify != null) {
+        static const char* modes[] = { "none", "structural", "full", "psnr" };
+        const char* colon = strchr(verify, ':');
+        const int n = colon != null ? (int)(colon - verify) : (int)strlen(verify);
+        int mode = countof(modes);
+        for (int i = 0; i < countof(modes); i++) {
+            if ((int)strlen(modes[i]) == n && memcmp(verify, modes[i], n) == 0) { mode = i; }
+        }
+        if (colon != null && (mode < verify_full ||
+            sscanf(colon + 1, "%lf", &job->verify_rate) != 1 ||
+            job->verify_rate <= 0 || job->verify_rate > 1)) {
+            mode = countof(modes);
+        }
+        if (mode == countof(modes)) {
+            traceln("--verify %s: expected none, structural, full[:rate] or psnr[:rate] "
+                "with 0 < rate <= 1", verify);
+            return EINVAL;
+        }
+        job->verify = (verify_t)mode;
+    }
+    return 0;
+}
+
+// Runs job to completion. Buffers (writer and jpeg memory, thumbnail
+// writer, work list capacity) stay allocated between jobs.
+static int job_run(const job_t* job, char* reply, int count) {
+    const double time = crt.seconds();
+    source_folder = job->source;
+    snprintf(output_folder, countof(output_folder), "%s", job->output);
+    jpeg_quality = job->quality;
+    output_layout = job->layout;
+    generate_tiles = job->tiles;
+    output_hardlink = job->hardlink;
+    output_verify = job->verify;
+    output_verify_rate = job->verify_rate;
+    output_meta_padding = job->meta_padding;
+    total = 0;
+    total_yy = 0;
+    total_yy_mm = 0;
+    total_yy_mm_dd = 0;
+    total_written = 0;
+    total_cloned = 0;
+    total_resumed = 0;
+    total_failed = 0;
+    memset(quarantined, 0, sizeof(quarantined));
+    quarantined_count = 0;
+    memset(output_created, 0, sizeof(output_created)); // other output folder
+    output_created_count = 0;
+    int r = files.mkdirs(output_folder);
+    if (r != 0) {
+        snprintf(reply, count, "mkdirs(%s) failed %s", output_folder, crt.error(r));
+        return r;
+    }
+    char journal_path[260];
+    snprintf(journal_path, countof(journal_path), "%s/photos.journal", output_folder);
+    if (job->restart && files.exists(journal_path)) { files.remove(journal_path); }
+    if (job->tar[0] != 0) {
+        // archive is written from scratch, there is nothing to resume
+        output_tar = tar.open(job->tar);
+        if (output_tar == null) {
+            snprintf(reply, count, "failed to create %s", job->tar);
+            return EIO;
+        }
+    } else {
+        output_journal = journal.open(journal_path, journal_sync_records,
+            output_flush, null);
+    }
+    iterate(source_folder);
+    const int files_count = work_count;
+    const uint64_t tree = work_partition(job->shard, job->shards);
+    if (job->shards > 1) {
+        output_catalog = catalog.open(output_folder, job->shard, job->shards,
+            files_count, tree, job->restart || job->tar[0] != 0);
+    }
+    // workers stay warm between service jobs with the same --workers
+    if (output_pool != null && (output_workers != job->workers ||
+                                output_budget != job->budget)) {
+        pool.stop(output_pool);
+        output_pool = null;
+        output_tune = false;
+    }
+    if (output_pool == null && job->workers > 0) {
+        output_pool = pool.start(job->workers, sizeof(writer_context.memory), 60.0,
+            job->budget, process_pooled);
+        output_workers = job->workers;
+        output_budget = job->budget;
+    }
+    if (output_pool != null && output_tune != job->tune) {
+        pool.tune(output_pool, job->tune); // tuned worker count stays warm too
+        output_tune = job->tune;
+    }
+    work_process(job->locality);
+    char workers[256] = {0};
+    if (output_pool != null) {
+        pool.drain(output_pool);
+        pool.report(output_pool, workers, countof(workers));
+        traceln("%s", workers);
+    }
+    if (output_journal != null) { journal.close(output_journal); output_journal = null; }
+    if (output_catalog != null) { catalog.close(output_catalog); output_catalog = null; }
+    if (output_thumbs != null) { thumbs.close(output_thumbs); output_thumbs = null; }
+    if (output_tiles != null) { thumbs.close(output_tiles); output_tiles = null; }
+    if (output_tar != null) {
+        r = tar.close(output_tar);
+        if (r != 0) { traceln("tar.close(%s) failed %s", job->tar, crt.error(r)); }
+        output_tar = null;
+    }
+    traceln("totals: %d yymmdd: %d yymm: %d yy: %d",
+        total, total_yy_mm_dd, total_yy_mm, total_yy);
+    char failures[256];
+    quarantine_summary(failures, countof(failures));
+    if (failures[0] != 0) {
+        traceln("quarantined: %s see %s/quarantine.txt", failures, output_folder);
+    }
+    snprintf(reply, count, "files: %d written: %d cloned: %d resumed: %d failed: %d%s%s%s "
+        "seconds: %.3f%s%s", total, total_written, total_cloned, total_resumed,
+        total_failed, failures[0] != 0 ? " (" : "", failures, failures[0] != 0 ? ")" : "",
+        crt.seconds() - time, workers[0] != 0 ? " " : "", workers);
+    return r;
+}
+
+// splits line into argv[] at spaces, "quoted strings" may contain spaces
+static int job_split(char* line, const char** argv, int max) {
+    int argc = 0;
+    char* s = line;
+    while (*s != 0 && argc < max) {
+        while (*s == 0x20 || *s == '\t') { s++; }
+        if (*s == 0) { break; }
+        const char q = *s == '"' ? '"' : 0;
+        if (q != 0) { s++; }
+        argv[argc++] = s;
+        while (*s != 0 && (q != 0 ? *s != q : *s != 0x20 && *s != '\t')) { s++; }
+        if (*s != 0) { *s++ = 0; }
+    }
+    return argc;
+}
+
+static int service_job(const char* line, char* reply, int count) {
+    char copy[4096];
+    snprintf(copy, countof(copy), "%s", line);
+    const char* argv[32] = { "photos" }; // argv[0] as on command line
+    int argc = 1 + job_split(copy, argv + 1, countof(argv) - 2);
+    job_t job = {0};
+    int r = job_options(&job, &argc, argv);
+    if (r == 0 && (argc != 3 || !files.is_folder(argv[1]))) {
+        r = EINVAL;
+    }
+    if (r != 0) {
+        snprintf(reply, count, "expected: <source folder> <output folder> [options]");
+    } else {
+        snprintf(job.source, countof(job.source), "%s", argv[1]);
+        snprintf(job.output, countof(job.output), "%s", argv[2]);
+        r = job_run(&job, reply, count);
+    }
+    return r;
+}
+
+// --caption "text" output.jpg ...: new description for already processed
+// outputs. Date, GPS and keywords are kept, segments are patched within
+// their reserved padding and only outputs without room are rewritten.
+// Files that were not encoded by photos (clones, camera originals) are
+// skipped: their EXIF and XMP carry more than meta_t can say.
+
+static char caption_keywords[4096]; // storage of meta_t.subject[]
+static int32_t caption_keywords_bytes;
+
+static void caption_keyword(xmp_subscription_t* s, const char* text, uint32_t bytes,
+        int32_t item) {
+    (void)item;
+    meta_t* m = (meta_t*)s->that;
+    const int32_t left = countof(caption_keywords) - caption_keywords_bytes;
+    if (m->subjects < countof(m->subject) && (int32_t)bytes < left) {
+        char* keyword = caption_keywords + caption_keywords_bytes;
+        caption_keywords_bytes += xmp_unescape(text, bytes, keyword, left) + 1;
+        m->subject[m->subjects++] = keyword;
+    }
+}
+
+static int caption_meta(const char* pathname, meta_t* m) {
+    void* data = null;
+    int64_t bytes = 0;
+    int r = crt.memmap_read(pathname, &data, &bytes);
+    if (r != 0) { return r; }
+    static exif_info_t exif;
+    memset(&exif, 0, sizeof(exif));
+    if (exif_from_memory(&exif, data, (uint32_t)bytes) == 0) {
+        snprintf(m->DateTimeOriginal, countof(m->DateTimeOriginal), "%s",
+            exif.DateTimeOriginal);
+        gps_from_exif(&exif, m);
+    }
+    const uint8_t* video = null;
+    uint32_t video_bytes = 0;
+    if (exif_motion_photo(data, (uint32_t)bytes, &video, &video_bytes) == 0) {
+        motion_from_exif(&exif, video, (int32_t)video_bytes, m);
+        m->motion.data = null; // already follows the image in the file
+    }
+    const char* xml = null;
+    uint32_t xml_bytes = 0;
+    caption_keywords_bytes = 0;
+    if (xmp_from_jpeg(data, (uint32_t)bytes, &xml, &xml_bytes) == 0) {
+        xmp_subscription_t subject = {
+            .name = "dc:subject", .container = xmp_bag,
+            .value = caption_keyword, .that = m
+        };
+        xmp_subscribe(xml, xml_bytes, &subject, 1);
+    }
+    crt.memunmap(data, bytes);
+    return 0;
+}
+
+static int caption_edit(const char* caption, int32_t padding, int count,
+        const char** pathnames) {
+    int in_place = 0;
+    int rewritten = 0;
+    int skipped = 0;
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        meta_t m = {0};
+        m.padding = padding; // reserved again when the file is rewritten
+        int r = caption_meta(pathnames[i], &m);
+        snprintf(m.ImageDescription, countof(m.ImageDescription), "%s", caption);
+        bool rewrite = false;
+        if (r == 0) { r = meta.edit(pathnames[i], &m, &rewrite); }
+        if (r == EPERM) {
+            traceln("%s: metadata not written by photos, skipped", pathnames[i]);
+            skipped++;
+        } else if (r != 0) {
+            traceln("%s: %s", pathnames[i], crt.error(r));
+            failed++;
+        } else if (rewrite) {
+            rewritten++;
+        } else {
+            in_place++;
+        }
+    }
+    traceln("captions: %d in place, %d rewritten, %d skipped, %d failed",
+        in_place, rewritten, skipped, failed);
+    return failed == 0 ? 0 : EIO;
+}
+
 static void init(void) {
     app.title = title;
     app.ui->layout = layout;
@@ -495,8 +1973,46 @@ static void init(void) {
     static uic_text(text, "Custom Photo Processor");
     static uic_t* children[] = { &text.ui, null };
     app.ui->children = children;
+    // "--worker <name> <index>": pool worker process started by supervisor
+    const char* worker = args.option_str(&app.argc, app.argv, "--worker");
+    if (worker != null) {
+        exit(pool.worker(worker, app.argc > 1 ? atoi(app.argv[1]) : -1, pool_encode));
+    }
     bool test_exif = args.option_bool(&app.argc, app.argv, "--test-exif");
-    if (test_exif && app.argc > 1 && files.exists(app.argv[1]) && !files.is_folder(app.argv[1])) {
+    bool bench_exif = args.option_bool(&app.argc, app.argv, "--bench-exif");
+    // headless tile pyramid round trip in a scratch store, "." or folder
+    bool test_tiles = args.option_bool(&app.argc, app.argv, "--test-tiles");
+    // headless thumbnail grid cache check
+    bool test_grid = args.option_bool(&app.argc, app.argv, "--test-grid");
+    // headless: jobs come from \\.\pipe\photos, warm across jobs
+    bool service_mode = args.option_bool(&app.argc, app.argv, "--service");
+    // combines catalogs of all shards copied into one output folder
+    const char* merge = args.option_str(&app.argc, app.argv, "--merge");
+    // new description for already processed outputs listed after options
+    const char* caption = args.option_str(&app.argc, app.argv, "--caption");
+    job_t job = {0};
+    fatal_if_not_zero(job_options(&job, &app.argc, app.argv));
+    if (service_mode) {
+        exit(service.run("photos", service_job));
+    } else if (merge != null) {
+        char reply[1024];
+        int r = catalog.merge(merge, reply, countof(reply));
+        traceln("%s", reply);
+        exit(r);
+    } else if (caption != null) {
+        exit(caption_edit(caption, job.meta_padding, app.argc - 1, app.argv + 1));
+    } else if (test_grid) {
+        exit(grid.test());
+    } else if (test_tiles) {
+        exit(tiles.test(app.argc > 1 ? app.argv[1] : "."));
+    } else if (bench_exif) {
+        for (int i = 1; i < app.argc; i++) { exif_bench(app.argv[i]); }
+        if (app.argc == 1) {
+            exif_bench("metadata_test_file_IIM_XMP_EXIF.jpg"); // Intel "II"
+            exif_bench("IPTC-PhotometadataRef-Std2022.1.jpg"); // Motorola "MM"
+        }
+        exit(0);
+    } else if (test_exif && app.argc > 1 && files.exists(app.argv[1]) && !files.is_folder(app.argv[1])) {
         exif_test(app.argv[1]);
         exit(0);
     } else if (test_exif && app.argc == 1) {
@@ -504,9 +2020,15 @@ static void init(void) {
         exif_test("IPTC-PhotometadataRef-Std2022.1.jpg");
         exit(0);
     } else if (app.argc > 1 && files.is_folder(app.argv[1])) {
-        iterate(app.argv[1]);
-        traceln("totals: %d yymmdd: %d yymm: %d yy: %d",
-            total, total_yy_mm_dd, total_yy_mm, total_yy);
+        snprintf(job.source, countof(job.source), "%s", app.argv[1]);
+        snprintf(job.output, countof(job.output), "%s",
+            app.argc > 2 ? app.argv[2] : output_folder);
+        char reply[1024];
+        int r = job_run(&job, reply, countof(reply));
+        traceln("%s%s", r == 0 ? "" : "failed: ", reply);
+        if (output_pool != null) { pool.stop(output_pool); output_pool = null; }
+    } else if (files.is_folder(output_folder)) {
+        browse(output_folder);
     }
 }
 
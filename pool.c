@@ -0,0 +1,532 @@
+#include "pool.h"
+#include <Windows.h>
+
+begin_c
+
+enum {
+    pool_max_workers = 31, // two wait handles per worker, at most 64 total
+    pool_magic = 0x4C4F4F50, // "POOL"
+    pool_header_bytes = 4096,
+    pool_granularity = 64 * 1024
+};
+
+typedef struct pool_header_s { // first page of the shared mapping
+    int32_t magic;
+    int32_t workers;
+    int64_t stride;      // bytes per slot including pool_slot_t
+    int32_t capacity;    // encoded bytes per slot
+    uint32_t supervisor; // process id
+    volatile int32_t stop;
+} pool_header_t;
+
+typedef struct pool_slot_s { // followed by capacity bytes of encoded image
+    int32_t seq;
+    int32_t quality;
+    int32_t r;
+    int32_t w;
+    int32_t h;
+    int32_t c;
+    int32_t bytes;
+    double seconds;   // decode and encode time measured by the worker
+    char pathname[260];
+} pool_slot_t;
+
+typedef struct pool_pending_s { // submitted but not yet admitted
+    char pathname[260];
+    int32_t seq;
+    int32_t quality;
+    int64_t footprint;
+} pool_pending_t;
+
+enum { pool_pending_per_worker = 4, pool_backfill_max = 8 };
+
+// Worker that crashes or hangs is respawned after a backoff doubling with
+// each consecutive failure (a source that kills every worker at startup or
+// a broken executable must not make the supervisor spin creating
+// processes). After pool_respawn_max failures in a row the slot is given
+// up and when no slot is left the pool fails all pending work.
+
+enum { pool_respawn_max = 8 };
+
+static const double pool_backoff_min = 0.1; // seconds
+static const double pool_backoff_max = 5.0;
+
+typedef struct pool_stage_s { // accumulated over a tuning window
+    int32_t files;
+    double read;     // supervisor between submit() calls: mapping and parsing
+    double encode;   // worker decode and encode
+    double write;    // supervisor inside done(): writing outputs
+    double queue;    // sum of pending queue depth sampled at each completion
+} pool_stage_t;
+
+// Tuner: hill climbing on files/s over windows of at least pool_tune_seconds
+// and a few completions per active worker. Steps the number of active
+// workers in the current direction, reverses when throughput drops and
+// holds instead of growing when nothing waits in the pending queue or the
+// supervisor (read and write stages) is saturated: more decoders would only
+// sit idle.
+
+enum { pool_tune_files_per_worker = 4 };
+
+static const double pool_tune_seconds = 1.0;
+static const double pool_tune_drop = 0.95;     // worse than 95% of previous: reverse
+static const double pool_tune_saturated = 0.9; // supervisor busy fraction
+
+typedef struct pool_s {
+    char name[64];
+    HANDLE mapping;
+    pool_header_t* header;
+    int workers;
+    double timeout;
+    pool_done_t done;
+    HANDLE request[pool_max_workers];
+    HANDLE finished[pool_max_workers];
+    HANDLE process[pool_max_workers]; // null: waiting for respawn or given up
+    double respawn[pool_max_workers]; // time to respawn, 0: given up
+    int32_t failures[pool_max_workers]; // consecutive crashes and hangs
+    bool busy[pool_max_workers];
+    double started[pool_max_workers];
+    int64_t footprint[pool_max_workers];
+    int64_t budget;   // 0: unlimited
+    int64_t inflight; // sum of footprint[] of busy workers
+    pool_pending_t* pending;
+    int32_t pending_count;
+    int32_t pending_max;
+    int32_t backfilled; // times pending[0] was passed over by smaller work
+    bool failed;        // every slot was given up
+    bool tune;          // adapt active to measured throughput
+    int active;         // workers [0..active-1] receive new work
+    int direction;      // +1 or -1 next tuning step
+    double rate;        // files/s of previous window (0: none yet)
+    double best_rate;
+    int best_active;
+    double window;      // start of current window
+    double returned;    // time submit() returned to the caller (0: not in a run)
+    pool_stage_t stage; // current window
+    pool_stage_t total; // whole life of the pool
+} pool_t_;
+
+static pool_slot_t* pool_slot(pool_header_t* h, int i) {
+    return (pool_slot_t*)((byte*)h + pool_header_bytes + h->stride * i);
+}
+
+static HANDLE pool_event(const char* name, int i, const char* suffix, bool create) {
+    char event_name[128];
+    snprintf(event_name, countof(event_name), "Local\\%s.%d.%s", name, i, suffix);
+    return create ? CreateEventA(null, false, false, event_name) :
+                    OpenEventA(EVENT_ALL_ACCESS, false, event_name);
+}
+
+static bool pool_given_up(pool_t_* p, int i) {
+    return p->process[i] == null && p->respawn[i] == 0;
+}
+
+static void pool_failure(pool_t_* p, int i) {
+    p->process[i] = null;
+    p->failures[i]++;
+    if (p->failures[i] >= pool_respawn_max) {
+        traceln("pool: worker %d failed %d times in a row, given up", i, p->failures[i]);
+        p->respawn[i] = 0;
+        bool failed = true;
+        for (int k = 0; k < p->workers; k++) { failed = failed && pool_given_up(p, k); }
+        p->failed = failed;
+    } else {
+        double backoff = pool_backoff_min * (1 << (p->failures[i] - 1));
+        if (backoff > pool_backoff_max) { backoff = pool_backoff_max; }
+        p->respawn[i] = crt.seconds() + backoff;
+    }
+}
+
+static void pool_spawn(pool_t_* p, int i) {
+    char exe[MAX_PATH];
+    fatal_if(GetModuleFileNameA(null, exe, countof(exe)) == 0);
+    char command[MAX_PATH + 128];
+    snprintf(command, countof(command), "\"%s\" --worker %s %d", exe, p->name, i);
+    STARTUPINFOA si = { .cb = sizeof(si) };
+    PROCESS_INFORMATION pi = {0};
+    ResetEvent(p->request[i]);
+    ResetEvent(p->finished[i]);
+    if (CreateProcessA(null, command, null, null, false,
+            CREATE_NO_WINDOW, null, null, &si, &pi)) {
+        CloseHandle(pi.hThread);
+        p->process[i] = pi.hProcess;
+    } else {
+        traceln("pool: worker %d failed to start %s", i, crt.error(GetLastError()));
+        pool_failure(p, i);
+    }
+}
+
+static void pool_complete(pool_t_* p, int i, int r) {
+    pool_slot_t* s = pool_slot(p->header, i);
+    pool_result_t result = {
+        .pathname = s->pathname,
+        .seq = s->seq,
+        .r = r
+    };
+    if (r == 0) {
+        p->failures[i] = 0; // healthy even if encode() reported an error
+        result.r = s->r;
+        result.w = s->w;
+        result.h = s->h;
+        result.c = s->c;
+        result.jpeg = (const byte*)s + sizeof(pool_slot_t);
+        result.bytes = s->bytes;
+    }
+    p->busy[i] = false;
+    p->inflight -= p->footprint[i];
+    const double time = crt.seconds();
+    p->done(&result);
+    p->stage.files++;
+    p->stage.write += crt.seconds() - time;
+    p->stage.encode += r == 0 ? s->seconds : time - p->started[i];
+    p->stage.queue += p->pending_count;
+}
+
+static void pool_stage_add(pool_stage_t* sum, const pool_stage_t* s) {
+    sum->files  += s->files;
+    sum->read   += s->read;
+    sum->encode += s->encode;
+    sum->write  += s->write;
+    sum->queue  += s->queue;
+}
+
+static void pool_tune(pool_t_* p) {
+    const double now = crt.seconds();
+    const double elapsed = now - p->window;
+    pool_stage_t* s = &p->stage;
+    if (elapsed < pool_tune_seconds ||
+        s->files < p->active * pool_tune_files_per_worker) {
+        return;
+    }
+    const double rate = s->files / elapsed;
+    const double queue = s->queue / s->files;
+    const double supervisor = (s->read + s->write) / elapsed;
+    if (rate > p->best_rate) {
+        p->best_rate = rate;
+        p->best_active = p->active;
+    }
+    if (p->rate > 0 && rate < p->rate * pool_tune_drop) { p->direction = -p->direction; }
+    const bool starved = queue < 1.0 || supervisor > pool_tune_saturated;
+    int active = p->active + p->direction;
+    if (p->direction > 0 && starved) { active = p->active; }
+    active = active < 1 ? 1 : active > p->workers ? p->workers : active;
+    if (active != p->active) {
+        traceln("pool: %.1f files/s queue %.1f supervisor %.0f%% workers %d -> %d",
+            rate, queue, supervisor * 100, p->active, active);
+    }
+    p->active = active;
+    p->rate = rate;
+    pool_stage_add(&p->total, s);
+    memset(s, 0, sizeof(*s));
+    p->window = now;
+}
+
+// crashed or hung worker process is gone, respawned later by pool_wait()
+static void pool_restart(pool_t_* p, int i) {
+    CloseHandle(p->process[i]);
+    pool_failure(p, i);
+}
+
+// waits for at least one worker to finish, crash or time out
+static void pool_wait(pool_t_* p) {
+    HANDLE handles[pool_max_workers * 2];
+    int slot[pool_max_workers];
+    int n = 0; // live workers
+    for (int i = 0; i < p->workers; i++) {
+        if (p->process[i] != null) { slot[n++] = i; }
+    }
+    for (int k = 0; k < n; k++) {
+        handles[k] = p->finished[slot[k]];
+        handles[n + k] = p->process[slot[k]];
+    }
+    DWORD w = WAIT_TIMEOUT;
+    if (n > 0) {
+        w = WaitForMultipleObjects(n * 2, handles, false, 100);
+    } else {
+        Sleep(100); // all workers are waiting for respawn
+    }
+    if (WAIT_OBJECT_0 <= w && w < WAIT_OBJECT_0 + n) {
+        const int i = slot[w - WAIT_OBJECT_0];
+        if (p->busy[i]) { pool_complete(p, i, 0); }
+    } else if (WAIT_OBJECT_0 + n <= w && w < WAIT_OBJECT_0 + n * 2) {
+        const int i = slot[w - WAIT_OBJECT_0 - n];
+        DWORD code = 0;
+        GetExitCodeProcess(p->process[i], &code);
+        traceln("pool: worker %d exited 0x%08X %s", i, code,
+            p->busy[i] ? pool_slot(p->header, i)->pathname : "");
+        pool_restart(p, i);
+        if (p->busy[i]) { pool_complete(p, i, pool_crashed); }
+    } else {
+        const double now = crt.seconds();
+        for (int i = 0; i < p->workers; i++) {
+            if (p->busy[i] && now - p->started[i] > p->timeout) {
+                traceln("pool: worker %d hung on %s", i, pool_slot(p->header, i)->pathname);
+                TerminateProcess(p->process[i], ERROR_TIMEOUT);
+                WaitForSingleObject(p->process[i], INFINITE);
+                pool_restart(p, i);
+                pool_complete(p, i, pool_hung);
+            }
+        }
+    }
+    const double now = crt.seconds();
+    for (int i = 0; i < p->workers; i++) {
+        if (p->process[i] == null && p->respawn[i] > 0 && now >= p->respawn[i]) {
+            pool_spawn(p, i);
+        }
+    }
+    if (p->tune) { pool_tune(p); }
+}
+
+static pool_t pool_start(int workers, int32_t slot_bytes, double timeout, int64_t budget,
+        pool_done_t done) {
+    pool_t_* p = (pool_t_*)calloc(1, sizeof(pool_t_));
+    if (p == null) { return null; }
+    p->workers = workers < 1 ? 1 : workers > pool_max_workers ? pool_max_workers : workers;
+    p->timeout = timeout;
+    p->budget = budget;
+    p->done = done;
+    p->active = p->workers;
+    p->direction = -1;
+    p->pending_max = p->workers * pool_pending_per_worker;
+    p->pending = (pool_pending_t*)calloc(p->pending_max, sizeof(pool_pending_t));
+    if (p->pending == null) { free(p); return null; }
+    snprintf(p->name, countof(p->name), "photos.pool.%lu", GetCurrentProcessId());
+    const int64_t stride = ((int64_t)sizeof(pool_slot_t) + slot_bytes + pool_granularity - 1) /
+        pool_granularity * pool_granularity;
+    const int64_t size = pool_header_bytes + stride * p->workers;
+    char mapping_name[96];
+    snprintf(mapping_name, countof(mapping_name), "Local\\%s", p->name);
+    p->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, null, PAGE_READWRITE,
+        (DWORD)(size >> 32), (DWORD)size, mapping_name);
+    p->header = p->mapping == null ? null :
+        (pool_header_t*)MapViewOfFile(p->mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (p->header == null) {
+        traceln("pool: failed to map %lld bytes %s", size, crt.error(GetLastError()));
+        if (p->mapping != null) { CloseHandle(p->mapping); }
+        free(p->pending);
+        free(p);
+        return null;
+    }
+    p->header->workers = p->workers;
+    p->header->stride = stride;
+    p->header->capacity = (int32_t)(stride - sizeof(pool_slot_t));
+    p->header->supervisor = GetCurrentProcessId();
+    p->header->magic = pool_magic;
+    for (int i = 0; i < p->workers; i++) {
+        p->request[i] = pool_event(p->name, i, "request", true);
+        p->finished[i] = pool_event(p->name, i, "finished", true);
+        fatal_if(p->request[i] == null || p->finished[i] == null);
+        pool_spawn(p, i);
+    }
+    traceln("pool: %d workers %lld bytes shared", p->workers, size);
+    return (pool_t)p;
+}
+
+static void pool_run(pool_t_* p, int i, const pool_pending_t* t) {
+    pool_slot_t* s = pool_slot(p->header, i);
+    memcpy(s->pathname, t->pathname, sizeof(s->pathname));
+    s->seq = t->seq;
+    s->quality = t->quality;
+    s->r = 0;
+    s->bytes = 0;
+    s->seconds = 0;
+    p->busy[i] = true;
+    p->started[i] = crt.seconds();
+    p->footprint[i] = t->footprint;
+    p->inflight += t->footprint;
+    SetEvent(p->request[i]);
+}
+
+// idle live worker among active ones or -1, all workers are considered
+// when every active slot has been given up
+static int pool_idle(pool_t_* p) {
+    int n = p->active;
+    bool usable = false;
+    for (int i = 0; i < n; i++) { usable = usable || !pool_given_up(p, i); }
+    if (!usable) { n = p->workers; }
+    for (int i = 0; i < n; i++) {
+        if (!p->busy[i] && p->process[i] != null) { return i; }
+    }
+    return -1;
+}
+
+// admits pending work in order to idle workers while it fits the budget
+static void pool_dispatch(pool_t_* p) {
+    if (p->failed) { // no worker left: pending work fails instead of waiting
+        for (int32_t k = 0; k < p->pending_count; k++) {
+            const pool_result_t result = {
+                .pathname = p->pending[k].pathname,
+                .seq = p->pending[k].seq,
+                .r = pool_failed
+            };
+            p->done(&result);
+        }
+        p->pending_count = 0;
+        return;
+    }
+    int32_t k = 0;
+    while (k < p->pending_count) {
+        const int i = pool_idle(p);
+        if (i < 0) { break; }
+        const pool_pending_t* t = &p->pending[k];
+        const bool fits = p->budget == 0 || p->inflight == 0 ||
+            p->inflight + t->footprint <= p->budget;
+        if (fits) {
+            pool_run(p, i, t);
+            if (k == 0) {
+                p->backfilled = 0;
+            } else {
+                p->backfilled++;
+            }
+            p->pending_count--;
+            memmove(&p->pending[k], &p->pending[k + 1],
+                (p->pending_count - k) * sizeof(pool_pending_t));
+        } else if (k == 0 && p->backfilled >= pool_backfill_max) {
+            break; // head waits for memory to be released, no more backfill
+        } else {
+            k++;
+        }
+    }
+}
+
+static bool pool_busy(pool_t_* p) {
+    bool busy = false;
+    for (int i = 0; i < p->workers; i++) { busy = busy || p->busy[i]; }
+    return busy;
+}
+
+static int pool_submit(pool_t handle, const char* pathname, int seq, int quality,
+        int64_t footprint) {
+    pool_t_* p = (pool_t_*)handle;
+    if (p->returned > 0) { p->stage.read += crt.seconds() - p->returned; }
+    if (p->window == 0) { p->window = crt.seconds(); }
+    if ((int)strlen(pathname) >= countof(p->pending[0].pathname)) {
+        p->returned = crt.seconds();
+        return ENAMETOOLONG;
+    }
+    while (p->pending_count == p->pending_max) {
+        pool_dispatch(p);
+        if (p->pending_count == p->pending_max) { pool_wait(p); }
+    }
+    pool_pending_t* t = &p->pending[p->pending_count++];
+    snprintf(t->pathname, countof(t->pathname), "%s", pathname);
+    t->seq = seq;
+    t->quality = quality;
+    t->footprint = footprint;
+    pool_dispatch(p);
+    p->returned = crt.seconds();
+    return 0;
+}
+
+static void pool_drain(pool_t handle) {
+    pool_t_* p = (pool_t_*)handle;
+    for (;;) {
+        pool_dispatch(p);
+        // nothing in flight: head always fits unless workers await respawn
+        if (!pool_busy(p) && p->pending_count == 0) { break; }
+        pool_wait(p);
+    }
+    // time until the next run is neither reading nor throughput
+    p->returned = 0;
+    p->window = 0;
+    pool_stage_add(&p->total, &p->stage);
+    memset(&p->stage, 0, sizeof(p->stage));
+}
+
+static void pool_tune_enable(pool_t handle, bool on) {
+    pool_t_* p = (pool_t_*)handle;
+    p->tune = on;
+    if (on) {
+        p->active = p->workers; // start wide, first step probes one less
+        p->direction = -1;
+        p->rate = 0;
+    } else {
+        p->active = p->workers;
+    }
+}
+
+static void pool_report(pool_t handle, char* text, int count) {
+    pool_t_* p = (pool_t_*)handle;
+    pool_stage_t t = p->total;
+    pool_stage_add(&t, &p->stage);
+    const double n = t.files > 0 ? t.files : 1;
+    snprintf(text, count, "workers: %d of %d%s read: %.1fms encode: %.1fms "
+        "write: %.1fms queue: %.1f", p->active, p->workers, p->tune ? " (tuned)" : "",
+        t.read * 1000 / n, t.encode * 1000 / n, t.write * 1000 / n, t.queue / n);
+    if (p->tune && p->best_active > 0) {
+        const int k = (int)strlen(text);
+        snprintf(text + k, count - k, " best: %d at %.1f files/s", p->best_active,
+            p->best_rate);
+    }
+}
+
+static void pool_stop(pool_t handle) {
+    pool_t_* p = (pool_t_*)handle;
+    pool_drain(handle);
+    p->header->stop = true;
+    for (int i = 0; i < p->workers; i++) { SetEvent(p->request[i]); }
+    for (int i = 0; i < p->workers; i++) {
+        if (p->process[i] != null) {
+            if (WaitForSingleObject(p->process[i], 1000) != WAIT_OBJECT_0) {
+                TerminateProcess(p->process[i], 0);
+            }
+            CloseHandle(p->process[i]);
+        }
+        CloseHandle(p->request[i]);
+        CloseHandle(p->finished[i]);
+    }
+    UnmapViewOfFile(p->header);
+    CloseHandle(p->mapping);
+    free(p->pending);
+    free(p);
+}
+
+static int pool_worker(const char* name, int index, pool_encode_t encode) {
+    char mapping_name[96];
+    snprintf(mapping_name, countof(mapping_name), "Local\\%s", name);
+    HANDLE mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, false, mapping_name);
+    if (mapping == null) { return GetLastError(); }
+    pool_header_t* h = (pool_header_t*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    int r = h == null ? GetLastError() : 0;
+    if (r == 0 && (h->magic != pool_magic || index < 0 || index >= h->workers)) {
+        r = ERROR_INVALID_PARAMETER;
+    }
+    HANDLE request = r == 0 ? pool_event(name, index, "request", false) : null;
+    HANDLE finished = r == 0 ? pool_event(name, index, "finished", false) : null;
+    HANDLE supervisor = r == 0 ? OpenProcess(SYNCHRONIZE, false, h->supervisor) : null;
+    if (r == 0 && (request == null || finished == null || supervisor == null)) {
+        r = GetLastError();
+    }
+    while (r == 0) {
+        HANDLE handles[2] = { request, supervisor };
+        // supervisor going away (even if it crashed) ends the worker
+        if (WaitForMultipleObjects(2, handles, false, INFINITE) != WAIT_OBJECT_0 ||
+            h->stop) {
+            break;
+        }
+        pool_slot_t* s = pool_slot(h, index);
+        const double time = crt.seconds();
+        s->r = encode(s->pathname, s->quality, (byte*)s + sizeof(pool_slot_t),
+            h->capacity, &s->bytes, &s->w, &s->h, &s->c);
+        s->seconds = crt.seconds() - time;
+        SetEvent(finished);
+    }
+    if (supervisor != null) { CloseHandle(supervisor); }
+    if (finished != null) { CloseHandle(finished); }
+    if (request != null) { CloseHandle(request); }
+    if (h != null) { UnmapViewOfFile(h); }
+    CloseHandle(mapping);
+    return r;
+}
+
+pool_if pool = {
+    .start  = pool_start,
+    .submit = pool_submit,
+    .drain  = pool_drain,
+    .tune   = pool_tune_enable,
+    .report = pool_report,
+    .stop   = pool_stop,
+    .worker = pool_worker
+};
+
+end_c
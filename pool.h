@@ -0,0 +1,69 @@
+#pragma once
+#include "crt.h"
+
+begin_c
+
+// Crash isolated pool of worker processes decoding and re-encoding images.
+// The supervisor (the calling process) and its workers (the same executable
+// started with "--worker <name> <index>") share a memory mapping with a
+// ring of slots, one per worker. A slot carries the request (source
+// pathname, quality) and the result (encoded JPEG and image dimensions)
+// with ownership handed over by a pair of events, so encoded images are
+// never copied between processes. A worker that crashes or does not
+// finish within timeout is terminated and its file is reported with an
+// error for the caller to quarantine. It is respawned after a backoff that
+// grows with consecutive failures; a slot failing too often is given up
+// and when none is left pending work is reported as pool_failed.
+// Admission control: each submitted file comes with an estimate of its
+// decode memory footprint and work is handed to workers only while the
+// sum of footprints in flight stays under the budget. A file that does not
+// fit waits in the pending queue while smaller files behind it backfill
+// idle workers, but only a bounded number of times so that large files
+// are not starved. A file larger than the budget runs alone.
+// Tuning: pool measures per file stage times (supervisor reading between
+// submits, worker decode and encode, supervisor writing in done()) and
+// pending queue depth, and with tune() on adapts the number of workers
+// receiving work (1..workers) to maximize files per second.
+
+typedef struct pool_s* pool_t;
+
+typedef struct pool_result_s {
+    const char* pathname;
+    int seq;
+    int r;            // 0, pool_crashed, pool_hung, pool_failed or encode() error
+    int w;            // decoded image dimensions and channels
+    int h;
+    int c;
+    const byte* jpeg; // encoded image, valid only inside done()
+    int32_t bytes;
+} pool_result_t;
+
+enum { pool_crashed = -1, pool_hung = -2, pool_failed = -3 };
+
+// called in supervisor, on the thread calling submit(), drain() or stop()
+typedef void (*pool_done_t)(const pool_result_t* result);
+
+// called in worker process: decodes pathname and encodes it into jpeg
+typedef int (*pool_encode_t)(const char* pathname, int quality, byte* jpeg,
+    int32_t capacity, int32_t* bytes, int* w, int* h, int* c);
+
+typedef struct {
+    // starts workers (at most 31), slot_bytes is the largest encoded image,
+    // budget is the limit of decode footprints in flight (0: unlimited)
+    pool_t (*start)(int workers, int32_t slot_bytes, double timeout, int64_t budget,
+        pool_done_t done);
+    // queues pathname with its estimated decode footprint, waits only when
+    // the pending queue is full
+    int (*submit)(pool_t p, const char* pathname, int seq, int quality, int64_t footprint);
+    void (*drain)(pool_t p); // waits for all submitted work
+    void (*tune)(pool_t p, bool on); // off: all workers receive work
+    // single line: active workers and mean stage times per file since start
+    void (*report)(pool_t p, char* text, int count);
+    void (*stop)(pool_t p);  // drains and terminates workers
+    // worker process main loop, returns when supervisor goes away
+    int (*worker)(const char* name, int index, pool_encode_t encode);
+} pool_if;
+
+extern pool_if pool;
+
+end_c
@@ -0,0 +1,142 @@
+#include "service.h"
+#include <Windows.h>
+
+begin_c
+
+enum { service_line_max = 4096 };
+
+typedef struct service_item_s {
+    struct service_item_s* next;
+    HANDLE pipe;  // client connection, reply is written here
+    int32_t id;
+    char line[service_line_max];
+} service_item_t;
+
+typedef struct service_queue_s {
+    mutex_t lock;
+    event_t wake;
+    service_item_t* head;
+    service_item_t* tail;
+    service_job_t job;
+    bool quit;
+} service_queue_t;
+
+static service_queue_t service_queue;
+
+static void service_reply(HANDLE pipe, const char* text) {
+    DWORD written = 0;
+    // failure is normal: client may have disconnected after "queued"
+    if (WriteFile(pipe, text, (DWORD)strlen(text), &written, null)) {
+        FlushFileBuffers(pipe);
+    }
+}
+
+static void service_worker(void* unused) {
+    (void)unused;
+    threads.name("service");
+    service_queue_t* q = &service_queue;
+    for (;;) {
+        mutexes.lock(&q->lock);
+        service_item_t* it = q->head;
+        if (it != null) {
+            q->head = it->next;
+            if (q->head == null) { q->tail = null; }
+        }
+        const bool quit = q->quit;
+        mutexes.unlock(&q->lock);
+        if (it == null && quit) { break; }
+        if (it == null) {
+            events.wait(q->wake);
+        } else {
+            char reply[1024];
+            int r = q->job(it->line, reply, countof(reply) - 1);
+            char text[countof(reply) + 64];
+            snprintf(text, countof(text), "%s %d %s\n", r == 0 ? "done" : "failed",
+                it->id, reply);
+            traceln("%s", text);
+            service_reply(it->pipe, text);
+            DisconnectNamedPipe(it->pipe);
+            CloseHandle(it->pipe);
+            free(it);
+        }
+    }
+}
+
+// reads single '\n' terminated line, returns false on error or overflow
+static bool service_read_line(HANDLE pipe, char* line, int count) {
+    int n = 0;
+    for (;;) {
+        DWORD bytes = 0;
+        if (!ReadFile(pipe, line + n, 1, &bytes, null) || bytes == 0) {
+            break; // client closed: line without '\n' is still accepted
+        }
+        if (line[n] == '\n') { break; }
+        if (++n >= count - 1) { return false; }
+    }
+    while (n > 0 && (line[n - 1] == '\r' || line[n - 1] == '\n' || line[n - 1] == 0x20)) { n--; }
+    line[n] = 0;
+    return n > 0;
+}
+
+static int service_run(const char* name, service_job_t job) {
+    char pipe_name[256];
+    snprintf(pipe_name, countof(pipe_name), "\\\\.\\pipe\\%s", name);
+    service_queue_t* q = &service_queue;
+    q->job = job;
+    mutexes.init(&q->lock);
+    q->wake = events.create();
+    thread_t worker = threads.start(service_worker, null);
+    traceln("service: listening on %s", pipe_name);
+    int r = 0;
+    int32_t id = 0;
+    bool quit = false;
+    while (!quit && r == 0) {
+        HANDLE pipe = CreateNamedPipeA(pipe_name, PIPE_ACCESS_DUPLEX,
+            PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+            PIPE_UNLIMITED_INSTANCES, 4096, 4096, 0, null);
+        if (pipe == INVALID_HANDLE_VALUE) { r = GetLastError(); break; }
+        bool connected = ConnectNamedPipe(pipe, null) ||
+            GetLastError() == ERROR_PIPE_CONNECTED;
+        service_item_t* it = connected ?
+            (service_item_t*)calloc(1, sizeof(service_item_t)) : null;
+        if (it != null && service_read_line(pipe, it->line, countof(it->line))) {
+            quit = strcmp(it->line, "quit") == 0;
+            if (!quit) {
+                it->pipe = pipe;
+                it->id = ++id;
+                char text[64];
+                snprintf(text, countof(text), "queued %d\n", it->id);
+                service_reply(pipe, text);
+                mutexes.lock(&q->lock);
+                if (q->tail != null) { q->tail->next = it; } else { q->head = it; }
+                q->tail = it;
+                mutexes.unlock(&q->lock);
+                events.set(q->wake);
+                it = null;
+                pipe = INVALID_HANDLE_VALUE; // owned by queued item
+            } else {
+                service_reply(pipe, "bye\n");
+            }
+        }
+        free(it);
+        if (pipe != INVALID_HANDLE_VALUE) {
+            DisconnectNamedPipe(pipe);
+            CloseHandle(pipe);
+        }
+    }
+    if (r != 0) { traceln("service: %s failed %s", pipe_name, crt.error(r)); }
+    mutexes.lock(&q->lock);
+    q->quit = true;
+    mutexes.unlock(&q->lock);
+    events.set(q->wake);
+    threads.join(worker);
+    events.dispose(q->wake);
+    mutexes.dispose(&q->lock);
+    return r;
+}
+
+service_if service = {
+    .run = service_run
+};
+
+end_c
@@ -0,0 +1,25 @@
+#pragma once
+#include "crt.h"
+
+begin_c
+
+// Headless job service on a local named pipe "\\.\pipe\<name>".
+// A client connects, writes a single job line terminated by '\n' and
+// receives "queued <id>\n" immediately. Jobs run one after another on a
+// single long lived worker thread and when a job finishes its reply line
+// is written back to the same connection (if the client still waits).
+// The job line "quit" stops accepting jobs, drains the queue and returns.
+// Example (cmd.exe): echo c:/photos c:/out --layout date > \\.\pipe\photos
+
+// Runs job on the worker thread and fills reply (single line without '\n').
+// `line` is the job line without trailing '\n'. Returns 0 or error.
+typedef int (*service_job_t)(const char* line, char* reply, int count);
+
+typedef struct {
+    // blocks serving jobs until "quit", returns 0 or error
+    int (*run)(const char* name, service_job_t job);
+} service_if;
+
+extern service_if service;
+
+end_c
@@ -0,0 +1,177 @@
+#include "tar.h"
+
+begin_c
+
+enum { tar_block = 512, tar_buffer_bytes = 4 * 1024 * 1024 };
+
+typedef struct tar_header_s { // POSIX ustar
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char chksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+} tar_header_t;
+
+static_assertion(sizeof(tar_header_t) == tar_block);
+
+typedef struct tar_s {
+    FILE* file;
+    byte* buffer;
+    int32_t used;
+    int r; // first error, sticky
+} tar_t_;
+
+static void tar_flush(tar_t_* t) {
+    if (t->r == 0 && t->used > 0 && fwrite(t->buffer, 1, t->used, t->file) != (size_t)t->used) {
+        t->r = errno != 0 ? errno : EIO;
+    }
+    t->used = 0;
+}
+
+static void tar_write(tar_t_* t, const void* data, int64_t bytes) {
+    if (t->used + bytes > tar_buffer_bytes) { tar_flush(t); }
+    if (bytes >= tar_buffer_bytes) { // large entries bypass the buffer
+        if (t->r == 0 && fwrite(data, 1, (size_t)bytes, t->file) != (size_t)bytes) {
+            t->r = errno != 0 ? errno : EIO;
+        }
+    } else {
+        memcpy(t->buffer + t->used, data, (size_t)bytes);
+        t->used += (int32_t)bytes;
+    }
+}
+
+static void tar_pad(tar_t_* t, int64_t bytes) {
+    static const byte zeros[tar_block];
+    const int32_t n = (int32_t)((tar_block - bytes % tar_block) % tar_block);
+    if (n > 0) { tar_write(t, zeros, n); }
+}
+
+static void tar_octal(char* field, int32_t count, uint64_t v) {
+    // count - 1 octal digits zero padded and terminating NUL
+    for (int32_t i = count - 2; i >= 0; i--) {
+        field[i] = (char)('0' + (v & 7));
+        v >>= 3;
+    }
+    field[count - 1] = 0;
+}
+
+// values that do not fit count - 1 octal digits (size of 8GB and more) are
+// GNU base-256: high bit of the first byte set, big endian binary after it
+static void tar_number(char* field, int32_t count, uint64_t v) {
+    if (v >> (3 * (count - 1)) == 0) {
+        tar_octal(field, count, v);
+    } else {
+        field[0] = (char)0x80;
+        for (int32_t i = count - 1; i > 0; i--) {
+            field[i] = (char)(v & 0xFF);
+            v >>= 8;
+        }
+    }
+}
+
+// '/' splitting name into ustar prefix and name or null if there is none
+static const char* tar_split(const char* name, int32_t n) {
+    const char* s = name + n - 101; // name part is at most 100 chars
+    while (*s != 0 && *s != '/') { s++; }
+    return *s == '/' && s - name <= 155 ? s : null;
+}
+
+static bool tar_fits(const char* name) {
+    const int32_t n = (int32_t)strlen(name);
+    return n <= 100 || tar_split(name, n) != null;
+}
+
+static void tar_header(tar_t_* t, const char* name, char type, int64_t bytes,
+        int64_t mtime) {
+    tar_header_t h = {0};
+    const int32_t n = (int32_t)strlen(name);
+    if (n <= countof(h.name)) {
+        memcpy(h.name, name, n);
+    } else {
+        // name is truncated if it does not fit: preceded by LongLink record
+        const char* s = tar_split(name, n);
+        if (s != null) {
+            memcpy(h.prefix, name, s - name);
+            memcpy(h.name, s + 1, n - (s + 1 - name));
+        } else {
+            memcpy(h.name, name, countof(h.name));
+        }
+    }
+    tar_octal(h.mode, countof(h.mode), 0644);
+    tar_octal(h.uid, countof(h.uid), 0);
+    tar_octal(h.gid, countof(h.gid), 0);
+    tar_number(h.size, countof(h.size), (uint64_t)bytes);
+    tar_octal(h.mtime, countof(h.mtime), mtime > 0 ? (uint64_t)mtime : 0);
+    h.typeflag = type;
+    memcpy(h.magic, "ustar", 6);
+    memcpy(h.version, "00", 2);
+    memset(h.chksum, ' ', sizeof(h.chksum));
+    uint32_t sum = 0;
+    const byte* b = (const byte*)&h;
+    for (int32_t i = 0; i < tar_block; i++) { sum += b[i]; }
+    tar_octal(h.chksum, 7, sum); // 6 digits, NUL and the space left from above
+    tar_write(t, &h, sizeof(h));
+}
+
+static tar_t tar_open(const char* pathname) {
+    tar_t_* t = (tar_t_*)calloc(1, sizeof(tar_t_));
+    if (t != null) {
+        t->buffer = (byte*)malloc(tar_buffer_bytes);
+        t->file = fopen(pathname, "wb");
+        if (t->buffer == null || t->file == null) {
+            traceln("tar: failed to create %s", pathname);
+            if (t->file != null) { fclose(t->file); }
+            free(t->buffer);
+            free(t);
+            t = null;
+        }
+    }
+    return (tar_t)t;
+}
+
+static int tar_append(tar_t handle, const char* name, const void* data, int64_t bytes,
+        int64_t mtime) {
+    tar_t_* t = (tar_t_*)handle;
+    if (!tar_fits(name)) {
+        const int64_t n = (int64_t)strlen(name) + 1;
+        tar_header(t, "././@LongLink", 'L', n, 0);
+        tar_write(t, name, n);
+        tar_pad(t, n);
+    }
+    tar_header(t, name, '0', bytes, mtime);
+    tar_write(t, data, bytes);
+    tar_pad(t, bytes);
+    return t->r;
+}
+
+static int tar_close(tar_t handle) {
+    tar_t_* t = (tar_t_*)handle;
+    static const byte zeros[tar_block * 2]; // end of archive
+    tar_write(t, zeros, sizeof(zeros));
+    tar_flush(t);
+    if (fclose(t->file) != 0 && t->r == 0) { t->r = errno; }
+    int r = t->r;
+    free(t->buffer);
+    free(t);
+    return r;
+}
+
+tar_if tar = {
+    .open   = tar_open,
+    .append = tar_append,
+    .close  = tar_close
+};
+
+end_c
@@ -0,0 +1,28 @@
+#pragma once
+#include "crt.h"
+
+begin_c
+
+// Streaming tar (POSIX ustar) archive writer.
+// Entries are appended to a single file through a large buffer, so
+// writing an archive of many small files costs big sequential writes
+// only: no per entry file create, close or time change. Entry names
+// longer than ustar allows are preceded by GNU "././@LongLink" records and
+// sizes of 8GB and more use GNU base-256 (understood by GNU tar, bsdtar and
+// 7-Zip).
+
+typedef struct tar_s* tar_t;
+
+typedef struct {
+    tar_t (*open)(const char* pathname); // creates or truncates
+    // appends regular file entry `name` ('/' separated, relative)
+    // mtime is in seconds since 1970-01-01 00:00:00 UTC
+    int (*append)(tar_t t, const char* name, const void* data, int64_t bytes,
+        int64_t mtime);
+    // writes end of archive marker, flushes and closes, returns 0 or error
+    int (*close)(tar_t t);
+} tar_if;
+
+extern tar_if tar;
+
+end_c
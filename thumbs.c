@@ -0,0 +1,296 @@
+#include "thumbs.h"
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define _fseeki64 fseeko
+#define _ftelli64 ftello
+#endif
+
+begin_c
+
+enum { thumbs_magic = 0x54485043 }; // "THPC"
+
+typedef struct thumbs_entry_s {
+    uint64_t key;
+    uint64_t mtime;
+    uint64_t offset; // in the pack file
+    uint32_t bytes;
+    uint32_t data;   // checksum of the thumbnail bytes in the pack
+    uint32_t check;  // of the entry itself including data
+    uint32_t reserved;
+} thumbs_entry_t;
+
+static_assertion(sizeof(thumbs_entry_t) == 40);
+
+typedef struct thumbs_map_s { // read only mapping of a file prefix
+    void* data;
+    int64_t bytes;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} thumbs_map_t;
+
+typedef struct thumbs_s {
+    FILE* pack;   // "a+b": reads anywhere, writes append
+    FILE* index;
+    thumbs_map_t pack_map;
+    thumbs_map_t index_map;
+    int64_t pack_bytes;
+    const thumbs_entry_t* mapped; // entries inside index_map
+    int32_t mapped_count;
+    thumbs_entry_t* appended;     // entries put() after open()
+    int32_t appended_count;
+    int32_t appended_allocated;
+    int32_t* hash; // key -> entry number (mapped first, then appended)
+    int32_t hash_mask;
+    int32_t hash_count;
+    byte* scratch; // for thumbnails appended after the pack was mapped
+    int32_t scratch_bytes;
+} thumbs_t_;
+
+static uint32_t thumbs_check(const thumbs_entry_t* e) {
+    uint64_t x = e->key ^ (e->mtime * 31) ^ (e->offset * 131) ^ e->bytes ^
+        ((uint64_t)e->data << 17);
+    return (uint32_t)(x ^ (x >> 32)) ^ thumbs_magic;
+}
+
+static uint32_t thumbs_data_check(const byte* data, uint32_t bytes) { // FNV-1a
+    uint32_t h = 0x811C9DC5U;
+    for (uint32_t i = 0; i < bytes; i++) {
+        h ^= data[i];
+        h *= 0x01000193U;
+    }
+    return h;
+}
+
+// Mappings share read and write access so that appends through stdio
+// keep working while the file prefix is mapped.
+
+static void thumbs_map(thumbs_map_t* m, const char* filename) {
+    memset(m, 0, sizeof(*m));
+#ifdef _WIN32
+    m->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+        null, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, null);
+    LARGE_INTEGER size = {0};
+    if (m->file != INVALID_HANDLE_VALUE && GetFileSizeEx(m->file, &size) && size.QuadPart > 0) {
+        m->mapping = CreateFileMappingA(m->file, null, PAGE_READONLY, 0, 0, null);
+        if (m->mapping != null) {
+            m->data = MapViewOfFile(m->mapping, FILE_MAP_READ, 0, 0, 0);
+            m->bytes = m->data != null ? size.QuadPart : 0;
+        }
+    }
+#else
+    int fd = open(filename, O_RDONLY);
+    struct stat st = {0};
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* a = mmap(null, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (a != MAP_FAILED) {
+            m->data = a;
+            m->bytes = st.st_size;
+        }
+    }
+    if (fd >= 0) { close(fd); }
+#endif
+}
+
+static void thumbs_unmap(thumbs_map_t* m) {
+#ifdef _WIN32
+    if (m->data != null) { UnmapViewOfFile(m->data); }
+    if (m->mapping != null) { CloseHandle(m->mapping); }
+    if (m->file != null && m->file != INVALID_HANDLE_VALUE) { CloseHandle(m->file); }
+#else
+    if (m->data != null) { munmap(m->data, m->bytes); }
+#endif
+    memset(m, 0, sizeof(*m));
+}
+
+static uint64_t thumbs_key(const char* pathname) { // FNV-1a
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (const byte* s = (const byte*)pathname; *s != 0; s++) {
+        h ^= *s;
+        h *= 0x100000001B3ULL;
+    }
+    return h;
+}
+
+static const thumbs_entry_t* thumbs_entry(const thumbs_t_* t, int32_t i) {
+    return i < t->mapped_count ? &t->mapped[i] : &t->appended[i - t->mapped_count];
+}
+
+static int32_t* thumbs_slot(thumbs_t_* t, uint64_t key) {
+    uint32_t i = (uint32_t)(key ^ (key >> 32)) & t->hash_mask;
+    for (;;) {
+        int32_t* s = &t->hash[i];
+        if (*s < 0 || thumbs_entry(t, *s)->key == key) { return s; }
+        i = (i + 1) & t->hash_mask;
+    }
+}
+
+static int thumbs_rehash(thumbs_t_* t, int32_t size) {
+    int32_t* h = (int32_t*)malloc(size * sizeof(int32_t));
+    if (h == null) { return ENOMEM; }
+    free(t->hash);
+    t->hash = h;
+    t->hash_mask = size - 1;
+    t->hash_count = 0;
+    for (int32_t i = 0; i < size; i++) { t->hash[i] = -1; }
+    const int32_t n = t->mapped_count + t->appended_count;
+    for (int32_t i = 0; i < n; i++) {
+        int32_t* s = thumbs_slot(t, thumbs_entry(t, i)->key);
+        if (*s < 0) { t->hash_count++; }
+        *s = i; // later entries supersede earlier ones
+    }
+    return 0;
+}
+
+static int thumbs_add(thumbs_t_* t, int32_t i) {
+    if ((t->hash_count + 1) * 2 > t->hash_mask + 1) {
+        int r = thumbs_rehash(t, (t->hash_mask + 1) * 2);
+        if (r != 0) { return r; }
+    }
+    int32_t* s = thumbs_slot(t, thumbs_entry(t, i)->key);
+    if (*s < 0) { t->hash_count++; }
+    *s = i;
+    return 0;
+}
+
+static int64_t thumbs_file_size(FILE* f) {
+    _fseeki64(f, 0, SEEK_END);
+    return (int64_t)_ftelli64(f);
+}
+
+static void thumbs_close(thumbs_t handle) {
+    thumbs_t_* t = (thumbs_t_*)handle;
+    if (t != null) {
+        if (t->pack != null)  { fclose(t->pack); }
+        if (t->index != null) { fclose(t->index); }
+        thumbs_unmap(&t->pack_map);
+        thumbs_unmap(&t->index_map);
+        free(t->appended);
+        free(t->hash);
+        free(t->scratch);
+        free(t);
+    }
+}
+
+static thumbs_t thumbs_open(const char* folder, const char* name) {
+    thumbs_t_* t = (thumbs_t_*)calloc(1, sizeof(thumbs_t_));
+    if (t == null) { return null; }
+    const int n = (int)(strlen(folder) + strlen(name) + 16);
+    char* pack_name = (char*)stackalloc(n);
+    char* index_name = (char*)stackalloc(n);
+    snprintf(pack_name, n, "%s/%s.pack", folder, name);
+    snprintf(index_name, n, "%s/%s.index", folder, name);
+    t->pack = fopen(pack_name, "a+b");
+    t->index = fopen(index_name, "r+b");
+    if (t->index == null) { t->index = fopen(index_name, "w+b"); }
+    if (t->pack == null || t->index == null) {
+        traceln("failed to open %s or %s", pack_name, index_name);
+        thumbs_close((thumbs_t)t);
+        return null;
+    }
+    t->pack_bytes = thumbs_file_size(t->pack);
+    thumbs_map(&t->pack_map, pack_name);
+    thumbs_map(&t->index_map, index_name);
+    t->mapped = (const thumbs_entry_t*)t->index_map.data;
+    const int32_t entries = (int32_t)(t->index_map.bytes / sizeof(thumbs_entry_t));
+    // count only valid prefix: torn or garbage tail is overwritten by put()
+    while (t->mapped_count < entries) {
+        const thumbs_entry_t* e = &t->mapped[t->mapped_count];
+        if (e->check != thumbs_check(e) || e->offset + e->bytes > (uint64_t)t->pack_bytes) {
+            traceln("%s: %d of %d entries valid", index_name, t->mapped_count, entries);
+            break;
+        }
+        t->mapped_count++;
+    }
+    int32_t size = 1024;
+    while (size < t->mapped_count * 2) { size *= 2; }
+    if (thumbs_rehash(t, size) != 0) {
+        thumbs_close((thumbs_t)t);
+        return null;
+    }
+    _fseeki64(t->index, (int64_t)t->mapped_count * sizeof(thumbs_entry_t), SEEK_SET);
+    return (thumbs_t)t;
+}
+
+static const byte* thumbs_get(thumbs_t handle, uint64_t key, uint64_t mtime, int32_t* bytes) {
+    thumbs_t_* t = (thumbs_t_*)handle;
+    const int32_t i = *thumbs_slot(t, key);
+    if (i < 0) { return null; }
+    const thumbs_entry_t* e = thumbs_entry(t, i);
+    if (e->mtime != mtime) { return null; }
+    *bytes = (int32_t)e->bytes;
+    if ((int64_t)(e->offset + e->bytes) <= t->pack_map.bytes) {
+        const byte* data = (const byte*)t->pack_map.data + e->offset; // zero copy
+        return thumbs_data_check(data, e->bytes) == e->data ? data : null;
+    }
+    if (t->scratch_bytes < (int32_t)e->bytes) {
+        byte* s = (byte*)realloc(t->scratch, e->bytes);
+        if (s == null) { return null; }
+        t->scratch = s;
+        t->scratch_bytes = (int32_t)e->bytes;
+    }
+    if (_fseeki64(t->pack, (int64_t)e->offset, SEEK_SET) != 0 ||
+        fread(t->scratch, 1, e->bytes, t->pack) != e->bytes) {
+        return null;
+    }
+    return thumbs_data_check(t->scratch, e->bytes) == e->data ? t->scratch : null;
+}
+
+static int thumbs_put(thumbs_t handle, uint64_t key, uint64_t mtime,
+        const void* data, int32_t bytes) {
+    thumbs_t_* t = (thumbs_t_*)handle;
+    if (t->appended_count == t->appended_allocated) {
+        const int32_t n = t->appended_allocated == 0 ? 256 : t->appended_allocated * 2;
+        thumbs_entry_t* a = (thumbs_entry_t*)realloc(t->appended, n * sizeof(thumbs_entry_t));
+        if (a == null) { return ENOMEM; }
+        t->appended = a;
+        t->appended_allocated = n;
+    }
+    // size is taken from the file: a failed put() may have left a partial
+    // tail in the pack and entries must point past it (the seek to the end
+    // is also required between fread() and fwrite())
+    t->pack_bytes = thumbs_file_size(t->pack);
+    thumbs_entry_t e = { .key = key, .mtime = mtime,
+                         .offset = (uint64_t)t->pack_bytes, .bytes = (uint32_t)bytes,
+                         .data = thumbs_data_check((const byte*)data, (uint32_t)bytes) };
+    e.check = thumbs_check(&e);
+    // data is handed to the OS before the index refers to it but neither
+    // is fsync()ed: after power loss the index may reach the disk without
+    // the pack bytes, get() detects that by the data checksum
+    if (fwrite(data, 1, bytes, t->pack) != (size_t)bytes || fflush(t->pack) != 0) {
+        const int r = errno != 0 ? errno : EIO;
+        t->pack_bytes = thumbs_file_size(t->pack);
+        return r;
+    }
+    t->pack_bytes += bytes;
+    const int64_t record = (int64_t)(t->mapped_count + t->appended_count) * sizeof(e);
+    if (fwrite(&e, sizeof(e), 1, t->index) != 1 || fflush(t->index) != 0) {
+        const int r = errno != 0 ? errno : EIO;
+        _fseeki64(t->index, record, SEEK_SET); // partial record is overwritten next
+        return r;
+    }
+    t->appended[t->appended_count++] = e;
+    return thumbs_add(t, t->mapped_count + t->appended_count - 1);
+}
+
+static int32_t thumbs_count(thumbs_t handle) {
+    thumbs_t_* t = (thumbs_t_*)handle;
+    return t->hash_count;
+}
+
+thumbs_if thumbs = {
+    .open  = thumbs_open,
+    .key   = thumbs_key,
+    .get   = thumbs_get,
+    .put   = thumbs_put,
+    .count = thumbs_count,
+    .close = thumbs_close
+};
+
+end_c
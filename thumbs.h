@@ -0,0 +1,37 @@
+#pragma once
+#include "crt.h"
+
+begin_c
+
+// Packed on-disk thumbnail cache.
+// All encoded (JPEG) thumbnails of a library live in a single append-only
+// "<name>.pack" file. "<name>.index" is an append-only array of fixed size
+// entries {key, mtime, offset, bytes, checksums} memory mapped at open(),
+// so a cold start only touches the index and the pages of thumbnails
+// actually shown.
+// Entries are written after their data is flushed to the pack and carry
+// a checksum: a torn tail after a crash is ignored and overwritten.
+// Nothing is fsync()ed (a cache is cheap to rebuild): entries also carry
+// a checksum of the thumbnail bytes and get() treats a thumbnail that did
+// not reach the disk before power loss as absent.
+// Not thread safe.
+
+typedef struct thumbs_s* thumbs_t;
+
+typedef struct {
+    // opens or creates folder/name.pack and folder/name.index
+    thumbs_t (*open)(const char* folder, const char* name);
+    // stable 64-bit key of a source pathname
+    uint64_t (*key)(const char* pathname);
+    // encoded thumbnail or null if absent or stale (mtime differs);
+    // pointer stays valid until next get(), put() or close()
+    const byte* (*get)(thumbs_t t, uint64_t key, uint64_t mtime, int32_t* bytes);
+    // appends thumbnail, newer put() for the same key replaces older one
+    int (*put)(thumbs_t t, uint64_t key, uint64_t mtime, const void* data, int32_t bytes);
+    int32_t (*count)(thumbs_t t);
+    void (*close)(thumbs_t t);
+} thumbs_if;
+
+extern thumbs_if thumbs;
+
+end_c
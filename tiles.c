@@ -0,0 +1,277 @@
+#include "tiles.h"
+#include <math.h>
+#include "stb_image.h"
+#include "stb_image_resize.h"
+#include "stb_image_write.h"
+
+begin_c
+
+enum { tiles_info_level = 0x7F }; // pseudo level holding tiles_info_t
+
+static uint64_t tiles_key(const char* pathname, int32_t level, int32_t col, int32_t row) {
+    uint64_t k = thumbs.key(pathname) ^
+        (((uint64_t)level << 56) | ((uint64_t)row << 28) | (uint64_t)col);
+    // splitmix64 finalizer spreads (level, row, col) over all bits
+    k = (k ^ (k >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    k = (k ^ (k >> 27)) * 0x94D049BB133111EBULL;
+    return k ^ (k >> 31);
+}
+
+typedef struct tiles_writer_s {
+    byte* data;
+    int32_t bytes;
+    int32_t allocated;
+    bool failed;
+} tiles_writer_t;
+
+static void tiles_write(void *context, void* data, int bytes) {
+    tiles_writer_t* tw = (tiles_writer_t*)context;
+    if (tw->bytes + bytes > tw->allocated) {
+        const int32_t n = (tw->bytes + bytes) * 2;
+        byte* a = (byte*)realloc(tw->data, n);
+        if (a == null) { tw->failed = true; return; }
+        tw->data = a;
+        tw->allocated = n;
+    }
+    memcpy(tw->data + tw->bytes, data, bytes);
+    tw->bytes += bytes;
+}
+
+static int tiles_level_put(thumbs_t store, const char* pathname, uint64_t mtime,
+        int32_t level, const byte* pixels, int32_t w, int32_t h, int32_t c,
+        int32_t quality, byte* tile, tiles_writer_t* tw) {
+    int r = 0;
+    for (int32_t row = 0; row * tile_size < h && r == 0; row++) {
+        for (int32_t col = 0; col * tile_size < w && r == 0; col++) {
+            const int32_t x = col * tile_size;
+            const int32_t y = row * tile_size;
+            const int32_t cw = w - x < tile_size ? w - x : tile_size;
+            const int32_t ch = h - y < tile_size ? h - y : tile_size;
+            for (int32_t j = 0; j < ch; j++) {
+                memcpy(tile + (size_t)j * cw * c,
+                       pixels + ((size_t)(y + j) * w + x) * c, (size_t)cw * c);
+            }
+            tw->bytes = 0;
+            if (!stbi_write_jpg_to_func(tiles_write, tw, cw, ch, c, tile, quality) ||
+                tw->failed) {
+                r = ENOMEM;
+            } else {
+                r = thumbs.put(store, tiles_key(pathname, level, col, row), mtime,
+                    tw->data, tw->bytes);
+            }
+        }
+    }
+    return r;
+}
+
+static int tiles_generate(thumbs_t store, const char* pathname, uint64_t mtime,
+        const byte* pixels, int32_t w, int32_t h, int32_t c, int32_t quality) {
+    tiles_info_t info = { .w = w, .h = h, .levels = 1 };
+    while ((w >> (info.levels - 1)) > tile_size || (h >> (info.levels - 1)) > tile_size) {
+        info.levels++;
+    }
+    byte* tile = (byte*)malloc((size_t)tile_size * tile_size * c);
+    tiles_writer_t tw = {0};
+    const byte* level = pixels;
+    byte* scaled = null;
+    int32_t lw = w;
+    int32_t lh = h;
+    int r = tile == null ? ENOMEM : 0;
+    for (int32_t i = 0; i < info.levels && r == 0; i++) {
+        if (i > 0) { // each level is downscaled from the previous one
+            const int32_t nw = lw / 2 > 0 ? lw / 2 : 1;
+            const int32_t nh = lh / 2 > 0 ? lh / 2 : 1;
+            byte* next = (byte*)malloc((size_t)nw * nh * c);
+            if (next == null) { r = ENOMEM; break; }
+            stbir_resize_uint8(level, lw, lh, 0, next, nw, nh, 0, c);
+            free(scaled);
+            scaled = next;
+            level = next;
+            lw = nw;
+            lh = nh;
+        }
+        r = tiles_level_put(store, pathname, mtime, i, level, lw, lh, c, quality, tile, &tw);
+    }
+    // info is written last: a pyramid is visible only when complete
+    if (r == 0) {
+        r = thumbs.put(store, tiles_key(pathname, tiles_info_level, 0, 0), mtime,
+            &info, sizeof(info));
+    }
+    free(scaled);
+    free(tile);
+    free(tw.data);
+    return r;
+}
+
+static bool tiles_info(thumbs_t store, const char* pathname, uint64_t mtime,
+        tiles_info_t* info) {
+    int32_t bytes = 0;
+    const byte* data = thumbs.get(store, tiles_key(pathname, tiles_info_level, 0, 0),
+        mtime, &bytes);
+    if (data != null && bytes == sizeof(*info)) {
+        memcpy(info, data, sizeof(*info));
+        return true;
+    }
+    return false;
+}
+
+static int32_t tiles_level(const tiles_info_t* info, double zoom) {
+    // finest level that is still not smaller than on screen size
+    int32_t level = zoom >= 1.0 ? 0 : (int32_t)floor(log2(1.0 / zoom));
+    return level < info->levels ? level : info->levels - 1;
+}
+
+static int32_t tiles_visible(const tiles_info_t* info, double x, double y, double zoom,
+        int32_t vw, int32_t vh, tile_t* tiles, int32_t max) {
+    const int32_t level = tiles_level(info, zoom);
+    const double scale = (double)(1 << level); // full resolution pixels per level pixel
+    const int32_t lw = info->w >> level > 0 ? info->w >> level : 1;
+    const int32_t lh = info->h >> level > 0 ? info->h >> level : 1;
+    // viewport in level pixel coordinates:
+    const double x0 = x / scale;
+    const double y0 = y / scale;
+    const double x1 = x0 + vw / (zoom * scale);
+    const double y1 = y0 + vh / (zoom * scale);
+    const int32_t c0 = x0 < 0 ? 0 : (int32_t)(x0 / tile_size);
+    const int32_t r0 = y0 < 0 ? 0 : (int32_t)(y0 / tile_size);
+    const int32_t c1 = (int32_t)ceil((x1 < lw ? x1 : lw) / tile_size);
+    const int32_t r1 = (int32_t)ceil((y1 < lh ? y1 : lh) / tile_size);
+    const double k = zoom * scale; // viewport pixels per level pixel
+    int32_t n = 0;
+    for (int32_t row = r0; row < r1 && n < max; row++) {
+        for (int32_t col = c0; col < c1 && n < max; col++) {
+            tile_t* t = &tiles[n++];
+            t->level = level;
+            t->col = col;
+            t->row = row;
+            const int32_t tw = lw - col * tile_size < tile_size ? lw - col * tile_size : tile_size;
+            const int32_t th = lh - row * tile_size < tile_size ? lh - row * tile_size : tile_size;
+            t->x = (int32_t)floor((col * tile_size - x0) * k);
+            t->y = (int32_t)floor((row * tile_size - y0) * k);
+            t->w = (int32_t)ceil(tw * k);
+            t->h = (int32_t)ceil(th * k);
+        }
+    }
+    return n;
+}
+
+static const byte* tiles_fetch(thumbs_t store, const char* pathname, uint64_t mtime,
+        const tile_t* tile, int32_t* bytes) {
+    return thumbs.get(store, tiles_key(pathname, tile->level, tile->col, tile->row),
+        mtime, bytes);
+}
+
+// synthetic image: smooth gradients survive JPEG within a few levels
+static byte tiles_test_pixel(int32_t x, int32_t y, int32_t k) {
+    return (byte)(k == 0 ? x / 4 : k == 1 ? y / 4 : 128);
+}
+
+// decodes every visible tile and checks its size and the pixel at its
+// center against the image point it is placed over
+static int tiles_test_view(thumbs_t store, const char* name, const tiles_info_t* info,
+        double x, double y, double zoom, int32_t vw, int32_t vh, int32_t expected) {
+    tile_t visible[64];
+    const int32_t n = tiles_visible(info, x, y, zoom, vw, vh, visible, countof(visible));
+    if (n != expected) {
+        traceln("tiles: %d visible tiles at zoom %.3f expected %d", n, zoom, expected);
+        return EINVAL;
+    }
+    int32_t x0 = INT32_MAX, y0 = INT32_MAX, x1 = INT32_MIN, y1 = INT32_MIN;
+    int r = 0;
+    for (int32_t i = 0; i < n && r == 0; i++) {
+        const tile_t* t = &visible[i];
+        int32_t bytes = 0;
+        const byte* data = tiles_fetch(store, name, 1, t, &bytes);
+        int w = 0, h = 0, c = 0;
+        byte* pixels = data == null ? null : stbi_load_from_memory(data, bytes, &w, &h, &c, 3);
+        const double k = zoom * (1 << t->level); // viewport pixels per level pixel
+        if (pixels == null) {
+            traceln("tiles: tile %d:%d,%d missing", t->level, t->col, t->row);
+            r = ENOENT;
+        } else if (abs((int32_t)ceil(w * k) - t->w) > 0 || abs((int32_t)ceil(h * k) - t->h) > 0) {
+            traceln("tiles: tile %d:%d,%d is %dx%d placed as %dx%d",
+                t->level, t->col, t->row, w, h, t->w, t->h);
+            r = EINVAL;
+        } else {
+            // full resolution point under the tile center
+            const int32_t fx = (int32_t)(x + (t->x + t->w / 2.0) / zoom);
+            const int32_t fy = (int32_t)(y + (t->y + t->h / 2.0) / zoom);
+            const byte* p = pixels + ((size_t)(h / 2) * w + w / 2) * 3;
+            for (int32_t j = 0; j < 3 && r == 0; j++) {
+                if (abs(p[j] - tiles_test_pixel(fx, fy, j)) > 16) {
+                    traceln("tiles: tile %d:%d,%d center %d expected %d",
+                        t->level, t->col, t->row, p[j], tiles_test_pixel(fx, fy, j));
+                    r = EINVAL;
+                }
+            }
+        }
+        stbi_image_free(pixels);
+        if (t->x < x0) { x0 = t->x; }
+        if (t->y < y0) { y0 = t->y; }
+        if (t->x + t->w > x1) { x1 = t->x + t->w; }
+        if (t->y + t->h > y1) { y1 = t->y + t->h; }
+    }
+    // tiles cover the viewport (or the image where it ends inside it)
+    const int32_t right = (int32_t)ceil((info->w - x) * zoom);
+    const int32_t bottom = (int32_t)ceil((info->h - y) * zoom);
+    if (r == 0 && (x0 > 0 || y0 > 0 || x1 < (vw < right ? vw : right) - 1 ||
+                   y1 < (vh < bottom ? vh : bottom) - 1)) {
+        traceln("tiles: [%d,%d %d,%d] do not cover %dx%d", x0, y0, x1, y1, vw, vh);
+        r = EINVAL;
+    }
+    return r;
+}
+
+static int tiles_test(const char* folder) {
+    enum { w = 1000, h = 600 };
+    byte* pixels = (byte*)malloc((size_t)w * h * 3);
+    if (pixels == null) { return ENOMEM; }
+    for (int32_t y = 0; y < h; y++) {
+        for (int32_t x = 0; x < w; x++) {
+            for (int32_t k = 0; k < 3; k++) {
+                pixels[((size_t)y * w + x) * 3 + k] = tiles_test_pixel(x, y, k);
+            }
+        }
+    }
+    const char* name = "tiles.test.jpg";
+    thumbs_t store = thumbs.open(folder, "tiles.test");
+    int r = store == null ? EIO : tiles_generate(store, name, 1, pixels, w, h, 3, 90);
+    tiles_info_t info = {0};
+    if (r == 0 && (!tiles_info(store, name, 1, &info) ||
+                   info.w != w || info.h != h || info.levels != 3)) {
+        traceln("tiles: info %dx%d levels %d", info.w, info.h, info.levels);
+        r = EINVAL;
+    }
+    if (r == 0 && tiles_info(store, name, 2, &info)) {
+        traceln("tiles: stale pyramid reported");
+        r = EINVAL;
+    }
+    // full resolution 400x300 viewport at (300, 200): columns 1..2, rows 0..1
+    if (r == 0) { r = tiles_test_view(store, name, &info, 300, 200, 1.0, 400, 300, 4); }
+    // right bottom corner with edge tiles 232x88
+    if (r == 0) { r = tiles_test_view(store, name, &info, 700, 400, 1.0, 400, 300, 4); }
+    // half size: level 1 500x300, 2x2 tiles
+    if (r == 0) { r = tiles_test_view(store, name, &info, 0, 0, 0.5, 640, 480, 4); }
+    // whole image into a small window: single tile of level 2
+    if (r == 0) { r = tiles_test_view(store, name, &info, 0, 0, 0.2, 200, 120, 1); }
+    if (store != null) { thumbs.close(store); }
+    free(pixels);
+    char pathname[260];
+    snprintf(pathname, countof(pathname), "%s/tiles.test.pack", folder);
+    remove(pathname);
+    snprintf(pathname, countof(pathname), "%s/tiles.test.index", folder);
+    remove(pathname);
+    traceln("tiles: test %s", r == 0 ? "passed" : "FAILED");
+    return r;
+}
+
+tiles_if tiles = {
+    .generate = tiles_generate,
+    .info     = tiles_info,
+    .level    = tiles_level,
+    .visible  = tiles_visible,
+    .fetch    = tiles_fetch,
+    .test     = tiles_test
+};
+
+end_c
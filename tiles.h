@@ -0,0 +1,58 @@
+#pragma once
+#include "crt.h"
+#include "thumbs.h"
+
+begin_c
+
+// Mipmap tile pyramid for zoomable viewing of large images.
+// Level 0 is full resolution, every next level is half the size of the
+// previous one down to the level that fits into a single tile. Each level
+// is cut into tile_size x tile_size JPEG tiles (edge tiles are smaller)
+// stored in a thumbs pack keyed by (pathname, level, column, row).
+// The viewer computes the tiles intersecting its viewport at the level
+// matching the zoom and fetches only those, so pan and zoom cost depends
+// on viewport size and not on image size.
+
+enum { tile_size = 256 };
+
+typedef struct tiles_info_s {
+    int32_t w;      // full resolution image size
+    int32_t h;
+    int32_t levels; // number of pyramid levels (>= 1)
+} tiles_info_t;
+
+typedef struct tile_s {
+    int32_t level;
+    int32_t col;   // tile column and row at the level
+    int32_t row;
+    int32_t x;     // placement in viewport pixels
+    int32_t y;
+    int32_t w;
+    int32_t h;
+} tile_t;
+
+typedef struct {
+    // writes the pyramid of decoded pixels into the store, returns 0 or error
+    int (*generate)(thumbs_t store, const char* pathname, uint64_t mtime,
+        const byte* pixels, int32_t w, int32_t h, int32_t c, int32_t quality);
+    // false if there is no (up to date) pyramid for pathname in the store
+    bool (*info)(thumbs_t store, const char* pathname, uint64_t mtime,
+        tiles_info_t* info);
+    // best level for zoom (1.0 full resolution, 0.5 half size...)
+    int32_t (*level)(const tiles_info_t* info, double zoom);
+    // Tiles covering viewport [vw x vh] showing image at zoom with full
+    // resolution image point (x, y) at viewport top left corner.
+    // Returns number of tiles (at most max) written into tiles[].
+    int32_t (*visible)(const tiles_info_t* info, double x, double y, double zoom,
+        int32_t vw, int32_t vh, tile_t* tiles, int32_t max);
+    // encoded tile, pointer valid until next access to the store
+    const byte* (*fetch)(thumbs_t store, const char* pathname, uint64_t mtime,
+        const tile_t* tile, int32_t* bytes);
+    // headless self check: generate(), visible() and fetch() round trip of
+    // a synthetic image in a scratch store in folder, returns 0 or error
+    int (*test)(const char* folder);
+} tiles_if;
+
+extern tiles_if tiles;
+
+end_c
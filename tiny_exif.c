@@ -39,6 +39,7 @@
 #include <inttypes.h>
 #include <assert.h>
 #include <ctype.h>
+#include <stdlib.h>
 #include "yxml.h"
 #include "crt.h"
 
@@ -321,7 +322,6 @@ typedef struct entry_parser_s {
     const uint8_t* data;
     uint32_t bytes;
     uint32_t tiff_header_start;
-    bool     alignIntel; // byte alignment (defined in EXIF header)
     uint32_t offs; // current offset into buffer
     uint16_t tag;
     uint16_t format;
@@ -333,16 +333,6 @@ static void parser_init(entry_parser_t* p, uint32_t _offs) {
     p->offs = _offs - 12;
 }
 
-static uint32_t parse32(const uint8_t* buf, bool intel);
-
-static uint32_t get_data(entry_parser_t* p) {
-    return parse32(p->data + p->offs + 8, p->alignIntel);
-}
-
-static uint32_t get_sub_ifd(entry_parser_t* p) {
-    return p->tiff_header_start + get_data(p);
-}
-
 static bool is_short(entry_parser_t* p) { return p->format == 3; }
 static bool is_long(entry_parser_t* p) { return p->format == 4; }
 static bool is_rational(entry_parser_t* p) { return p->format == 5 || p->format == 10; }
@@ -352,151 +342,31 @@ static bool is_undefined(entry_parser_t* p) { return p->format == 7; }
 
 static uint8_t parse8(const uint8_t* buf) { return buf[0]; }
 
-static uint16_t parse16(const uint8_t* buf, bool intel) {
-    if (intel)
-        return ((uint16_t)buf[1]<<8) | buf[0];
-    return ((uint16_t)buf[0]<<8) | buf[1];
-}
-
-static uint32_t parse32(const uint8_t* buf, bool intel) {
-    if (intel)
-        return ((uint32_t)buf[3]<<24) |
-            ((uint32_t)buf[2]<<16) |
-            ((uint32_t)buf[1]<<8)  |
-            buf[0];
-    return ((uint32_t)buf[0]<<24) |
-        ((uint32_t)buf[1]<<16) |
-        ((uint32_t)buf[2]<<8)  |
-        buf[3];
-}
-
-static float parse_float(const uint8_t* buf, bool intel) {
-    union {
-        uint32_t i;
-        float f;
-    } i2f;
-    i2f.i = parse32(buf, intel);
-    return i2f.f;
-}
-
-static double parse_rational(const uint8_t* buf, bool intel, bool isSigned) {
-    const uint32_t denominator = parse32(buf+4, intel);
-    if (denominator == 0)
-        return 0.0;
-    const uint32_t numerator = parse32(buf, intel);
-    return isSigned ?
-        (double)(int32_t)numerator/(double)(int32_t)denominator :
-        (double)numerator/(double)denominator;
-}
-
-static exif_str_t parse_string(entry_parser_t* p, const uint8_t* buf,
-    uint32_t num_components,
-    uint32_t value,
-    uint32_t base,
-    uint32_t count,
-    bool intel) {
-    char* res = p->info->next;
-    if (num_components <= 4) {
-        if ((size_t)(p->info->next - p->info->strings + sizeof(p->info->strings)) <= num_components + 1) {
-            return "";
-        }
-        p->info->next += num_components + 1;
-        char j = intel ? 0 : 24;
-        char j_m = intel ? -8 : 8;
-        for (uint32_t i = 0; i<num_components; i++, j -= j_m) {
-            res[i] = (value >> j) & 0xff;
-        }
-        if (num_components > 0 && res[num_components - 1] == 0) {
-            res[num_components - 1] = 0;
-        }
-    } else if (base + value + num_components <= count) {
-        const char* const s = (const char*)buf + base + value;
-        uint32_t num = 0;
-        while (num < num_components && s[num] != 0) { ++num; }
-        while (num && s[num-1] == ' ') { --num; }
-        if ((size_t)(p->info->next - p->info->strings + sizeof(p->info->strings)) <= num + 1) {
-            return "";
-        }
-        p->info->next += num + 1;
-        memcpy(res, s, num);
-        res[num] = 0;
-    }
-    return res;
-}
-
-static void parse_tag(entry_parser_t* p) {
-    p->offs  += 12;
-    p->tag    = parse16(p->data + p->offs, p->alignIntel);
-    p->format = parse16(p->data + p->offs + 2, p->alignIntel);
-    p->length = parse32(p->data + p->offs + 4, p->alignIntel);
-}
-
-static bool parser_fetch_str(entry_parser_t* p, exif_str_t* val) {
-    if (p->format != 2 || p->length == 0)
-        return false;
-    *val = parse_string(p, p->data, p->length, get_data(p), p->tiff_header_start,
-        p->bytes, p->alignIntel);
-    return true;
-}
-
-static bool parser_fetch8(entry_parser_t* p, uint8_t* val) {
-    if ((p->format != 1 && p->format != 2 && p->format != 6) || p->length == 0)
-        return false;
-    *val = parse8(p->data + p->offs + 8);
-    return true;
-}
-
-static bool parser_fetch16(entry_parser_t* p, uint16_t* val) {
-    if (!is_short(p) || p->length == 0)
-        return false;
-    *val = parse16(p->data + p->offs + 8, p->alignIntel);
-    return true;
-}
-
-static bool parser_fetch16_idx(entry_parser_t* p, uint16_t* val, uint32_t idx) {
-    if (!is_short(p) || p->length <= idx)
-        return false;
-    *val = parse16(p->data + get_sub_ifd(p) + idx * 2, p->alignIntel);
-    return true;
-}
-
-static bool parser_fetch32(entry_parser_t* p, uint32_t* val) {
-    if (!is_long(p) || p->length == 0)
-        return false;
-    *val = parse32(p->data + p->offs + 8, p->alignIntel);
-    return true;
-}
-
-static bool parser_fetch_float(entry_parser_t* p, float* val) {
-    if (!is_float(p) || p->length == 0)
-        return false;
-    *val = parse_float(p->data + p->offs + 8, p->alignIntel);
-    return true;
-}
+// TIFF fields are loaded directly and byte swapped when the file order
+// differs from the little endian order of x86, x64 and ARM64 hosts
 
-static bool parser_fetch_double(entry_parser_t* p, double* val) {
-    if (!is_rational(p) || p->length == 0)
-        return false;
-    *val = parse_rational(p->data + get_sub_ifd(p), p->alignIntel, is_signed_rational(p));
-    return true;
+static inline uint16_t exif_load16(const uint8_t* buf) {
+    uint16_t v;
+    memcpy(&v, buf, sizeof(v));
+    return v;
 }
 
-static bool parser_fetch_double_idx(entry_parser_t* p, double* val, uint32_t idx) {
-    if (!is_rational(p) || p->length <= idx)
-        return false;
-    *val = parse_rational(p->data + get_sub_ifd(p) + idx * 8, p->alignIntel, is_signed_rational(p));
-    return true;
+static inline uint32_t exif_load32(const uint8_t* buf) {
+    uint32_t v;
+    memcpy(&v, buf, sizeof(v));
+    return v;
 }
 
-static bool parser_fetch_float_as_doble(entry_parser_t* p, double* val) {
-    float _val;
-    if (!parser_fetch_float(p, &_val))
-        return false;
-    *val = _val;
-    return true;
-}
+#ifdef _MSC_VER
+#define exif_bswap16(v) _byteswap_ushort(v)
+#define exif_bswap32(v) _byteswap_ulong(v)
+#else
+#define exif_bswap16(v) __builtin_bswap16(v)
+#define exif_bswap32(v) __builtin_bswap32(v)
+#endif
 
 static int parse_xmp_xml(exif_info_t* ei, const char* xml, uint32_t len);
+static uint32_t xmp_motion_offset(const char* xml, uint32_t bytes, uint32_t* length);
 
 static int parse_xmp(exif_info_t* ei, const char* buf, unsigned len) {
 	unsigned offs = 29; // current offset into buffer
@@ -511,371 +381,6 @@ static int parse_xmp(exif_info_t* ei, const char* buf, unsigned len) {
     }
 }
 
-// Parse tag as MakerNote IFD
-static void exif_parse_ifd_maker_note(entry_parser_t* p) {
-    const uint32_t startOff = p->offs;
-    const uint32_t off = get_sub_ifd(p);
-    if (0 != strcasecmp(p->info->Make, "DJI"))
-        return;
-    int num_entries = parse16(p->data + p->offs, p->alignIntel);
-    if ((uint32_t)(2 + 12 * num_entries) > p->length)
-        return;
-    parser_init(p, off+2);
-    parse_tag(p);
-    --num_entries;
-    exif_str_t maker = null;
-    if (p->tag == 1 && parser_fetch_str(p, &maker)) {
-        if (0 == strcasecmp(maker, "DJI")) {
-            while (--num_entries >= 0) {
-                parse_tag(p);
-                switch (p->tag) {
-                    case 3:
-                        // SpeedX
-                        parser_fetch_float_as_doble(p, &p->info->GeoLocation.SpeedX);
-                        break;
-                    case 4:
-                        // SpeedY
-                        parser_fetch_float_as_doble(p, &p->info->GeoLocation.SpeedY);
-                        break;
-                    case 5:
-                        // SpeedZ
-                        parser_fetch_float_as_doble(p, &p->info->GeoLocation.SpeedZ);
-                        break;
-                    case 9:
-                        // Camera Pitch
-                        parser_fetch_float_as_doble(p, &p->info->GeoLocation.PitchDegree);
-                        break;
-                    case 10:
-                        // Camera Yaw
-                        parser_fetch_float_as_doble(p, &p->info->GeoLocation.YawDegree);
-                        break;
-                    case 11:
-                        // Camera Roll
-                        parser_fetch_float_as_doble(p, &p->info->GeoLocation.RollDegree);
-                        break;
-                }
-            }
-        }
-    }
-    parser_init(p, startOff+12);
-}
-
-// Parse tag as GPS IFD
-static void exif_parse_ifd_gps(entry_parser_t* p) {
-    switch (p->tag) {
-        case 1:
-            // GPS north or south
-            parser_fetch8(p, &p->info->GeoLocation.LatComponents.direction);
-            break;
-        case 2:
-            // GPS latitude
-            if (is_rational(p) && p->length == 3) {
-                parser_fetch_double_idx(p, &p->info->GeoLocation.LatComponents.degrees, 0);
-                parser_fetch_double_idx(p, &p->info->GeoLocation.LatComponents.minutes, 1);
-                parser_fetch_double_idx(p, &p->info->GeoLocation.LatComponents.seconds, 2);
-            }
-            break;
-        case 3:
-            // GPS east or west
-            parser_fetch8(p, &p->info->GeoLocation.LonComponents.direction);
-            break;
-        case 4:
-            // GPS longitude
-            if (is_rational(p) && p->length == 3) {
-                parser_fetch_double_idx(p, &p->info->GeoLocation.LonComponents.degrees, 0);
-                parser_fetch_double_idx(p, &p->info->GeoLocation.LonComponents.minutes, 1);
-                parser_fetch_double_idx(p, &p->info->GeoLocation.LonComponents.seconds, 2);
-            }
-            break;
-        case 5: {
-            // GPS altitude reference (below or above sea level)
-            uint8_t altitude = 0;
-            parser_fetch8(p, &altitude);
-            p->info->GeoLocation.AltitudeRef = altitude;
-            break;
-        }
-        case 6:
-            // GPS altitude
-            parser_fetch_double(p, &p->info->GeoLocation.Altitude);
-            break;
-        case 7:
-            // GPS timestamp
-            if (is_rational(p) && p->length == 3) {
-                double h = 0, m = 0, s = 0;
-                parser_fetch_double_idx(p, &h, 0);
-                parser_fetch_double_idx(p, &m, 1);
-                parser_fetch_double_idx(p, &s, 2);
-                char buffer[256];
-                snprintf(buffer, 256, "%g %g %g", h, m, s);
-                p->info->GeoLocation.GPSTimeStamp = buffer;
-            }
-            break;
-        case 11:
-            // Indicates the GPS DOP (data degree of precision)
-            parser_fetch_double(p, &p->info->GeoLocation.GPSDOP);
-            break;
-        case 18:
-            // GPS geodetic survey data
-            parser_fetch_str(p, &p->info->GeoLocation.GPSMapDatum);
-            break;
-        case 29:
-            // GPS date-stamp
-            parser_fetch_str(p, &p->info->GeoLocation.GPSDateStamp);
-            break;
-        case 30:
-            // GPS differential indicates whether differential correction is applied to the GPS receiver
-            parser_fetch16(p, &p->info->GeoLocation.GPSDifferential);
-            break;
-    }
-}
-
-// Parse tag as Exif IFD
-static void exif_parse_ifd(entry_parser_t* p) {
-    switch (p->tag) {
-        case 0x02bc:
-            p->info->has_xmp = true;
-    		// XMP Metadata (Adobe technote 9-14-02)
-		    if (is_undefined(p)) {
-			    exif_str_t xml = null;
-                parser_fetch_str(p, &xml);
-			    parse_xmp_xml(p->info, xml, (uint32_t)strlen(xml));
-		    }
-            break;
-        case TAG_EXPOSURETIME: // Exposure time in seconds
-            parser_fetch_double(p, &p->info->ExposureTime);
-            break;
-        case TAG_FNUMBER:
-            parser_fetch_double(p, &p->info->FNumber);
-            break;
-        case TAG_EXPOSURE_PROGRAM:
-            parser_fetch16(p, &p->info->ExposureProgram);
-            break;
-        case TAG_ISOSPEED:
-            parser_fetch16(p, &p->info->ISOSpeedRatings);
-            break;
-        case TAG_DATE_TIME_ORIGINAL:
-            parser_fetch_str(p, &p->info->DateTimeOriginal);
-            break;
-        case TAG_DATE_TIME_DIGITIZED:
-            parser_fetch_str(p, &p->info->DateTimeDigitized);
-            break;
-        case TAG_SHUTTERSPEED:
-            parser_fetch_double(p, &p->info->ShutterSpeedValue);
-            p->info->ShutterSpeedValue = 1.0/exp(p->info->ShutterSpeedValue * log(2));
-            break;
-        case TAG_APERTURE:
-            parser_fetch_double(p, &p->info->ApertureValue);
-            p->info->ApertureValue = exp(p->info->ApertureValue * log(2) * 0.5);
-            break;
-        case TAG_BRIGHTNESS_VALUE:
-            parser_fetch_double(p, &p->info->BrightnessValue);
-            break;
-        case TAG_EXPOSURE_BIAS_VALUE:
-            parser_fetch_double(p, &p->info->ExposureBiasValue);
-            break;
-        case TAG_SUBJECT_DISTANCE:
-            parser_fetch_double(p, &p->info->SubjectDistance);
-            break;
-        case TAG_METRIC_MODULE:
-            parser_fetch16(p, &p->info->MeteringMode);
-            break;
-        case TAG_LIGHT_SOURCE:
-            parser_fetch16(p, &p->info->LightSource);
-            break;
-        case TAG_FLASH:
-            parser_fetch16(p, &p->info->Flash);
-            break;
-        case TAG_FOCAL_LENGTH:
-            parser_fetch_double(p, &p->info->FocalLength);
-            break;
-        case TAG_SUBJECT_AREA:
-            if (is_short(p) && p->length > 1) {
-                p->info->SubjectAreas = (uint16_t)p->length;
-                for (uint32_t i = 0; i < p->info->SubjectAreas; i++)
-                    parser_fetch16_idx(p, &p->info->SubjectArea[i], i);
-            }
-            break;
-        case TAG_MAKER_NOTE:
-            exif_parse_ifd_maker_note(p);
-            break;
-        case TAG_USERCOMMENT:
-            parser_fetch_str(p, &p->info->ImageDescription);
-            break;
-        case TAG_SUB_SEC_TIME_ORIGINAL:
-            // Fractions of seconds for DateTimeOriginal
-            parser_fetch_str(p, &p->info->SubSecTimeOriginal);
-            break;
-        case TAG_COMP_IMAGE_WIDTH: // only for compressed images
-            if (!parser_fetch32(p, &p->info->ImageWidth)) {
-                uint16_t _ImageWidth;
-                if (parser_fetch16(p, &_ImageWidth))
-                    p->info->ImageWidth = _ImageWidth;
-            }
-            break;
-        case TAG_COMP_IMAGE_HEIGHT:
-            if (!parser_fetch32(p, &p->info->ImageHeight)) {
-                uint16_t _ImageHeight;
-                if (parser_fetch16(p, &_ImageHeight))
-                    p->info->ImageHeight = _ImageHeight;
-            }
-            break;
-        case TAG_FOCALPLANE_X_RES:
-            parser_fetch_double(p, &p->info->LensInfo.FocalPlaneXResolution);
-            break;
-        case TAG_FOCALPLANE_Y_RES:
-            parser_fetch_double(p, &p->info->LensInfo.FocalPlaneYResolution);
-            break;
-        case TAG_FOCALPLANE_RESOLUTION_UNIT:
-            parser_fetch16(p, &p->info->LensInfo.FocalPlaneResolutionUnit);
-            break;
-        case TAG_EXPOSURE_INDEX:
-            // Exposure Index and ISO Speed Rating are often used interchangeably
-            if (p->info->ISOSpeedRatings == 0) {
-                double ExposureIndex;
-                if (parser_fetch_double(p, &ExposureIndex))
-                    p->info->ISOSpeedRatings = (uint16_t)ExposureIndex;
-            }
-            break;
-        case TAG_DIGITAL_ZOOM_RATIO:
-            // Digital Zoom Ratio
-            parser_fetch_double(p, &p->info->LensInfo.DigitalZoomRatio);
-            break;
-        case TAG_FOCAL_LENGTH_IN_35_MM_FILM:
-            if (!parser_fetch_double(p, &p->info->LensInfo.FocalLengthIn35mm)) {
-                uint16_t _FocalLengthIn35mm;
-                if (parser_fetch16(p, &_FocalLengthIn35mm))
-                    p->info->LensInfo.FocalLengthIn35mm = (double)_FocalLengthIn35mm;
-            }
-            break;
-        case 0xa431:
-            // Serial number of the camera
-            parser_fetch_str(p, &p->info->SerialNumber);
-            break;
-        case 0xa432:
-            // Focal length and FStop.
-            if (parser_fetch_double_idx(p, &p->info->LensInfo.FocalLengthMin, 0))
-                if (parser_fetch_double_idx(p, &p->info->LensInfo.FocalLengthMax, 1))
-                    if (parser_fetch_double_idx(p, &p->info->LensInfo.FStopMin, 2))
-                        parser_fetch_double_idx(p, &p->info->LensInfo.FStopMax, 3);
-            break;
-        case 0xa433:
-            // Lens make.
-            parser_fetch_str(p, &p->info->LensInfo.Make);
-            break;
-        case 0xa434:
-            // Lens model.
-            parser_fetch_str(p, &p->info->LensInfo.Model);
-            break;
-        case TAG_ARTIST:
-            parser_fetch_str(p, &p->info->Artist);
-            break;
-        case TAG_EXIFVERSION:
-            parser_fetch32(p, &p->info->ExifVersion);
-            break;
-        case TAG_MAX_APERTURE:
-            parser_fetch_double(p, &p->info->MaxAperture);
-            break;
-        case TAG_COLOR_SPACE:
-            parser_fetch16(p, &p->info->ColorSpace);
-            break;
-        case TAG_SENSING_METHOD: // short
-            parser_fetch16(p, &p->info->SensingMethod);
-            break;
-        case TAG_SCENE_TYPE:
-            parser_fetch16(p, &p->info->SceneType);
-            break;
-        case TAG_EXPOSURE_MODE:
-            parser_fetch16(p, &p->info->ExposureMode);
-            break;
-        case TAG_WHITE_BALANCE:
-            parser_fetch16(p, &p->info->WhiteBalance);
-            break;
-        case TAG_SCENE_CAPTURE_TYPE:
-            parser_fetch16(p, &p->info->CaptureType);
-            break;
-        case TAG_YCC_POSITIONING:
-            parser_fetch16(p, &p->info->YCCPositioning);
-            break;
-        case TAG_OFFSET_TIME_ORIGINAL:
-            parser_fetch_str(p, &p->info->OffsetTimeOriginal);
-            break;
-        case TAG_COMPONENT_CONFIG:
-            parser_fetch16(p, &p->info->ComponentConfig);
-            break;
-        case TAG_FLASH_PIX_VERSION:
-            parser_fetch32(p, &p->info->FlashPixVersion);
-            break;
-        default:
-            traceln("skip: 0x%04X", p->tag);
-    }
-}
-
-// Parse tag as Image IFD
-static void exif_parse_ifd_image(entry_parser_t* p,
-        uint32_t* exif_sub_ifd_offset, uint32_t* gps_sub_ifd_offset) {
-    switch (p->tag) {
-        case TAG_BITS_PER_SAMPLE:
-            parser_fetch16(p, &p->info->BitsPerSample);
-            break;
-        case TAG_IMAGE_DESCRIPTION:
-            parser_fetch_str(p, &p->info->ImageDescription);
-            break;
-        case TAG_MAKE: // Camera maker
-            parser_fetch_str(p, &p->info->Make);
-            break;
-        case TAG_MODEL: // Camera model
-            parser_fetch_str(p, &p->info->Model);
-            break;
-        case TAG_ORIENTATION: // Orientation of image
-            parser_fetch16(p, &p->info->Orientation);
-            break;
-        case TAG_X_RESOLUTION:
-            parser_fetch_double(p, &p->info->XResolution);
-            break;
-        case TAG_Y_RESOLUTION:
-            parser_fetch_double(p, &p->info->YResolution);
-            break;
-        case TAG_RESOLUTION_UNIT:
-            parser_fetch16(p, &p->info->ResolutionUnit);
-            break;
-        case TAG_SOFTWARE:
-            parser_fetch_str(p, &p->info->Software);
-            break;
-        case TAG_DATETIME: // EXIF/TIFF date/time of image modification
-            // "YYYY:MM:DD HH:MM:SS" 20 (0x14) bytes
-            parser_fetch_str(p, &p->info->DateTime);
-            break;
-        case 0x1001:
-            // Original Image width
-            if (!parser_fetch32(p, &p->info->RelatedImageWidth)) {
-                uint16_t _RelatedImageWidth;
-                if (parser_fetch16(p, &_RelatedImageWidth))
-                    p->info->RelatedImageWidth = _RelatedImageWidth;
-            }
-            break;
-        case 0x1002:
-            // Original Image height
-            if (!parser_fetch32(p, &p->info->RelatedImageHeight)) {
-                uint16_t _RelatedImageHeight;
-                if (parser_fetch16(p, &_RelatedImageHeight))
-                    p->info->RelatedImageHeight = _RelatedImageHeight;
-            }
-            break;
-        case TAG_COPYRIGHT:
-            parser_fetch_str(p, &p->info->Copyright);
-            break;
-        case TAG_EXIF_IFD_POINTER: // EXIF SubIFD offset
-            *exif_sub_ifd_offset = get_sub_ifd(p);
-            break;
-        case TAG_GPS_IFD_POINTER: // GPS IFS offset
-            *gps_sub_ifd_offset = get_sub_ifd(p);
-            break;
-        default: // Try to parse as EXIF IFD tag, as some images store them in here
-            exif_parse_ifd(p);
-            break;
-    }
-}
-
 static void geolocation_parse_coords(exif_info_t* ei) {
     // Convert GPS latitude
     ei->GeoLocation.LatComponents;
@@ -908,6 +413,13 @@ static void geolocation_parse_coords(exif_info_t* ei) {
 }
 
 
+#define EXIF_INTEL 1
+#include "tiny_exif_ifd.h"
+#undef EXIF_INTEL
+#define EXIF_INTEL 0
+#include "tiny_exif_ifd.h"
+#undef EXIF_INTEL
+
 // Main parsing function for an EXIF segment.
 // Do a sanity check by looking for bytes "Exif\0\0".
 // The marker has to contain at least the TIFF header, otherwise the
@@ -954,63 +466,17 @@ static int exif_parse_from_segment(exif_info_t* ei, const uint8_t* data, uint32_
     p.data = data;
     p.bytes = bytes;
     p.tiff_header_start = offs;
-    p.alignIntel = alignIntel;
     offs += 2;
-    if (0x2a != parse16(data + offs, alignIntel))
+    if (0x2a != (alignIntel ? parse16_intel(data + offs) : parse16_motorola(data + offs)))
         return EXIF_PARSE_CORRUPT_DATA;
     offs += 2;
-    const uint32_t first_ifd_offset = parse32(data + offs, alignIntel);
+    const uint32_t first_ifd_offset = alignIntel ?
+        parse32_intel(data + offs) : parse32_motorola(data + offs);
     offs += first_ifd_offset - 4;
     if (offs >= bytes)
         return EXIF_PARSE_CORRUPT_DATA;
-    // Now parsing the first Image File Directory (IFD0, for the main image).
-    // An IFD consists of a variable number of 12-byte directory entries. The
-    // first two bytes of the IFD section contain the number of directory
-    // entries in the section. The last 4 bytes of the IFD contain an offset
-    // to the next IFD, which means this IFD must contain exactly 6 + 12 * num
-    // bytes of data.
-    if (offs + 2 > bytes)
-        return EXIF_PARSE_CORRUPT_DATA;
-    int num_entries = parse16(data + offs, alignIntel);
-    if (offs + 6 + 12 * num_entries > bytes)
-        return EXIF_PARSE_CORRUPT_DATA;
-    uint32_t exif_sub_ifd_offset = bytes;
-    uint32_t gps_sub_ifd_offset  = bytes;
-    parser_init(&p, offs + 2);
-    while (--num_entries >= 0) {
-        parse_tag(&p);
-        exif_parse_ifd_image(&p, &exif_sub_ifd_offset, &gps_sub_ifd_offset);
-    }
-    // Jump to the EXIF SubIFD if it exists and parse all the information
-    // there. Note that it's possible that the EXIF SubIFD doesn't exist.
-    // The EXIF SubIFD contains most of the interesting information that a
-    // typical user might want.
-    if (exif_sub_ifd_offset + 4 <= bytes) {
-        offs = exif_sub_ifd_offset;
-        num_entries = parse16(data + offs, alignIntel);
-        if (offs + 6 + 12 * num_entries > bytes)
-            return EXIF_PARSE_CORRUPT_DATA;
-        parser_init(&p, offs + 2);
-        while (--num_entries >= 0) {
-            parse_tag(&p);
-            exif_parse_ifd(&p);
-        }
-    }
-    // Jump to the GPS SubIFD if it exists and parse all the information
-    // there. Note that it's possible that the GPS SubIFD doesn't exist.
-    if (gps_sub_ifd_offset + 4 <= bytes) {
-        offs = gps_sub_ifd_offset;
-        num_entries = parse16(data + offs, alignIntel);
-        if (offs + 6 + 12 * num_entries > bytes)
-            return EXIF_PARSE_CORRUPT_DATA;
-        parser_init(&p, offs + 2);
-        while (--num_entries >= 0) {
-            parse_tag(&p);
-            exif_parse_ifd_gps(&p);
-        }
-        geolocation_parse_coords(ei);
-    }
-    return EXIF_PARSE_SUCCESS;
+    // the rest of the segment is walked by the byte order specialized code
+    return alignIntel ? exif_parse_ifds_intel(&p, offs) : exif_parse_ifds_motorola(&p, offs);
 }
 
 // Set all data members to default values.
@@ -1019,6 +485,9 @@ static int exif_parse_from_segment(exif_info_t* ei, const uint8_t* data, uint32_
 void exif_clear(exif_info_t* ei) {
     ei->Fields = EXIF_FIELD_NA;
     ei->next = ei->strings;
+    ei->has_app1 = false;
+    ei->has_xmp = false;
+    ei->has_mpf = false;
     // Strings
     ei->ImageDescription  = "";
     ei->Make              = "";
@@ -1035,6 +504,8 @@ void exif_clear(exif_info_t* ei) {
     ei->ImageHeight       = 0;
     ei->RelatedImageWidth = 0;
     ei->RelatedImageHeight= 0;
+    ei->Thumbnail         = null;
+    ei->ThumbnailBytes    = 0;
     ei->Orientation       = 0;
     ei->XResolution       = 0;
     ei->YResolution       = 0;
@@ -1160,7 +631,7 @@ int exif_parse_from_stream(exif_info_t* ei, exif_stream_t* stream) {
                 if (buf == null) {
                     return apps1 & EXIF_FIELD_ALL ? (int)EXIF_PARSE_SUCCESS : EXIF_PARSE_INVALID_JPEG;
                 }
-                section_bytes = parse16(buf, false);
+                section_bytes = parse16_motorola(buf);
                 if (section_bytes <= 2 || (buf=stream->get(stream, section_bytes-=2)) == null)
                     return apps1 & EXIF_FIELD_ALL ? (int)EXIF_PARSE_SUCCESS : EXIF_PARSE_INVALID_JPEG;
                 ei->has_app1 = true;
@@ -1190,6 +661,16 @@ int exif_parse_from_stream(exif_info_t* ei, exif_stream_t* stream) {
                         return apps1 & EXIF_FIELD_ALL ? (int)EXIF_PARSE_SUCCESS : ret;
                 }
                 break;
+            case JM_APP2: // ICC profile or MPF index, see exif_mpf_from_jpeg()
+                buf = stream->get(stream, 2);
+                section_bytes = buf != null ? parse16_motorola(buf) : 0;
+                if (section_bytes <= 2 || (buf = stream->get(stream, section_bytes -= 2)) == null) {
+                    return apps1 & EXIF_FIELD_ALL ? (int)EXIF_PARSE_SUCCESS : EXIF_PARSE_INVALID_JPEG;
+                }
+                if (section_bytes >= 4 + 8 && memcmp(buf, "MPF\0", 4) == 0) {
+                    ei->has_mpf = true;
+                }
+                break;
             case JM_APP14:
             case JM_APP13: // IPCT
             case JM_SOF0:
@@ -1201,7 +682,7 @@ int exif_parse_from_stream(exif_info_t* ei, exif_stream_t* stream) {
                 if (!ignored) { traceln("unhandled: 0x%02X", marker); }
                 // skip the section
                 buf = stream->get(stream, 2);
-                section_bytes = buf != null ? parse16(buf, false) : 0;
+                section_bytes = buf != null ? parse16_motorola(buf) : 0;
 //              traceln("marker: 0x%02X section length: %d", marker, section_bytes);
                 if (buf == null || section_bytes <= 2 || !stream->skip(stream, section_bytes - 2)) {
                     return apps1 & EXIF_FIELD_ALL ? (int)EXIF_PARSE_SUCCESS : EXIF_PARSE_INVALID_JPEG;
@@ -1238,131 +719,6 @@ int exif_parse_from_stream(exif_info_t* ei, exif_stream_t* stream) {
 // <plus:CopyrightOwnerName>Joe Photographer</plus:CopyrightOwnerName>
 // <photoshop:History>
 
-static int parse_xmp_legacy(exif_info_t* ei, const char* xml, uint32_t len) {
-    (void)ei; (void)xml; (void)len; // TODO: remove when xml is implemented
-    // TODO: find test files with all those tags and implement them
-	// Skip xpacket end section so that tinyxml2 lib parses the section correctly.
-#ifdef TINYEXIF_LEGACY_XMP_SUPPORT // no way to test it in absence of test materials
-	const char* szEnd = Tools::strrnstr(xml, "<?xpacket end=", len);
-	if (szEnd != NULL)
-		len = (uint32_t)(szEnd - xml);
-
-	// Try parsing the XML packet.
-	tinyxml2::XMLDocument doc;
-	const tinyxml2::XMLElement* document;
-	if (doc.Parse(xml, len) != tinyxml2::XML_SUCCESS ||
-		((document=doc.FirstChildElement("x:xmpmeta")) == NULL && (document=doc.FirstChildElement("xmp:xmpmeta")) == NULL) ||
-		(document=document->FirstChildElement("rdf:RDF")) == NULL ||
-		(document=document->FirstChildElement("rdf:Description")) == NULL)
-		return PARSE_ABSENT_DATA;
-
-	// Try parsing the XMP content for tiff details.
-	if (Orientation == 0) {
-		uint32_t _Orientation(0);
-		document->QueryUnsignedAttribute("tiff:Orientation", &_Orientation);
-		Orientation = (uint16_t)_Orientation;
-	}
-	if (ImageWidth == 0 && ImageHeight == 0) {
-		document->QueryUnsignedAttribute("tiff:ImageWidth", &ImageWidth);
-		if (document->QueryUnsignedAttribute("tiff:ImageHeight", &ImageHeight) != tinyxml2::XML_SUCCESS)
-			document->QueryUnsignedAttribute("tiff:ImageLength", &ImageHeight) ;
-	}
-	if (XResolution == 0 && YResolution == 0 && ResolutionUnit == 0) {
-		document->QueryDoubleAttribute("tiff:XResolution", &XResolution);
-		document->QueryDoubleAttribute("tiff:YResolution", &YResolution);
-		uint32_t _ResolutionUnit(0);
-		document->QueryUnsignedAttribute("tiff:ResolutionUnit", &_ResolutionUnit);
-		ResolutionUnit = (uint16_t)_ResolutionUnit;
-	}
-	// Try parsing the XMP content for projection type.
-	{
-	    const tinyxml2::XMLElement* const element(document->FirstChildElement("GPano:ProjectionType"));
-	    if (element != NULL) {
-		    const char* const szProjectionType(element->GetText());
-		    if (szProjectionType != NULL) {
-			    if (0 == strcasecmp(szProjectionType, "perspective"))
-				    ProjectionType = 1;
-			    else
-			    if (0 == strcasecmp(szProjectionType, "equirectangular") ||
-				    0 == strcasecmp(szProjectionType, "spherical"))
-				    ProjectionType = 2;
-		    }
-	    }
-	}
-	// Try parsing the XMP content for supported maker's info.
-	struct ParseXMP	{
-		// try yo fetch the value both from the attribute and child element
-		// and parse if needed rational numbers stored as string fraction
-		static bool Value(const tinyxml2::XMLElement* document, const char* name, double& value) {
-			const char* szAttribute = document->Attribute(name);
-			if (szAttribute == NULL) {
-				const tinyxml2::XMLElement* const element(document->FirstChildElement(name));
-				if (element == NULL || (szAttribute=element->GetText()) == NULL)
-					return false;
-			}
-			std::vector<std::string> values;
-			Tools::strSplit(szAttribute, '/', values);
-			switch (values.size()) {
-			case 1: value = strtod(values.front().c_str(), NULL); return true;
-			case 2: value = strtod(values.front().c_str(), NULL)/strtod(values.back().c_str(), NULL); return true;
-			}
-			return false;
-		}
-		// same as previous function but with unsigned int results
-		static bool Value(const tinyxml2::XMLElement* document, const char* name, uint32_t& value) {
-			const char* szAttribute = document->Attribute(name);
-			if (szAttribute == NULL) {
-				const tinyxml2::XMLElement* const element(document->FirstChildElement(name));
-				if (element == NULL || (szAttribute = element->GetText()) == NULL)
-					return false;
-			}
-			value = strtoul(szAttribute, NULL, 0); return true;
-			return false;
-		}
-	};
-	const char* szAbout(document->Attribute("rdf:about"));
-	if (0 == strcasecmp(Make.c_str(), "DJI") || (szAbout != NULL && 0 == strcasecmp(szAbout, "DJI Meta Data"))) {
-		ParseXMP::Value(document, "drone-dji:AbsoluteAltitude", GeoLocation.Altitude);
-		ParseXMP::Value(document, "drone-dji:RelativeAltitude", GeoLocation.RelativeAltitude);
-		ParseXMP::Value(document, "drone-dji:GimbalRollDegree", GeoLocation.RollDegree);
-		ParseXMP::Value(document, "drone-dji:GimbalPitchDegree", GeoLocation.PitchDegree);
-		ParseXMP::Value(document, "drone-dji:GimbalYawDegree", GeoLocation.YawDegree);
-		ParseXMP::Value(document, "drone-dji:CalibratedFocalLength", Calibration.FocalLength);
-		ParseXMP::Value(document, "drone-dji:CalibratedOpticalCenterX", Calibration.OpticalCenterX);
-		ParseXMP::Value(document, "drone-dji:CalibratedOpticalCenterY", Calibration.OpticalCenterY);
-	} else if (0 == strcasecmp(Make.c_str(), "senseFly") || 0 == strcasecmp(Make.c_str(), "Sentera")) {
-		ParseXMP::Value(document, "Camera:Roll", GeoLocation.RollDegree);
-		if (ParseXMP::Value(document, "Camera:Pitch", GeoLocation.PitchDegree)) {
-			// convert to DJI format: senseFly uses pitch 0 as NADIR, whereas DJI -90
-			GeoLocation.PitchDegree = Tools::NormD180(GeoLocation.PitchDegree-90.0);
-		}
-		ParseXMP::Value(document, "Camera:Yaw", GeoLocation.YawDegree);
-		ParseXMP::Value(document, "Camera:GPSXYAccuracy", GeoLocation.AccuracyXY);
-		ParseXMP::Value(document, "Camera:GPSZAccuracy", GeoLocation.AccuracyZ);
-	} else if (0 == strcasecmp(Make.c_str(), "PARROT")) {
-		ParseXMP::Value(document, "Camera:Roll", GeoLocation.RollDegree) ||
-		ParseXMP::Value(document, "drone-parrot:CameraRollDegree", GeoLocation.RollDegree);
-		if (ParseXMP::Value(document, "Camera:Pitch", GeoLocation.PitchDegree) ||
-			ParseXMP::Value(document, "drone-parrot:CameraPitchDegree", GeoLocation.PitchDegree)) {
-			// convert to DJI format: senseFly uses pitch 0 as NADIR, whereas DJI -90
-			GeoLocation.PitchDegree = Tools::NormD180(GeoLocation.PitchDegree-90.0);
-		}
-		ParseXMP::Value(document, "Camera:Yaw", GeoLocation.YawDegree) ||
-		ParseXMP::Value(document, "drone-parrot:CameraYawDegree", GeoLocation.YawDegree);
-		ParseXMP::Value(document, "Camera:AboveGroundAltitude", GeoLocation.RelativeAltitude);
-	}
-	ParseXMP::Value(document, "GPano:PosePitchDegrees", GPano.PosePitchDegrees);
-	ParseXMP::Value(document, "GPano:PoseRollDegrees", GPano.PoseRollDegrees);
-	// parse GCamera:MicroVideo
-	if (document->Attribute("GCamera:MicroVideo")) {
-		ParseXMP::Value(document, "GCamera:MicroVideo", MicroVideo.HasMicroVideo);
-		ParseXMP::Value(document, "GCamera:MicroVideoVersion", MicroVideo.MicroVideoVersion);
-		ParseXMP::Value(document, "GCamera:MicroVideoOffset", MicroVideo.MicroVideoOffset);
-	}
-#endif
-	return EXIF_PARSE_SUCCESS;
-}
-
 typedef struct xml_npv_s {
     const char* n;
     const char**v;
@@ -1393,7 +749,8 @@ typedef struct xml_context_s {
     int32_t top;
     xml_npv_t* npv;
     int32_t npv_count;
-    int32_t index;
+    int32_t index; // npv[] element content is captured into or -1
+    int32_t attr;  // npv[] attribute value is captured into or -1
 } xml_context_t;
 
 static const char* yxml_parent(xml_context_t* ctx, int up) {
@@ -1486,16 +843,68 @@ static void yxml_element_end(yxml_t* x) {
     }
 }
 
+// Simple properties are often written as attributes of rdf:Description
+// (or of rdf:li for structures) instead of elements:
+// <rdf:Description xmp:Rating="3" GCamera:MicroVideoOffset="2712001">
+// Attribute names are matched against the same npv[] table with the
+// parent (if any) searched from the element owning the attribute up.
+// Containers (append) cannot be attributes.
+
+static void yxml_attr_start(yxml_t* x) {
+    xml_context_t* ctx = (xml_context_t*)x;
+    assert(ctx->attr < 0);
+    for (int i = 0; i < ctx->npv_count && ctx->attr < 0 && !ctx->ei->not_enough_memory; i++) {
+        if (!ctx->npv[i].append && yxml_strequ(x->attr, ctx->npv[i].n)) {
+            const char* parent = ctx->npv[i].p;
+            bool has_parent = parent == null;
+            for (int p = ctx->top - 1; p >= 0 && !has_parent; p--) {
+                has_parent = yxml_strequ(ctx->stack[p], parent);
+            }
+            if (has_parent) {
+                if (ctx->ei->next + 2 >= ctx->ei->strings + countof(ctx->ei->strings)) {
+                    ctx->ei->not_enough_memory = true;
+                } else {
+                    ctx->ei->next++; // same layout as element content
+                    ctx->ei->next[0] = 0;
+                    *ctx->npv[i].v = ctx->ei->next;
+                    ctx->attr = i;
+                }
+            }
+        }
+    }
+}
+
+static void yxml_attr_value(yxml_t* x) {
+    xml_context_t* ctx = (xml_context_t*)x;
+    if (ctx->attr >= 0 && !ctx->ei->not_enough_memory) {
+        const int64_t k = strlen(x->data); // single UTF-8 character
+        if (ctx->ei->next + k + 2 >= ctx->ei->strings + countof(ctx->ei->strings)) {
+            ctx->ei->not_enough_memory = true;
+        } else {
+            memcpy(ctx->ei->next, x->data, k + 1); // including terminating zero byte
+            ctx->ei->next += k;
+        }
+    }
+}
+
+static void yxml_attr_end(yxml_t* x) {
+    xml_context_t* ctx = (xml_context_t*)x;
+    if (ctx->attr >= 0 && !ctx->ei->not_enough_memory) {
+        ctx->ei->next++; // double zero byte termination
+    }
+    ctx->attr = -1;
+}
+
 static void yxml_xmp(yxml_t* x, yxml_ret_t r) {
 	switch(r) {
 	    case YXML_ELEMSTART: yxml_element_start(x); break;
 	    case YXML_CONTENT  : yxml_content(x);       break;
 	    case YXML_ELEMEND  : yxml_element_end(x);   break;
+	    case YXML_ATTRSTART: yxml_attr_start(x);    break;
+	    case YXML_ATTRVAL  : yxml_attr_value(x);    break;
+	    case YXML_ATTREND  : yxml_attr_end(x);      break;
         // ignored:
-	    case YXML_ATTRSTART:
-	    case YXML_ATTREND:
 	    case YXML_PICONTENT:
-	    case YXML_ATTRVAL:
 	    case YXML_PISTART:
 	    case YXML_PIEND:
 	    case YXML_OK:
@@ -1620,10 +1029,125 @@ static void dump_exif_xmp(exif_info_t* ei) {
     dump(MetadataDate);
     dump(ModifyDate);
     dump(Rating);
+    dump(about);
+    dump(tiff.Orientation);
+    dump(tiff.ImageWidth);
+    dump(tiff.ImageHeight);
+    dump(tiff.XResolution);
+    dump(tiff.YResolution);
+    dump(tiff.ResolutionUnit);
+    dump(GPano.ProjectionType);
+    dump(GPano.PosePitchDegrees);
+    dump(GPano.PoseRollDegrees);
+    dump(GCamera.MicroVideo);
+    dump(GCamera.MicroVideoVersion);
+    dump(GCamera.MicroVideoOffset);
+    dump(GCamera.MotionPhoto);
+    dump(GCamera.MotionPhotoVersion);
+    dump(GCamera.MotionPhotoPresentationTimestampUs);
+    dump(dji.AbsoluteAltitude);
+    dump(dji.RelativeAltitude);
+    dump(dji.GimbalRollDegree);
+    dump(dji.GimbalPitchDegree);
+    dump(dji.GimbalYawDegree);
+    dump(Camera.Pitch);
+}
+
+// "1.5", "-12/10" or "+123.45" (DJI), false for empty string
+static bool xmp_number(const char* s, double* value) {
+    char* end = null;
+    double n = strtod(s, &end);
+    if (end == s) { return false; }
+    if (*end == '/') {
+        const char* d = end + 1;
+        const double denominator = strtod(d, &end);
+        if (end == d || denominator == 0) { return false; }
+        n /= denominator;
+    }
+    *value = n;
+    return true;
+}
+
+static bool xmp_uint32(const char* s, uint32_t* value) {
+    double n = 0;
+    if (!xmp_number(s, &n) || n < 0 || n > UINT32_MAX) { return false; }
+    *value = (uint32_t)n;
+    return true;
+}
+
+static double xmp_normalize_180(double degrees) { // into (-180..180]
+    degrees = fmod(degrees, 360.0);
+    return degrees > 180 ? degrees - 360 : degrees <= -180 ? degrees + 360 : degrees;
+}
+
+static bool xmp_make(exif_info_t* ei, const char* make) {
+    return ei->Make != null && strcasecmp(ei->Make, make) == 0;
+}
+
+// Numeric fields from XMP strings, EXIF IFD values take precedence.
+static void xmp_to_fields(exif_info_t* ei) {
+    uint32_t u = 0;
+    double d = 0;
+    if (ei->Orientation == 0 && xmp_uint32(ei->xmp.tiff.Orientation, &u)) {
+        ei->Orientation = (uint16_t)u;
+    }
+    if (ei->ImageWidth == 0 && ei->ImageHeight == 0) {
+        xmp_uint32(ei->xmp.tiff.ImageWidth, &ei->ImageWidth);
+        xmp_uint32(ei->xmp.tiff.ImageHeight, &ei->ImageHeight);
+    }
+    if (ei->XResolution == 0 && ei->YResolution == 0 && ei->ResolutionUnit == 0) {
+        xmp_number(ei->xmp.tiff.XResolution, &ei->XResolution);
+        xmp_number(ei->xmp.tiff.YResolution, &ei->YResolution);
+        if (xmp_uint32(ei->xmp.tiff.ResolutionUnit, &u)) { ei->ResolutionUnit = (uint16_t)u; }
+    }
+    const char* projection = ei->xmp.GPano.ProjectionType;
+    if (strcasecmp(projection, "perspective") == 0) {
+        ei->ProjectionType = 1;
+    } else if (strcasecmp(projection, "equirectangular") == 0 ||
+               strcasecmp(projection, "spherical") == 0) {
+        ei->ProjectionType = 2;
+    }
+    xmp_number(ei->xmp.GPano.PosePitchDegrees, &ei->GPano.PosePitchDegrees);
+    xmp_number(ei->xmp.GPano.PoseRollDegrees, &ei->GPano.PoseRollDegrees);
+    if (ei->xmp.GCamera.MicroVideo[0] != 0) {
+        xmp_uint32(ei->xmp.GCamera.MicroVideo, &ei->MicroVideo.HasMicroVideo);
+        xmp_uint32(ei->xmp.GCamera.MicroVideoVersion, &ei->MicroVideo.MicroVideoVersion);
+        xmp_uint32(ei->xmp.GCamera.MicroVideoOffset, &ei->MicroVideo.MicroVideoOffset);
+    }
+    struct Geolocation_t* g = &ei->GeoLocation;
+    if (xmp_make(ei, "DJI") || strcasecmp(ei->xmp.about, "DJI Meta Data") == 0) {
+        xmp_number(ei->xmp.dji.AbsoluteAltitude, &g->Altitude);
+        xmp_number(ei->xmp.dji.RelativeAltitude, &g->RelativeAltitude);
+        xmp_number(ei->xmp.dji.GimbalRollDegree, &g->RollDegree);
+        xmp_number(ei->xmp.dji.GimbalPitchDegree, &g->PitchDegree);
+        xmp_number(ei->xmp.dji.GimbalYawDegree, &g->YawDegree);
+        xmp_number(ei->xmp.dji.CalibratedFocalLength, &ei->Calibration.FocalLength);
+        xmp_number(ei->xmp.dji.CalibratedOpticalCenterX, &ei->Calibration.OpticalCenterX);
+        xmp_number(ei->xmp.dji.CalibratedOpticalCenterY, &ei->Calibration.OpticalCenterY);
+    } else if (xmp_make(ei, "senseFly") || xmp_make(ei, "Sentera")) {
+        xmp_number(ei->xmp.Camera.Roll, &g->RollDegree);
+        if (xmp_number(ei->xmp.Camera.Pitch, &d)) {
+            g->PitchDegree = xmp_normalize_180(d - 90.0); // DJI: -90 is nadir
+        }
+        xmp_number(ei->xmp.Camera.Yaw, &g->YawDegree);
+        xmp_number(ei->xmp.Camera.GPSXYAccuracy, &g->AccuracyXY);
+        xmp_number(ei->xmp.Camera.GPSZAccuracy, &g->AccuracyZ);
+    } else if (xmp_make(ei, "PARROT")) {
+        if (!xmp_number(ei->xmp.Camera.Roll, &g->RollDegree)) {
+            xmp_number(ei->xmp.parrot.CameraRollDegree, &g->RollDegree);
+        }
+        if (xmp_number(ei->xmp.Camera.Pitch, &d) ||
+            xmp_number(ei->xmp.parrot.CameraPitchDegree, &d)) {
+            g->PitchDegree = xmp_normalize_180(d - 90.0);
+        }
+        if (!xmp_number(ei->xmp.Camera.Yaw, &g->YawDegree)) {
+            xmp_number(ei->xmp.parrot.CameraYawDegree, &g->YawDegree);
+        }
+        xmp_number(ei->xmp.Camera.AboveGroundAltitude, &g->RelativeAltitude);
+    }
 }
 
 static int parse_xmp_xml(exif_info_t* ei, const char* xml, uint32_t bytes) {
-    parse_xmp_legacy(ei, xml, bytes);
     xml_context_t context = {0};
     context.ei = ei;
     char xml_stack[8 * 1024]; // the xml_stack size is determined by the longest tag in depth...
@@ -1736,6 +1260,46 @@ static int parse_xmp_xml(exif_info_t* ei, const char* xml, uint32_t bytes) {
         { "xmp:ModifyDate"          , &ei->xmp.ModifyDate },
         { "xmp:Rating"              , &ei->xmp.Rating },
 
+        { "rdf:about"               , &ei->xmp.about },
+        { "tiff:Orientation"        , &ei->xmp.tiff.Orientation },
+        { "tiff:ImageWidth"         , &ei->xmp.tiff.ImageWidth },
+        { "tiff:ImageHeight"        , &ei->xmp.tiff.ImageHeight },
+        { "tiff:ImageLength"        , &ei->xmp.tiff.ImageHeight },
+        { "tiff:XResolution"        , &ei->xmp.tiff.XResolution },
+        { "tiff:YResolution"        , &ei->xmp.tiff.YResolution },
+        { "tiff:ResolutionUnit"     , &ei->xmp.tiff.ResolutionUnit },
+
+        { "GPano:ProjectionType"    , &ei->xmp.GPano.ProjectionType },
+        { "GPano:PosePitchDegrees"  , &ei->xmp.GPano.PosePitchDegrees },
+        { "GPano:PoseRollDegrees"   , &ei->xmp.GPano.PoseRollDegrees },
+
+        { "GCamera:MicroVideo"          , &ei->xmp.GCamera.MicroVideo },
+        { "GCamera:MicroVideoVersion"   , &ei->xmp.GCamera.MicroVideoVersion },
+        { "GCamera:MicroVideoOffset"    , &ei->xmp.GCamera.MicroVideoOffset },
+        { "GCamera:MotionPhoto"         , &ei->xmp.GCamera.MotionPhoto },
+        { "GCamera:MotionPhotoVersion"  , &ei->xmp.GCamera.MotionPhotoVersion },
+        { "GCamera:MotionPhotoPresentationTimestampUs", &ei->xmp.GCamera.MotionPhotoPresentationTimestampUs },
+
+        { "drone-dji:AbsoluteAltitude"          , &ei->xmp.dji.AbsoluteAltitude },
+        { "drone-dji:RelativeAltitude"          , &ei->xmp.dji.RelativeAltitude },
+        { "drone-dji:GimbalRollDegree"          , &ei->xmp.dji.GimbalRollDegree },
+        { "drone-dji:GimbalPitchDegree"         , &ei->xmp.dji.GimbalPitchDegree },
+        { "drone-dji:GimbalYawDegree"           , &ei->xmp.dji.GimbalYawDegree },
+        { "drone-dji:CalibratedFocalLength"     , &ei->xmp.dji.CalibratedFocalLength },
+        { "drone-dji:CalibratedOpticalCenterX"  , &ei->xmp.dji.CalibratedOpticalCenterX },
+        { "drone-dji:CalibratedOpticalCenterY"  , &ei->xmp.dji.CalibratedOpticalCenterY },
+
+        { "Camera:Roll"                 , &ei->xmp.Camera.Roll },
+        { "Camera:Pitch"                , &ei->xmp.Camera.Pitch },
+        { "Camera:Yaw"                  , &ei->xmp.Camera.Yaw },
+        { "Camera:GPSXYAccuracy"        , &ei->xmp.Camera.GPSXYAccuracy },
+        { "Camera:GPSZAccuracy"         , &ei->xmp.Camera.GPSZAccuracy },
+        { "Camera:AboveGroundAltitude"  , &ei->xmp.Camera.AboveGroundAltitude },
+
+        { "drone-parrot:CameraRollDegree"   , &ei->xmp.parrot.CameraRollDegree },
+        { "drone-parrot:CameraPitchDegree"  , &ei->xmp.parrot.CameraPitchDegree },
+        { "drone-parrot:CameraYawDegree"    , &ei->xmp.parrot.CameraYawDegree },
+
         // for disambiguation non-parented items must apprear last in the list
         { "Iptc4xmpExt:AOCopyrightNotice"           , &ei->xmp.Iptc4xmpExt.AOCopyrightNotice },
         { "Iptc4xmpExt:AOCreator"                   , &ei->xmp.Iptc4xmpExt.AOCreator         },
@@ -1747,6 +1311,7 @@ static int parse_xmp_xml(exif_info_t* ei, const char* xml, uint32_t bytes) {
     context.npv = npv;
     context.npv_count = countof(npv);
     context.index = -1;
+    context.attr = -1;
     yxml_ret_t r = YXML_OK;
     context.ei->not_enough_memory = false;
     for (uint32_t i = 0; i < bytes && !context.ei->not_enough_memory; i++) {
@@ -1764,6 +1329,18 @@ static int parse_xmp_xml(exif_info_t* ei, const char* xml, uint32_t bytes) {
             // much easier for the clients to handle
         }
     }
+    xmp_to_fields(ei);
+    // Motion Photo 1.0 replaced MicroVideoOffset with Container:Directory
+    // that attributes cannot express: walked only when the photo says so
+    if (ei->MicroVideo.HasMicroVideo == 0 && ei->xmp.GCamera.MotionPhoto[0] == '1') {
+        uint32_t length = 0;
+        const uint32_t offset = xmp_motion_offset(xml, bytes, &length);
+        if (offset > 0) {
+            ei->MicroVideo.HasMicroVideo = 1;
+            xmp_uint32(ei->xmp.GCamera.MotionPhotoVersion, &ei->MicroVideo.MicroVideoVersion);
+            ei->MicroVideo.MicroVideoOffset = offset;
+        }
+    }
     if (ei->dump) {
         dump_exif_xmp(ei);
     }
@@ -1808,3 +1385,399 @@ int exif_from_memory(exif_info_t* ei, const uint8_t* data, uint32_t length) {
 }
 
 
+
+int xmp_from_jpeg(const uint8_t* data, uint32_t bytes, const char** xml, uint32_t* xml_bytes) {
+    static const char ns[] = "http://ns.adobe.com/xap/1.0/"; // including '\0'
+    if (bytes < 4 || data[0] != 0xFF || data[1] != 0xD8) { return EXIF_PARSE_INVALID_JPEG; }
+    uint32_t i = 2;
+    while (i + 4 <= bytes && data[i] == 0xFF) {
+        const uint8_t marker = data[i + 1];
+        if (marker == 0xFF) { i++; continue; } // fill byte
+        if (marker == 0xDA || marker == 0xD9) { break; } // SOS or EOI
+        const uint32_t length = (data[i + 2] << 8) | data[i + 3];
+        if (length < 2 || i + 2 + length > bytes) { return EXIF_PARSE_CORRUPT_DATA; }
+        if (marker == 0xE1 && length - 2 > sizeof(ns) &&
+            memcmp(data + i + 4, ns, sizeof(ns)) == 0) {
+            *xml = (const char*)data + i + 4 + sizeof(ns);
+            *xml_bytes = length - 2 - sizeof(ns);
+            return EXIF_PARSE_SUCCESS;
+        }
+        i += 2 + length;
+    }
+    return EXIF_PARSE_ABSENT_DATA;
+}
+
+// MP Index IFD (CIPA DC-007) in the TIFF block of APP2 "MPF\0" at tiff:
+// 0xB001 NumberOfImages, 0xB002 MPEntry: 16 bytes per image of attribute,
+// size, offset (from tiff, 0 for the primary image) and dependent images
+static int32_t exif_mpf_index(const uint8_t* data, uint32_t bytes, const uint8_t* tiff,
+        uint32_t tiff_bytes, exif_mpf_image_t* images, int32_t count) {
+    const bool intel = tiff[0] == 'I' && tiff[1] == 'I';
+    if (!intel && (tiff[0] != 'M' || tiff[1] != 'M')) { return 0; }
+    #define mpf16(p) (intel ? parse16_intel(p) : parse16_motorola(p))
+    #define mpf32(p) (intel ? parse32_intel(p) : parse32_motorola(p))
+    const uint32_t ifd = mpf32(tiff + 4);
+    if (mpf16(tiff + 2) != 0x2A || ifd < 8 || (uint64_t)ifd + 2 > tiff_bytes) { return 0; }
+    const uint32_t entries = mpf16(tiff + ifd);
+    if ((uint64_t)ifd + 2 + 12 * (uint64_t)entries > tiff_bytes) { return 0; }
+    uint32_t mp_entry = 0;  // offset of MPEntry array in tiff
+    uint32_t images_count = 0;
+    for (uint32_t i = 0; i < entries; i++) {
+        const uint8_t* e = tiff + ifd + 2 + i * 12;
+        const uint32_t components = mpf32(e + 4);
+        if (mpf16(e) == 0xB002 && mpf16(e + 2) == 7 && components % 16 == 0 &&
+            components > 4 && (uint64_t)mpf32(e + 8) + components <= tiff_bytes) {
+            mp_entry = mpf32(e + 8);
+            images_count = components / 16;
+        }
+    }
+    int32_t n = 0;
+    for (uint32_t i = 0; i < images_count && n < count; i++) {
+        const uint8_t* e = tiff + mp_entry + i * 16;
+        const uint32_t attribute = mpf32(e);
+        const uint32_t size = mpf32(e + 4);
+        const uint32_t offset = mpf32(e + 8);
+        const uint8_t* image = offset == 0 ? data : tiff + offset;
+        // spans outside of the source or not starting with SOI are dropped
+        if (size >= 4 && (uint64_t)(tiff - data) + offset <= bytes &&
+            size <= bytes - (uint32_t)(image - data) &&
+            image[0] == JM_START && image[1] == JM_SOI) {
+            images[n].type = attribute & 0x00FFFFFF;
+            images[n].flags = attribute >> 24;
+            images[n].data = image;
+            images[n].bytes = size;
+            n++;
+        }
+    }
+    #undef mpf16
+    #undef mpf32
+    return n;
+}
+
+int exif_mpf_from_jpeg(const uint8_t* data, uint32_t bytes, exif_mpf_image_t* images,
+        int32_t count, int32_t* n) {
+    *n = 0;
+    if (bytes < 4 || data[0] != 0xFF || data[1] != 0xD8) { return EXIF_PARSE_INVALID_JPEG; }
+    uint32_t i = 2;
+    while (i + 4 <= bytes && data[i] == 0xFF) {
+        const uint8_t marker = data[i + 1];
+        if (marker == 0xFF) { i++; continue; } // fill byte
+        if (marker == 0xDA || marker == 0xD9) { break; } // SOS or EOI
+        const uint32_t length = (data[i + 2] << 8) | data[i + 3];
+        if (length < 2 || i + 2 + length > bytes) { return EXIF_PARSE_CORRUPT_DATA; }
+        if (marker == JM_APP2 && length >= 2 + 4 + 8 && memcmp(data + i + 4, "MPF\0", 4) == 0) {
+            *n = exif_mpf_index(data, bytes, data + i + 8, length - 6, images, count);
+            return EXIF_PARSE_SUCCESS;
+        }
+        i += 2 + length;
+    }
+    return EXIF_PARSE_ABSENT_DATA;
+}
+
+typedef struct xmp_stream_s {
+    yxml_t yxml;
+    const char* stack[64]; // element names, valid until their ELEMEND
+    int32_t top;
+    xmp_subscription_t* s;
+    int32_t count;
+    int32_t satisfied;
+    int32_t element;       // subscription capturing element content or -1
+    int32_t depth;         // top of the stack at the subscribed element
+    int64_t start;         // content of element (or rdf:li item) starts at
+    int32_t item_depth;    // top of the stack at rdf:li item or 0
+    int32_t attr;          // subscription capturing attribute value or -1
+    int64_t attr_start;    // after the opening quote or -1
+    int64_t lt;            // last '<' outside attribute values
+    bool in_tag;           // inside start tag: attributes may follow
+    bool in_attr;
+} xmp_stream_t;
+
+static bool xmp_has_parent(xmp_stream_t* x, const char* parent, int32_t from) {
+    bool has_parent = parent == null;
+    for (int32_t p = from; p >= 0 && !has_parent; p--) {
+        has_parent = yxml_strequ(x->stack[p], parent);
+    }
+    return has_parent;
+}
+
+static void xmp_deliver(xmp_stream_t* x, xmp_subscription_t* s, const char* xml,
+        int64_t from, int64_t to, bool last) {
+    if (from < 0 || to < from) { from = to; } // empty "<name/>"
+    s->value(s, xml + from, (uint32_t)(to - from), s->values);
+    s->values++;
+    if (last && !s->satisfied) {
+        s->satisfied = true;
+        x->satisfied++;
+    }
+}
+
+static void xmp_element_start(xmp_stream_t* x) {
+    const char* name = x->yxml.elem;
+    x->stack[x->top++] = name;
+    x->in_tag = true;
+    if (x->element >= 0) {
+        xmp_subscription_t* s = &x->s[x->element];
+        if (s->container != xmp_simple && x->item_depth == 0 &&
+            yxml_strequ(name, "rdf:li")) {
+            x->item_depth = x->top;
+            x->start = -1;
+        }
+    } else {
+        for (int32_t i = 0; i < x->count && x->element < 0; i++) {
+            xmp_subscription_t* s = &x->s[i];
+            if (!s->satisfied && yxml_strequ(name, s->name) &&
+                xmp_has_parent(x, s->parent, x->top - 2)) {
+                x->element = i;
+                x->depth = x->top;
+                x->item_depth = 0;
+                x->start = -1;
+            }
+        }
+    }
+}
+
+static void xmp_element_end(xmp_stream_t* x, const char* xml, int64_t i) {
+    if (x->element >= 0) {
+        xmp_subscription_t* s = &x->s[x->element];
+        const int64_t end = x->lt >= 0 && x->lt > x->start ? x->lt : i;
+        if (x->item_depth == x->top) {
+            xmp_deliver(x, s, xml, x->start, end, false);
+            x->item_depth = 0;
+        } else if (x->depth == x->top) {
+            if (s->container == xmp_simple || s->values == 0) {
+                xmp_deliver(x, s, xml, x->start, end, true);
+            } else if (!s->satisfied) {
+                s->satisfied = true;
+                x->satisfied++;
+            }
+            x->element = -1;
+        }
+    }
+    x->top--;
+}
+
+static void xmp_attr_start(xmp_stream_t* x) {
+    x->in_attr = true;
+    x->attr_start = -1;
+    for (int32_t i = 0; i < x->count && x->attr < 0; i++) {
+        xmp_subscription_t* s = &x->s[i];
+        if (!s->satisfied && s->container == xmp_simple &&
+            yxml_strequ(x->yxml.attr, s->name) && xmp_has_parent(x, s->parent, x->top - 1)) {
+            x->attr = i;
+        }
+    }
+}
+
+int xmp_subscribe(const char* xml, uint32_t bytes, xmp_subscription_t* s, int32_t count) {
+    xmp_stream_t x = {0};
+    char stack[8 * 1024];
+    yxml_init(&x.yxml, stack, sizeof(stack));
+    x.s = s;
+    x.count = count;
+    x.element = -1;
+    x.attr = -1;
+    x.lt = -1;
+    for (int32_t i = 0; i < count; i++) {
+        s[i].values = 0;
+        s[i].satisfied = false;
+    }
+    yxml_ret_t r = YXML_OK;
+    for (int64_t i = 0; i < bytes && x.satisfied < count; i++) {
+        const char c = xml[i];
+        r = yxml_parse(&x.yxml, c);
+        if (r < 0) { break; }
+        switch (r) {
+            case YXML_ELEMSTART:
+                if (x.top == countof(x.stack)) { r = YXML_ESTACK; break; }
+                xmp_element_start(&x);
+                break;
+            case YXML_ELEMEND: xmp_element_end(&x, xml, i); x.in_tag = false; break;
+            case YXML_ATTRSTART: xmp_attr_start(&x); break;
+            case YXML_ATTREND:
+                if (x.attr >= 0) { xmp_deliver(&x, &s[x.attr], xml, x.attr_start, i, true); }
+                x.attr = -1;
+                x.in_attr = false;
+                break;
+            default: break;
+        }
+        if (r < 0) { break; }
+        if (x.in_attr) {
+            if (x.attr_start < 0 && (c == '"' || c == '\'')) { x.attr_start = i + 1; }
+        } else if (c == '<') {
+            x.lt = i;
+        } else if (c == '>' && x.in_tag) { // end of start tag: content follows
+            x.in_tag = false;
+            if (x.element >= 0 && (x.top == x.depth || x.top == x.item_depth)) {
+                x.start = i + 1;
+                x.lt = -1;
+            }
+        }
+    }
+    if (r < 0) {
+        return x.satisfied == count ? EXIF_PARSE_SUCCESS : EXIF_PARSE_CORRUPT_DATA;
+    }
+    return EXIF_PARSE_SUCCESS;
+}
+
+static uint32_t xmp_utf8(uint32_t cp, char* out) {
+    if (cp < 0x80)    { out[0] = (char)cp; return 1; }
+    if (cp < 0x800)   { out[0] = (char)(0xC0 | (cp >> 6));
+                        out[1] = (char)(0x80 | (cp & 0x3F)); return 2; }
+    if (cp < 0x10000) { out[0] = (char)(0xE0 | (cp >> 12));
+                        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+                        out[2] = (char)(0x80 | (cp & 0x3F)); return 3; }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+uint32_t xmp_unescape(const char* text, uint32_t bytes, char* output, uint32_t count) {
+    static const struct { const char* e; char c; } entities[] = {
+        { "&amp;", '&' }, { "&lt;", '<' }, { "&gt;", '>' }, { "&quot;", '"' }, { "&apos;", '\'' }
+    };
+    uint32_t k = 0;
+    uint32_t i = 0;
+    while (i < bytes && k + 4 < count) {
+        uint32_t n = 0;
+        if (text[i] == '&') {
+            for (int j = 0; j < countof(entities) && n == 0; j++) {
+                const uint32_t m = (uint32_t)strlen(entities[j].e);
+                if (i + m <= bytes && memcmp(text + i, entities[j].e, m) == 0) {
+                    output[k++] = entities[j].c;
+                    n = m;
+                }
+            }
+            if (n == 0 && i + 2 < bytes && text[i + 1] == '#') {
+                const bool hex = text[i + 2] == 'x';
+                uint32_t cp = 0;
+                uint32_t j = i + (hex ? 3 : 2);
+                while (j < bytes && isxdigit((uint8_t)text[j]) && (hex || isdigit((uint8_t)text[j]))) {
+                    cp = cp * (hex ? 16 : 10) + (isdigit((uint8_t)text[j]) ?
+                        text[j] - '0' : (tolower((uint8_t)text[j]) - 'a' + 10));
+                    j++;
+                }
+                if (j < bytes && text[j] == ';' && cp <= 0x10FFFF) {
+                    k += xmp_utf8(cp, output + k);
+                    n = j + 1 - i;
+                }
+            }
+        }
+        if (n == 0) { output[k++] = text[i]; n = 1; }
+        i += n;
+    }
+    output[k] = 0;
+    return k;
+}
+
+// Container:Directory is an rdf:Seq of items in the order they follow the
+// primary image in the file, each item either
+//     <Container:Item Item:Semantic="MotionPhoto" Item:Length="123"/>
+// or the same properties in element form. Items are parsed one by one
+// from the spans xmp_subscribe() delivers.
+
+typedef struct xmp_motion_s {
+    uint32_t offset;     // GCamera:MicroVideoOffset
+    uint32_t tail;       // bytes from the motion photo item to the end of file
+    uint32_t length;     // of the motion photo item
+    uint32_t item_length;
+    uint32_t item_padding;
+    bool item_video;
+    bool video;          // motion photo item seen
+} xmp_motion_t;
+
+static uint32_t xmp_span_uint32(const char* text, uint32_t bytes) {
+    uint64_t n = 0;
+    for (uint32_t i = 0; i < bytes && isdigit((uint8_t)text[i]) && n <= UINT32_MAX; i++) {
+        n = n * 10 + (text[i] - '0');
+    }
+    return n <= UINT32_MAX ? (uint32_t)n : 0;
+}
+
+static void xmp_motion_uint32(xmp_subscription_t* s, const char* text, uint32_t bytes,
+        int32_t item) {
+    (void)item;
+    *(uint32_t*)s->that = xmp_span_uint32(text, bytes);
+}
+
+static void xmp_motion_semantic(xmp_subscription_t* s, const char* text, uint32_t bytes,
+        int32_t item) {
+    (void)item;
+    *(bool*)s->that = bytes == 11 && memcmp(text, "MotionPhoto", 11) == 0;
+}
+
+static void xmp_motion_item(xmp_subscription_t* s, const char* text, uint32_t bytes,
+        int32_t item) {
+    (void)item;
+    xmp_motion_t* m = (xmp_motion_t*)s->that;
+    m->item_length = 0;
+    m->item_padding = 0;
+    m->item_video = false;
+    xmp_subscription_t properties[] = {
+        { .name = "Item:Semantic", .value = xmp_motion_semantic, .that = &m->item_video },
+        { .name = "Item:Length",   .value = xmp_motion_uint32,   .that = &m->item_length },
+        { .name = "Item:Padding",  .value = xmp_motion_uint32,   .that = &m->item_padding }
+    };
+    // element form <rdf:li rdf:parseType="Resource"><Item:Semantic>...
+    // </Item:Semantic><Item:Length>...</Item:Length></rdf:li> has sibling
+    // roots: a synthetic root makes the span a single XML element
+    static const char open[] = "<rdf:li>";
+    static const char close[] = "</rdf:li>";
+    char wrapped[4 * 1024];
+    if (bytes + sizeof(open) + sizeof(close) <= sizeof(wrapped)) {
+        memcpy(wrapped, open, sizeof(open) - 1);
+        memcpy(wrapped + sizeof(open) - 1, text, bytes);
+        memcpy(wrapped + sizeof(open) - 1 + bytes, close, sizeof(close) - 1);
+        xmp_subscribe(wrapped, (uint32_t)(sizeof(open) - 1 + bytes + sizeof(close) - 1),
+            properties, countof(properties));
+    } else {
+        xmp_subscribe(text, bytes, properties, countof(properties));
+    }
+    if (m->item_video && !m->video) {
+        m->video = true;
+        m->length = m->item_length;
+    }
+    if (m->video) { // this and all following items are at the end of file
+        const uint64_t tail = (uint64_t)m->tail + m->item_length + m->item_padding;
+        m->tail = tail <= UINT32_MAX ? (uint32_t)tail : 0;
+    }
+}
+
+static void xmp_motion(const char* xml, uint32_t bytes, xmp_motion_t* m) {
+    xmp_subscription_t s[] = {
+        { .name = "GCamera:MicroVideoOffset", .value = xmp_motion_uint32, .that = &m->offset },
+        { .name = "Container:Directory", .container = xmp_seq,
+          .value = xmp_motion_item, .that = m }
+    };
+    xmp_subscribe(xml, bytes, s, countof(s));
+}
+
+// bytes from the end of file to the video or 0, length 0 when not known
+static uint32_t xmp_motion_offset(const char* xml, uint32_t bytes, uint32_t* length) {
+    xmp_motion_t m = {0};
+    xmp_motion(xml, bytes, &m);
+    *length = m.video ? m.length : 0;
+    return m.video && m.length > 0 ? m.tail : m.offset;
+}
+
+int exif_motion_photo(const uint8_t* data, uint32_t bytes, const uint8_t** video,
+        uint32_t* video_bytes) {
+    *video = null;
+    *video_bytes = 0;
+    const char* xml = null;
+    uint32_t xml_bytes = 0;
+    if (xmp_from_jpeg(data, bytes, &xml, &xml_bytes) != EXIF_PARSE_SUCCESS) {
+        return EXIF_PARSE_ABSENT_DATA;
+    }
+    uint32_t length = 0;
+    const uint32_t offset = xmp_motion_offset(xml, xml_bytes, &length);
+    if (offset == 0 || offset > bytes - 4) { return EXIF_PARSE_ABSENT_DATA; } // after SOI
+    if (length == 0 || length > offset) { length = offset; }
+    const uint8_t* mp4 = data + bytes - offset;
+    // ISO/IEC 14496-12: size and type of the first box
+    if (length < 8 || memcmp(mp4 + 4, "ftyp", 4) != 0) { return EXIF_PARSE_ABSENT_DATA; }
+    *video = mp4;
+    *video_bytes = length;
+    return EXIF_PARSE_SUCCESS;
+}
@@ -74,6 +74,7 @@ typedef const char* exif_rdf_t; // similar to getenv() result
 typedef struct exif_info_s {
     bool has_app1;
     bool has_xmp;
+    bool has_mpf;                   // APP2 MPF index of secondary images, see exif_mpf_from_jpeg()
     bool not_enough_memory;         // examine on error and resize something...
     bool dump;                      // client can set to true prio calling to debug
     char strings[64 * 1024];        // EXIF UTF-8 string storage (max APP1 segment is 64KB)
@@ -85,6 +86,9 @@ typedef struct exif_info_s {
     uint32_t ImageHeight;           // Image height reported in EXIF data
     uint32_t RelatedImageWidth;     // Original image width reported in EXIF data
     uint32_t RelatedImageHeight;    // Original image height reported in EXIF data
+    const uint8_t* Thumbnail;       // IFD1 embedded JPEG thumbnail inside the data passed
+                                    // to exif_from_memory() or null if absent
+    uint32_t ThumbnailBytes;        // JPEGInterchangeFormatLength
     exif_str_t ImageDescription;    // Image description
     exif_str_t Artist;              // Artist
     exif_str_t UserComment;         // User Comment
@@ -274,6 +278,7 @@ typedef struct exif_info_s {
                                     // 1: differential correction applied
         exif_str_t GPSMapDatum;     // Geodetic survey data (may not be present)
         exif_str_t GPSTimeStamp;    // Time as UTC (Coordinated Universal Time) (may not be present)
+        char TimeStamp[64];         // storage of GPSTimeStamp "h m s"
         exif_str_t GPSDateStamp;    // A character string recording date and time information relative
                                     // to UTC (Coordinated Universal Time) YYYY:MM:DD (may not be present)
         struct Coord_t {
@@ -295,7 +300,7 @@ typedef struct exif_info_s {
     struct MicroVideo_t {               // Google camera video file in metadata
         uint32_t HasMicroVideo;         // not zero if exists
         uint32_t MicroVideoVersion;     // just regularinfo
-        uint32_t MicroVideoOffset;      // offset from end of file
+        uint32_t MicroVideoOffset;      // offset from end of file (both XMP forms)
     } MicroVideo;
 
     struct {
@@ -427,6 +432,54 @@ typedef struct exif_info_s {
         exif_str_t ModifyDate;
         exif_str_t Rating;
         exif_str_t Lens; // <aux:Lens>Samsung Galaxy S7 Rear Camera</aux:Lens>
+        // Usually written as rdf:Description attributes, converted into
+        // numeric fields above (Orientation, GPano, MicroVideo, GeoLocation...)
+        // when EXIF does not have them:
+        exif_str_t about;  // rdf:about e.g. "DJI Meta Data"
+        struct {
+            exif_str_t Orientation;
+            exif_str_t ImageWidth;
+            exif_str_t ImageHeight;    // or tiff:ImageLength
+            exif_str_t XResolution;    // "72/1"
+            exif_str_t YResolution;
+            exif_str_t ResolutionUnit;
+        } tiff;
+        struct {
+            exif_str_t ProjectionType; // "equirectangular"
+            exif_str_t PosePitchDegrees;
+            exif_str_t PoseRollDegrees;
+        } GPano;
+        struct {
+            exif_str_t MicroVideo;        // "1"
+            exif_str_t MicroVideoVersion;
+            exif_str_t MicroVideoOffset;  // bytes from the end of file
+            exif_str_t MotionPhoto;       // "1", video in Container:Directory
+            exif_str_t MotionPhotoVersion;
+            exif_str_t MotionPhotoPresentationTimestampUs; // "-1" unknown
+        } GCamera;
+        struct {                          // drone-dji:
+            exif_str_t AbsoluteAltitude;  // "+123.45"
+            exif_str_t RelativeAltitude;
+            exif_str_t GimbalRollDegree;
+            exif_str_t GimbalPitchDegree;
+            exif_str_t GimbalYawDegree;
+            exif_str_t CalibratedFocalLength;
+            exif_str_t CalibratedOpticalCenterX;
+            exif_str_t CalibratedOpticalCenterY;
+        } dji;
+        struct {                          // Camera: senseFly, Sentera and Parrot
+            exif_str_t Roll;
+            exif_str_t Pitch;             // 0 is nadir
+            exif_str_t Yaw;
+            exif_str_t GPSXYAccuracy;
+            exif_str_t GPSZAccuracy;
+            exif_str_t AboveGroundAltitude;
+        } Camera;
+        struct {                          // drone-parrot:
+            exif_str_t CameraRollDegree;
+            exif_str_t CameraPitchDegree;
+            exif_str_t CameraYawDegree;
+        } parrot;
     } xmp;
 } exif_info_t;
 
@@ -438,6 +491,86 @@ extern "C" {
 int exif_from_memory(exif_info_t* ei, const uint8_t* data, uint32_t bytes);
 int exif_from_stream(exif_info_t* ei, exif_stream_t* stream);
 
+// Multi-Picture Format: phones append previews, depth (disparity) and gain
+// maps as JPEG images after the primary image and index them in an APP2
+// "MPF\0" segment. exif_mpf_from_jpeg() walks the markers up to SOS only
+// and returns the index as spans of the source data (no copies); images
+// with spans outside of data are dropped.
+
+enum {
+    exif_mpf_undefined   = 0x000000, // also used for gain maps
+    exif_mpf_preview_vga = 0x010001, // large thumbnail, VGA equivalent
+    exif_mpf_preview_hd  = 0x010002, // large thumbnail, full HD equivalent
+    exif_mpf_preview_4k  = 0x010003, // large thumbnail, 4K equivalent
+    exif_mpf_panorama    = 0x020001, // multi-frame panorama
+    exif_mpf_disparity   = 0x020002, // stereo pair or depth
+    exif_mpf_multi_angle = 0x020003,
+    exif_mpf_primary     = 0x030000  // baseline MP primary image
+};
+
+typedef struct exif_mpf_image_s {
+    uint32_t type;          // exif_mpf_* (MP entry attribute bits 0..23)
+    uint32_t flags;         // bits 24..31: 0x80 parent, 0x40 child, 0x20 representative
+    const uint8_t* data;    // JPEG starting with SOI inside the source
+    uint32_t bytes;
+} exif_mpf_image_t;
+
+// count: capacity of images, *n: images returned, returns 0 or EXIF_PARSE_ABSENT_DATA
+int exif_mpf_from_jpeg(const uint8_t* data, uint32_t bytes, exif_mpf_image_t* images,
+    int32_t count, int32_t* n);
+
+// Motion photos (Google MicroVideo, Android Motion Photo, recent Samsung)
+// append an MP4 after the EOI of the primary image. XMP locates it either
+// by GCamera:MicroVideoOffset (bytes from the end of file) or by the
+// Container:Directory item with Item:Semantic="MotionPhoto" whose
+// Item:Length, together with the items that follow, counts from the end.
+// exif_motion_photo() returns the video as a span of the source data (no
+// copies) after checking that it starts with an ISO BMFF "ftyp" box, so a
+// writer can append it verbatim after a re-encoded image.
+
+// returns 0 or EXIF_PARSE_ABSENT_DATA
+int exif_motion_photo(const uint8_t* data, uint32_t bytes, const uint8_t** video,
+    uint32_t* video_bytes);
+
+// Streaming XMP subscriptions: no copies and no strings arena.
+// Callers register the properties they need and receive spans of the
+// source packet as the single pass reaches them. Spans are raw XML text:
+// entity references (&amp; &#xNN;) are left as they are, see
+// xmp_unescape(). Property is matched both in element form
+//     <xmp:Rating>3</xmp:Rating>
+// and attribute form
+//     <rdf:Description xmp:Rating="3">
+// For xmp_bag, xmp_seq and xmp_alt containers each rdf:li item is
+// delivered separately with its index (a writer that omitted the
+// container delivers the whole content as item 0). Parsing stops as
+// soon as every subscription is satisfied: a simple property after its
+// first value, a container when its element ends.
+
+typedef enum { xmp_simple, xmp_bag, xmp_seq, xmp_alt } xmp_container_t;
+
+typedef struct xmp_subscription_s xmp_subscription_t;
+
+typedef struct xmp_subscription_s {
+    const char* name;          // "dc:subject"
+    const char* parent;        // required ancestor e.g. "Iptc4xmpExt:LocationShown" or null
+    xmp_container_t container;
+    void (*value)(xmp_subscription_t* s, const char* text, uint32_t bytes, int32_t item);
+    void* that;                // client context
+    int32_t values;            // delivered so far, set by xmp_subscribe()
+    bool satisfied;            // set by xmp_subscribe()
+} xmp_subscription_t;
+
+// finds XMP packet in APP1 segments of JPEG data, returns 0,
+// EXIF_PARSE_INVALID_JPEG (no SOI), EXIF_PARSE_CORRUPT_DATA (segment
+// length runs past the data) or EXIF_PARSE_ABSENT_DATA (no XMP segment)
+int xmp_from_jpeg(const uint8_t* data, uint32_t bytes, const char** xml, uint32_t* xml_bytes);
+// returns EXIF_PARSE_SUCCESS when the packet was parsed to its end or every
+// subscription was satisfied before an XML error; EXIF_PARSE_CORRUPT_DATA on
+// an XML error before that (values delivered up to the error are kept)
+int xmp_subscribe(const char* xml, uint32_t bytes, xmp_subscription_t* s, int32_t count);
+// decodes XML entities of a span into zero terminated output, returns length
+uint32_t xmp_unescape(const char* text, uint32_t bytes, char* output, uint32_t count);
+
 #ifdef __cplusplus
 }
 #endif
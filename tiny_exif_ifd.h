@@ -0,0 +1,608 @@
+// Byte order specialized IFD walk. Included twice by tiny_exif.c with
+// EXIF_INTEL 1 ("II", little endian) and 0 ("MM", big endian): ifd(name)
+// expands to name_intel or name_motorola, so every field is a direct load
+// (byte swapped for Motorola) with no per field byte order branch and
+// the order is decided once per EXIF segment.
+// Every IFD is validated once before it is walked (exif_ifd_valid): entry
+// table and the values of all entries of known types must lie inside the
+// segment. The fetchers below rely on that and do no bounds checks.
+// No #pragma once: included once per byte order.
+
+#if EXIF_INTEL
+#define ifd(name) name##_intel
+static inline uint16_t ifd(parse16)(const uint8_t* buf) { return exif_load16(buf); }
+static inline uint32_t ifd(parse32)(const uint8_t* buf) { return exif_load32(buf); }
+#else
+#define ifd(name) name##_motorola
+static inline uint16_t ifd(parse16)(const uint8_t* buf) { return exif_bswap16(exif_load16(buf)); }
+static inline uint32_t ifd(parse32)(const uint8_t* buf) { return exif_bswap32(exif_load32(buf)); }
+#endif
+
+// IFD at offs (in p->data): entries, next IFD link and out of line values
+static bool ifd(exif_ifd_valid)(const entry_parser_t* p, uint32_t offs) {
+    // bytes per component of TIFF types 1..12, 0: unknown type, never read
+    static const uint8_t type_bytes[] = { 0, 1, 1, 2, 4, 8, 1, 1, 2, 4, 8, 4, 8 };
+    if (offs < p->tiff_header_start || (uint64_t)offs + 2 > p->bytes) { return false; }
+    const uint32_t n = ifd(parse16)(p->data + offs);
+    if ((uint64_t)offs + 6 + 12 * (uint64_t)n > p->bytes) { return false; }
+    for (uint32_t i = 0; i < n; i++) {
+        const uint8_t* e = p->data + offs + 2 + i * 12;
+        const uint32_t type = ifd(parse16)(e + 2);
+        if (type < countof(type_bytes)) {
+            const uint64_t bytes = (uint64_t)ifd(parse32)(e + 4) * type_bytes[type];
+            const uint64_t at = (uint64_t)p->tiff_header_start + ifd(parse32)(e + 8);
+            if (bytes > 4 && at + bytes > p->bytes) { return false; }
+        }
+    }
+    return true;
+}
+
+static uint32_t ifd(get_data)(entry_parser_t* p) {
+    return ifd(parse32)(p->data + p->offs + 8);
+}
+
+static uint32_t ifd(get_sub_ifd)(entry_parser_t* p) {
+    return p->tiff_header_start + ifd(get_data)(p);
+}
+
+static float ifd(parse_float)(const uint8_t* buf) {
+    union {
+        uint32_t i;
+        float f;
+    } i2f;
+    i2f.i = ifd(parse32)(buf);
+    return i2f.f;
+}
+
+static double ifd(parse_rational)(const uint8_t* buf, bool isSigned) {
+    const uint32_t denominator = ifd(parse32)(buf+4);
+    if (denominator == 0)
+        return 0.0;
+    const uint32_t numerator = ifd(parse32)(buf);
+    return isSigned ?
+        (double)(int32_t)numerator/(double)(int32_t)denominator :
+        (double)numerator/(double)denominator;
+}
+
+static exif_str_t ifd(parse_string)(entry_parser_t* p, uint32_t num_components) {
+    char* res = p->info->next;
+    const size_t left = (size_t)(p->info->strings + sizeof(p->info->strings) - p->info->next);
+    if (num_components <= 4) {
+        if (left <= num_components + 1) {
+            return "";
+        }
+        p->info->next += num_components + 1;
+        // value field bytes are the string in file order for both orders
+        memcpy(res, p->data + p->offs + 8, num_components);
+        res[num_components] = 0;
+    } else {
+        const char* const s = (const char*)p->data + ifd(get_sub_ifd)(p);
+        uint32_t num = 0;
+        while (num < num_components && s[num] != 0) { ++num; }
+        while (num && s[num-1] == ' ') { --num; }
+        if (left <= num + 1) {
+            return "";
+        }
+        p->info->next += num + 1;
+        memcpy(res, s, num);
+        res[num] = 0;
+    }
+    return res;
+}
+
+static void ifd(parse_tag)(entry_parser_t* p) {
+    p->offs  += 12;
+    p->tag    = ifd(parse16)(p->data + p->offs);
+    p->format = ifd(parse16)(p->data + p->offs + 2);
+    p->length = ifd(parse32)(p->data + p->offs + 4);
+}
+
+static bool ifd(parser_fetch_str)(entry_parser_t* p, exif_str_t* val) {
+    if (p->format != 2 || p->length == 0)
+        return false;
+    *val = ifd(parse_string)(p, p->length);
+    return true;
+}
+
+static bool ifd(parser_fetch8)(entry_parser_t* p, uint8_t* val) {
+    if ((p->format != 1 && p->format != 2 && p->format != 6) || p->length == 0)
+        return false;
+    *val = parse8(p->data + p->offs + 8);
+    return true;
+}
+
+static bool ifd(parser_fetch16)(entry_parser_t* p, uint16_t* val) {
+    if (!is_short(p) || p->length == 0)
+        return false;
+    *val = ifd(parse16)(p->data + p->offs + 8);
+    return true;
+}
+
+static bool ifd(parser_fetch16_idx)(entry_parser_t* p, uint16_t* val, uint32_t idx) {
+    if (!is_short(p) || p->length <= idx)
+        return false;
+    const uint32_t at = p->length <= 2 ? p->offs + 8 : ifd(get_sub_ifd)(p); // inline or not
+    *val = ifd(parse16)(p->data + at + idx * 2);
+    return true;
+}
+
+static bool ifd(parser_fetch32)(entry_parser_t* p, uint32_t* val) {
+    if (!is_long(p) || p->length == 0)
+        return false;
+    *val = ifd(parse32)(p->data + p->offs + 8);
+    return true;
+}
+
+static bool ifd(parser_fetch_float)(entry_parser_t* p, float* val) {
+    if (!is_float(p) || p->length == 0)
+        return false;
+    *val = ifd(parse_float)(p->data + p->offs + 8);
+    return true;
+}
+
+static bool ifd(parser_fetch_double)(entry_parser_t* p, double* val) {
+    if (!is_rational(p) || p->length == 0)
+        return false;
+    *val = ifd(parse_rational)(p->data + ifd(get_sub_ifd)(p), is_signed_rational(p));
+    return true;
+}
+
+static bool ifd(parser_fetch_double_idx)(entry_parser_t* p, double* val, uint32_t idx) {
+    if (!is_rational(p) || p->length <= idx)
+        return false;
+    *val = ifd(parse_rational)(p->data + ifd(get_sub_ifd)(p) + idx * 8, is_signed_rational(p));
+    return true;
+}
+
+static bool ifd(parser_fetch_float_as_doble)(entry_parser_t* p, double* val) {
+    float _val;
+    if (!ifd(parser_fetch_float)(p, &_val))
+        return false;
+    *val = _val;
+    return true;
+}
+
+// Parse tag as MakerNote IFD
+static void ifd(exif_parse_ifd_maker_note)(entry_parser_t* p) {
+    const uint32_t startOff = p->offs;
+    const uint32_t off = ifd(get_sub_ifd)(p);
+    if (0 != strcasecmp(p->info->Make, "DJI"))
+        return;
+    if (!ifd(exif_ifd_valid)(p, off))
+        return;
+    int num_entries = ifd(parse16)(p->data + off);
+    parser_init(p, off+2);
+    ifd(parse_tag)(p);
+    --num_entries;
+    exif_str_t maker = null;
+    if (p->tag == 1 && ifd(parser_fetch_str)(p, &maker)) {
+        if (0 == strcasecmp(maker, "DJI")) {
+            while (--num_entries >= 0) {
+                ifd(parse_tag)(p);
+                switch (p->tag) {
+                    case 3:
+                        // SpeedX
+                        ifd(parser_fetch_float_as_doble)(p, &p->info->GeoLocation.SpeedX);
+                        break;
+                    case 4:
+                        // SpeedY
+                        ifd(parser_fetch_float_as_doble)(p, &p->info->GeoLocation.SpeedY);
+                        break;
+                    case 5:
+                        // SpeedZ
+                        ifd(parser_fetch_float_as_doble)(p, &p->info->GeoLocation.SpeedZ);
+                        break;
+                    case 9:
+                        // Camera Pitch
+                        ifd(parser_fetch_float_as_doble)(p, &p->info->GeoLocation.PitchDegree);
+                        break;
+                    case 10:
+                        // Camera Yaw
+                        ifd(parser_fetch_float_as_doble)(p, &p->info->GeoLocation.YawDegree);
+                        break;
+                    case 11:
+                        // Camera Roll
+                        ifd(parser_fetch_float_as_doble)(p, &p->info->GeoLocation.RollDegree);
+                        break;
+                }
+            }
+        }
+    }
+    parser_init(p, startOff+12);
+}
+
+// Parse tag as GPS IFD
+static void ifd(exif_parse_ifd_gps)(entry_parser_t* p) {
+    switch (p->tag) {
+        case 1:
+            // GPS north or south
+            ifd(parser_fetch8)(p, &p->info->GeoLocation.LatComponents.direction);
+            break;
+        case 2:
+            // GPS latitude
+            if (is_rational(p) && p->length == 3) {
+                ifd(parser_fetch_double_idx)(p, &p->info->GeoLocation.LatComponents.degrees, 0);
+                ifd(parser_fetch_double_idx)(p, &p->info->GeoLocation.LatComponents.minutes, 1);
+                ifd(parser_fetch_double_idx)(p, &p->info->GeoLocation.LatComponents.seconds, 2);
+            }
+            break;
+        case 3:
+            // GPS east or west
+            ifd(parser_fetch8)(p, &p->info->GeoLocation.LonComponents.direction);
+            break;
+        case 4:
+            // GPS longitude
+            if (is_rational(p) && p->length == 3) {
+                ifd(parser_fetch_double_idx)(p, &p->info->GeoLocation.LonComponents.degrees, 0);
+                ifd(parser_fetch_double_idx)(p, &p->info->GeoLocation.LonComponents.minutes, 1);
+                ifd(parser_fetch_double_idx)(p, &p->info->GeoLocation.LonComponents.seconds, 2);
+            }
+            break;
+        case 5: {
+            // GPS altitude reference (below or above sea level)
+            uint8_t altitude = 0;
+            ifd(parser_fetch8)(p, &altitude);
+            p->info->GeoLocation.AltitudeRef = altitude;
+            break;
+        }
+        case 6:
+            // GPS altitude
+            ifd(parser_fetch_double)(p, &p->info->GeoLocation.Altitude);
+            break;
+        case 7:
+            // GPS timestamp
+            if (is_rational(p) && p->length == 3) {
+                double h = 0, m = 0, s = 0;
+                ifd(parser_fetch_double_idx)(p, &h, 0);
+                ifd(parser_fetch_double_idx)(p, &m, 1);
+                ifd(parser_fetch_double_idx)(p, &s, 2);
+                char* text = p->info->GeoLocation.TimeStamp;
+                snprintf(text, countof(p->info->GeoLocation.TimeStamp), "%g %g %g", h, m, s);
+                p->info->GeoLocation.GPSTimeStamp = text;
+            }
+            break;
+        case 11:
+            // Indicates the GPS DOP (data degree of precision)
+            ifd(parser_fetch_double)(p, &p->info->GeoLocation.GPSDOP);
+            break;
+        case 18:
+            // GPS geodetic survey data
+            ifd(parser_fetch_str)(p, &p->info->GeoLocation.GPSMapDatum);
+            break;
+        case 29:
+            // GPS date-stamp
+            ifd(parser_fetch_str)(p, &p->info->GeoLocation.GPSDateStamp);
+            break;
+        case 30:
+            // GPS differential indicates whether differential correction is applied to the GPS receiver
+            ifd(parser_fetch16)(p, &p->info->GeoLocation.GPSDifferential);
+            break;
+    }
+}
+
+// Parse tag as Exif IFD
+static void ifd(exif_parse_ifd)(entry_parser_t* p) {
+    switch (p->tag) {
+        case 0x02bc:
+            p->info->has_xmp = true;
+    		// XMP Metadata (Adobe technote 9-14-02)
+		    if (is_undefined(p) && p->length > 4) {
+			    const char* xml = (const char*)p->data + ifd(get_sub_ifd)(p);
+			    parse_xmp_xml(p->info, xml, p->length);
+		    }
+            break;
+        case TAG_EXPOSURETIME: // Exposure time in seconds
+            ifd(parser_fetch_double)(p, &p->info->ExposureTime);
+            break;
+        case TAG_FNUMBER:
+            ifd(parser_fetch_double)(p, &p->info->FNumber);
+            break;
+        case TAG_EXPOSURE_PROGRAM:
+            ifd(parser_fetch16)(p, &p->info->ExposureProgram);
+            break;
+        case TAG_ISOSPEED:
+            ifd(parser_fetch16)(p, &p->info->ISOSpeedRatings);
+            break;
+        case TAG_DATE_TIME_ORIGINAL:
+            ifd(parser_fetch_str)(p, &p->info->DateTimeOriginal);
+            break;
+        case TAG_DATE_TIME_DIGITIZED:
+            ifd(parser_fetch_str)(p, &p->info->DateTimeDigitized);
+            break;
+        case TAG_SHUTTERSPEED:
+            ifd(parser_fetch_double)(p, &p->info->ShutterSpeedValue);
+            p->info->ShutterSpeedValue = 1.0/exp(p->info->ShutterSpeedValue * log(2));
+            break;
+        case TAG_APERTURE:
+            ifd(parser_fetch_double)(p, &p->info->ApertureValue);
+            p->info->ApertureValue = exp(p->info->ApertureValue * log(2) * 0.5);
+            break;
+        case TAG_BRIGHTNESS_VALUE:
+            ifd(parser_fetch_double)(p, &p->info->BrightnessValue);
+            break;
+        case TAG_EXPOSURE_BIAS_VALUE:
+            ifd(parser_fetch_double)(p, &p->info->ExposureBiasValue);
+            break;
+        case TAG_SUBJECT_DISTANCE:
+            ifd(parser_fetch_double)(p, &p->info->SubjectDistance);
+            break;
+        case TAG_METRIC_MODULE:
+            ifd(parser_fetch16)(p, &p->info->MeteringMode);
+            break;
+        case TAG_LIGHT_SOURCE:
+            ifd(parser_fetch16)(p, &p->info->LightSource);
+            break;
+        case TAG_FLASH:
+            ifd(parser_fetch16)(p, &p->info->Flash);
+            break;
+        case TAG_FOCAL_LENGTH:
+            ifd(parser_fetch_double)(p, &p->info->FocalLength);
+            break;
+        case TAG_SUBJECT_AREA:
+            if (is_short(p) && p->length > 1) {
+                p->info->SubjectAreas = (uint16_t)p->length;
+                for (uint32_t i = 0; i < p->info->SubjectAreas; i++)
+                    ifd(parser_fetch16_idx)(p, &p->info->SubjectArea[i], i);
+            }
+            break;
+        case TAG_MAKER_NOTE:
+            ifd(exif_parse_ifd_maker_note)(p);
+            break;
+        case TAG_USERCOMMENT:
+            ifd(parser_fetch_str)(p, &p->info->ImageDescription);
+            break;
+        case TAG_SUB_SEC_TIME_ORIGINAL:
+            // Fractions of seconds for DateTimeOriginal
+            ifd(parser_fetch_str)(p, &p->info->SubSecTimeOriginal);
+            break;
+        case TAG_COMP_IMAGE_WIDTH: // only for compressed images
+            if (!ifd(parser_fetch32)(p, &p->info->ImageWidth)) {
+                uint16_t _ImageWidth;
+                if (ifd(parser_fetch16)(p, &_ImageWidth))
+                    p->info->ImageWidth = _ImageWidth;
+            }
+            break;
+        case TAG_COMP_IMAGE_HEIGHT:
+            if (!ifd(parser_fetch32)(p, &p->info->ImageHeight)) {
+                uint16_t _ImageHeight;
+                if (ifd(parser_fetch16)(p, &_ImageHeight))
+                    p->info->ImageHeight = _ImageHeight;
+            }
+            break;
+        case TAG_FOCALPLANE_X_RES:
+            ifd(parser_fetch_double)(p, &p->info->LensInfo.FocalPlaneXResolution);
+            break;
+        case TAG_FOCALPLANE_Y_RES:
+            ifd(parser_fetch_double)(p, &p->info->LensInfo.FocalPlaneYResolution);
+            break;
+        case TAG_FOCALPLANE_RESOLUTION_UNIT:
+            ifd(parser_fetch16)(p, &p->info->LensInfo.FocalPlaneResolutionUnit);
+            break;
+        case TAG_EXPOSURE_INDEX:
+            // Exposure Index and ISO Speed Rating are often used interchangeably
+            if (p->info->ISOSpeedRatings == 0) {
+                double ExposureIndex;
+                if (ifd(parser_fetch_double)(p, &ExposureIndex))
+                    p->info->ISOSpeedRatings = (uint16_t)ExposureIndex;
+            }
+            break;
+        case TAG_DIGITAL_ZOOM_RATIO:
+            // Digital Zoom Ratio
+            ifd(parser_fetch_double)(p, &p->info->LensInfo.DigitalZoomRatio);
+            break;
+        case TAG_FOCAL_LENGTH_IN_35_MM_FILM:
+            if (!ifd(parser_fetch_double)(p, &p->info->LensInfo.FocalLengthIn35mm)) {
+                uint16_t _FocalLengthIn35mm;
+                if (ifd(parser_fetch16)(p, &_FocalLengthIn35mm))
+                    p->info->LensInfo.FocalLengthIn35mm = (double)_FocalLengthIn35mm;
+            }
+            break;
+        case 0xa431:
+            // Serial number of the camera
+            ifd(parser_fetch_str)(p, &p->info->SerialNumber);
+            break;
+        case 0xa432:
+            // Focal length and FStop.
+            if (ifd(parser_fetch_double_idx)(p, &p->info->LensInfo.FocalLengthMin, 0))
+                if (ifd(parser_fetch_double_idx)(p, &p->info->LensInfo.FocalLengthMax, 1))
+                    if (ifd(parser_fetch_double_idx)(p, &p->info->LensInfo.FStopMin, 2))
+                        ifd(parser_fetch_double_idx)(p, &p->info->LensInfo.FStopMax, 3);
+            break;
+        case 0xa433:
+            // Lens make.
+            ifd(parser_fetch_str)(p, &p->info->LensInfo.Make);
+            break;
+        case 0xa434:
+            // Lens model.
+            ifd(parser_fetch_str)(p, &p->info->LensInfo.Model);
+            break;
+        case TAG_ARTIST:
+            ifd(parser_fetch_str)(p, &p->info->Artist);
+            break;
+        case TAG_EXIFVERSION:
+            ifd(parser_fetch32)(p, &p->info->ExifVersion);
+            break;
+        case TAG_MAX_APERTURE:
+            ifd(parser_fetch_double)(p, &p->info->MaxAperture);
+            break;
+        case TAG_COLOR_SPACE:
+            ifd(parser_fetch16)(p, &p->info->ColorSpace);
+            break;
+        case TAG_SENSING_METHOD: // short
+            ifd(parser_fetch16)(p, &p->info->SensingMethod);
+            break;
+        case TAG_SCENE_TYPE:
+            ifd(parser_fetch16)(p, &p->info->SceneType);
+            break;
+        case TAG_EXPOSURE_MODE:
+            ifd(parser_fetch16)(p, &p->info->ExposureMode);
+            break;
+        case TAG_WHITE_BALANCE:
+            ifd(parser_fetch16)(p, &p->info->WhiteBalance);
+            break;
+        case TAG_SCENE_CAPTURE_TYPE:
+            ifd(parser_fetch16)(p, &p->info->CaptureType);
+            break;
+        case TAG_YCC_POSITIONING:
+            ifd(parser_fetch16)(p, &p->info->YCCPositioning);
+            break;
+        case TAG_OFFSET_TIME_ORIGINAL:
+            ifd(parser_fetch_str)(p, &p->info->OffsetTimeOriginal);
+            break;
+        case TAG_COMPONENT_CONFIG:
+            ifd(parser_fetch16)(p, &p->info->ComponentConfig);
+            break;
+        case TAG_FLASH_PIX_VERSION:
+            ifd(parser_fetch32)(p, &p->info->FlashPixVersion);
+            break;
+        default:
+            if (p->info->dump) { traceln("skip: 0x%04X", p->tag); }
+    }
+}
+
+// Parse tag as Image IFD
+static void ifd(exif_parse_ifd_image)(entry_parser_t* p,
+        uint32_t* exif_sub_ifd_offset, uint32_t* gps_sub_ifd_offset) {
+    switch (p->tag) {
+        case TAG_BITS_PER_SAMPLE:
+            ifd(parser_fetch16)(p, &p->info->BitsPerSample);
+            break;
+        case TAG_IMAGE_DESCRIPTION:
+            ifd(parser_fetch_str)(p, &p->info->ImageDescription);
+            break;
+        case TAG_MAKE: // Camera maker
+            ifd(parser_fetch_str)(p, &p->info->Make);
+            break;
+        case TAG_MODEL: // Camera model
+            ifd(parser_fetch_str)(p, &p->info->Model);
+            break;
+        case TAG_ORIENTATION: // Orientation of image
+            ifd(parser_fetch16)(p, &p->info->Orientation);
+            break;
+        case TAG_X_RESOLUTION:
+            ifd(parser_fetch_double)(p, &p->info->XResolution);
+            break;
+        case TAG_Y_RESOLUTION:
+            ifd(parser_fetch_double)(p, &p->info->YResolution);
+            break;
+        case TAG_RESOLUTION_UNIT:
+            ifd(parser_fetch16)(p, &p->info->ResolutionUnit);
+            break;
+        case TAG_SOFTWARE:
+            ifd(parser_fetch_str)(p, &p->info->Software);
+            break;
+        case TAG_DATETIME: // EXIF/TIFF date/time of image modification
+            // "YYYY:MM:DD HH:MM:SS" 20 (0x14) bytes
+            ifd(parser_fetch_str)(p, &p->info->DateTime);
+            break;
+        case 0x1001:
+            // Original Image width
+            if (!ifd(parser_fetch32)(p, &p->info->RelatedImageWidth)) {
+                uint16_t _RelatedImageWidth;
+                if (ifd(parser_fetch16)(p, &_RelatedImageWidth))
+                    p->info->RelatedImageWidth = _RelatedImageWidth;
+            }
+            break;
+        case 0x1002:
+            // Original Image height
+            if (!ifd(parser_fetch32)(p, &p->info->RelatedImageHeight)) {
+                uint16_t _RelatedImageHeight;
+                if (ifd(parser_fetch16)(p, &_RelatedImageHeight))
+                    p->info->RelatedImageHeight = _RelatedImageHeight;
+            }
+            break;
+        case TAG_COPYRIGHT:
+            ifd(parser_fetch_str)(p, &p->info->Copyright);
+            break;
+        case TAG_EXIF_IFD_POINTER: // EXIF SubIFD offset
+            *exif_sub_ifd_offset = ifd(get_sub_ifd)(p);
+            break;
+        case TAG_GPS_IFD_POINTER: // GPS IFS offset
+            *gps_sub_ifd_offset = ifd(get_sub_ifd)(p);
+            break;
+        default: // Try to parse as EXIF IFD tag, as some images store them in here
+            ifd(exif_parse_ifd)(p);
+            break;
+    }
+}
+
+// IFD1 (if present) describes embedded thumbnail image
+static void ifd(exif_parse_ifd_thumbnail)(entry_parser_t* p, uint32_t ifd1_link) {
+    const uint32_t ifd1 = ifd(parse32)(p->data + ifd1_link);
+    const uint32_t offs = p->tiff_header_start + ifd1;
+    if (ifd1 == 0 || offs < ifd1 || !ifd(exif_ifd_valid)(p, offs)) { return; }
+    int num_entries = ifd(parse16)(p->data + offs);
+    uint32_t start = 0;
+    uint32_t length = 0;
+    parser_init(p, offs + 2);
+    while (--num_entries >= 0) {
+        ifd(parse_tag)(p);
+        if (p->tag == TAG_JPEG_INTERCHANGE_FORMAT) {
+            ifd(parser_fetch32)(p, &start);
+        } else if (p->tag == TAG_JPEG_INTERCHANGE_FORMAT_LEN) {
+            ifd(parser_fetch32)(p, &length);
+        }
+    }
+    const uint32_t at = p->tiff_header_start + start;
+    if (start > 0 && length > 2 && at > start && at + length > at &&
+        at + length <= p->bytes && p->data[at] == JM_START && p->data[at + 1] == JM_SOI) {
+        p->info->Thumbnail = p->data + at;
+        p->info->ThumbnailBytes = length;
+    }
+}
+
+// Now parsing the first Image File Directory (IFD0, for the main image).
+// An IFD consists of a variable number of 12-byte directory entries. The
+// first two bytes of the IFD section contain the number of directory
+// entries in the section. The last 4 bytes of the IFD contain an offset
+// to the next IFD, which means this IFD must contain exactly 6 + 12 * num
+// bytes of data. offs: IFD0 in p->data
+static int ifd(exif_parse_ifds)(entry_parser_t* p, uint32_t offs) {
+    const uint8_t* data = p->data;
+    const uint32_t bytes = p->bytes;
+    if (!ifd(exif_ifd_valid)(p, offs))
+        return EXIF_PARSE_CORRUPT_DATA;
+    int num_entries = ifd(parse16)(data + offs);
+    uint32_t exif_sub_ifd_offset = bytes;
+    uint32_t gps_sub_ifd_offset  = bytes;
+    // offset of the "next IFD" link that follows IFD0 entries:
+    const uint32_t ifd1_link = offs + 2 + 12 * num_entries;
+    parser_init(p, offs + 2);
+    while (--num_entries >= 0) {
+        ifd(parse_tag)(p);
+        ifd(exif_parse_ifd_image)(p, &exif_sub_ifd_offset, &gps_sub_ifd_offset);
+    }
+    ifd(exif_parse_ifd_thumbnail)(p, ifd1_link);
+    // Jump to the EXIF SubIFD if it exists and parse all the information
+    // there. Note that it's possible that the EXIF SubIFD doesn't exist.
+    // The EXIF SubIFD contains most of the interesting information that a
+    // typical user might want.
+    if (exif_sub_ifd_offset + 4 <= bytes) {
+        offs = exif_sub_ifd_offset;
+        if (!ifd(exif_ifd_valid)(p, offs))
+            return EXIF_PARSE_CORRUPT_DATA;
+        num_entries = ifd(parse16)(data + offs);
+        parser_init(p, offs + 2);
+        while (--num_entries >= 0) {
+            ifd(parse_tag)(p);
+            ifd(exif_parse_ifd)(p);
+        }
+    }
+    // Jump to the GPS SubIFD if it exists and parse all the information
+    // there. Note that it's possible that the GPS SubIFD doesn't exist.
+    if (gps_sub_ifd_offset + 4 <= bytes) {
+        offs = gps_sub_ifd_offset;
+        if (!ifd(exif_ifd_valid)(p, offs))
+            return EXIF_PARSE_CORRUPT_DATA;
+        num_entries = ifd(parse16)(data + offs);
+        parser_init(p, offs + 2);
+        while (--num_entries >= 0) {
+            ifd(parse_tag)(p);
+            ifd(exif_parse_ifd_gps)(p);
+        }
+        geolocation_parse_coords(p->info);
+    }
+    return EXIF_PARSE_SUCCESS;
+}
+
+#undef ifd
@@ -0,0 +1,240 @@
+#include "video.h"
+#ifndef _WIN32
+#define _fseeki64 fseeko
+#define _ftelli64 ftello
+#endif
+
+begin_c
+
+#define video_fourcc(s) ((uint32_t)(uint8_t)(s)[0] << 24 | (uint32_t)(uint8_t)(s)[1] << 16 | \
+                         (uint32_t)(uint8_t)(s)[2] <<  8 | (uint32_t)(uint8_t)(s)[3])
+
+enum {
+    video_boxes_max = 1024, // children per box, defends against degenerate files
+    video_keys_max = 16 * 1024
+};
+
+static const char video_creationdate[] = "com.apple.quicktime.creationdate";
+
+typedef struct video_box_s {
+    int64_t at;     // of the header
+    int64_t bytes;  // with the header
+    int32_t header; // 8 or 16 (64-bit size)
+    uint32_t type;
+} video_box_t;
+
+typedef struct video_walk_s {
+    FILE* f;
+    video_info_t* vi;
+    uint32_t key;          // 1-based index of creationdate in keys or 0
+    char keyed[20];        // value of creationdate key
+    char day[20];          // value of \xA9day
+} video_walk_t;
+
+static uint32_t video_be32(const uint8_t* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static uint64_t video_be64(const uint8_t* p) {
+    return (uint64_t)video_be32(p) << 32 | video_be32(p + 4);
+}
+
+static int video_read(FILE* f, int64_t at, void* data, int32_t bytes) {
+    if (_fseeki64(f, at, SEEK_SET) != 0) { return errno; }
+    if (fread(data, 1, bytes, f) == (size_t)bytes) { return 0; }
+    return ferror(f) ? (errno != 0 ? errno : EIO) : EINVAL; // short: truncated
+}
+
+// header of the box at `at` that must end before `end`, false if malformed
+static bool video_box(FILE* f, int64_t at, int64_t end, video_box_t* b) {
+    uint8_t h[16];
+    if (end - at < 8 || video_read(f, at, h, 8) != 0) { return false; }
+    uint64_t size = video_be32(h);
+    b->type = video_be32(h + 4);
+    b->header = 8;
+    if (size == 1) {
+        if (end - at < 16 || video_read(f, at + 8, h + 8, 8) != 0) { return false; }
+        size = video_be64(h + 8);
+        b->header = 16;
+    } else if (size == 0) { // last box extends to the end of file
+        size = (uint64_t)(end - at);
+    }
+    if (size < (uint64_t)b->header || size > (uint64_t)(end - at)) { return false; }
+    b->at = at;
+    b->bytes = (int64_t)size;
+    return true;
+}
+
+// ISO 8601 "2019-06-21T15:21:10-0700" into EXIF format without the zone
+static bool video_iso8601(const char* s, char* created) {
+    int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+    if (sscanf(s, "%4d-%2d-%2dT%2d:%2d:%2d", &year, &month, &day,
+               &hour, &minute, &second) != 6 ||
+        year < 1900 || month < 1 || month > 12 || day < 1 || day > 31 ||
+        hour > 23 || minute > 59 || second > 60) {
+        return false;
+    }
+    snprintf(created, 20, "%04d:%02d:%02d %02d:%02d:%02d",
+        year, month, day, hour, minute, second);
+    return true;
+}
+
+// seconds since 1904-01-01 00:00:00 UTC into EXIF format
+static bool video_mac_time(uint64_t t, char* created) {
+    const uint64_t epoch_1970 = 2082844800;
+    if (t <= epoch_1970) { return false; } // not set: 0 is common
+    const uint64_t s = t - epoch_1970;
+    // civil from days (proleptic Gregorian calendar)
+    const int64_t z = (int64_t)(s / 86400) + 719468;
+    const int64_t era = z / 146097;
+    const int64_t doe = z - era * 146097;
+    const int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const int64_t mp = (5 * doy + 2) / 153;
+    const int day = (int)(doy - (153 * mp + 2) / 5 + 1);
+    const int month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    const int year = (int)(yoe + era * 400 + (month <= 2));
+    const uint32_t ss = (uint32_t)(s % 86400);
+    if (year > 9999) { return false; }
+    snprintf(created, 20, "%04d:%02d:%02d %02u:%02u:%02u", year, month, day,
+        ss / 3600, ss / 60 % 60, ss % 60);
+    return true;
+}
+
+static void video_mvhd(video_walk_t* w, const video_box_t* b) {
+    uint8_t p[32];
+    const int32_t bytes = (int32_t)(b->bytes - b->header < (int64_t)sizeof(p) ?
+        b->bytes - b->header : (int64_t)sizeof(p));
+    if (bytes < 20 || video_read(w->f, b->at + b->header, p, bytes) != 0) { return; }
+    uint64_t created = 0, duration = 0;
+    uint32_t timescale = 0;
+    if (p[0] == 1 && bytes >= 32) { // version 1: 64-bit times
+        created   = video_be64(p + 4);
+        timescale = video_be32(p + 20);
+        duration  = video_be64(p + 24);
+    } else if (p[0] == 0) {
+        created   = video_be32(p + 4);
+        timescale = video_be32(p + 12);
+        duration  = video_be32(p + 16);
+    }
+    if (timescale != 0 && duration != UINT64_MAX && duration != UINT32_MAX) {
+        w->vi->duration = (double)duration / timescale;
+    }
+    if (video_mac_time(created, w->vi->created)) { w->vi->utc = true; }
+}
+
+// keys: version and flags, count, then (size, namespace "mdta", name)
+static void video_keys(video_walk_t* w, const video_box_t* b) {
+    uint8_t keys[video_keys_max];
+    const int64_t bytes = b->bytes - b->header;
+    if (bytes < 8 || bytes > video_keys_max ||
+        video_read(w->f, b->at + b->header, keys, (int32_t)bytes) != 0) {
+        return;
+    }
+    const uint32_t count = video_be32(keys + 4);
+    const uint32_t n = (uint32_t)sizeof(video_creationdate) - 1;
+    int64_t at = 8;
+    for (uint32_t i = 1; i <= count && at + 8 <= bytes && w->key == 0; i++) {
+        const uint32_t size = video_be32(keys + at);
+        if (size < 8 || size > bytes - at) { break; }
+        if (size == 8 + n && memcmp(keys + at + 8, video_creationdate, n) == 0) {
+            w->key = i;
+        }
+        at += size;
+    }
+}
+
+// ilst item: "data" box of type indicator, locale and UTF-8 value
+static void video_item(video_walk_t* w, const video_box_t* item, char* created) {
+    video_box_t data;
+    if (!video_box(w->f, item->at + item->header, item->at + item->bytes, &data) ||
+        data.type != video_fourcc("data")) {
+        return;
+    }
+    uint8_t p[8 + 64];
+    const int64_t bytes = data.bytes - data.header;
+    if (bytes <= 8 || bytes >= (int64_t)sizeof(p) ||
+        video_read(w->f, data.at + data.header, p, (int32_t)bytes) != 0) {
+        return;
+    }
+    p[bytes] = 0;
+    if (video_be32(p) == 1) { // well-known type: UTF-8 without terminator
+        video_iso8601((const char*)p + 8, created);
+    }
+}
+
+static void video_children(video_walk_t* w, const video_box_t* b, int64_t from);
+
+// QuickTime meta is a plain box, ISO (udta/meta) has version and flags
+static void video_meta(video_walk_t* w, const video_box_t* b) {
+    uint8_t p[8];
+    int64_t from = b->at + b->header;
+    if (video_read(w->f, from, p, 8) == 0 && video_be32(p + 4) != video_fourcc("hdlr")) {
+        from += 4;
+    }
+    video_children(w, b, from);
+}
+
+static void video_children(video_walk_t* w, const video_box_t* b, int64_t from) {
+    const int64_t end = b->at + b->bytes;
+    video_box_t c;
+    for (int32_t i = 0; i < video_boxes_max && video_box(w->f, from, end, &c); i++) {
+        if (b->type == video_fourcc("ilst")) {
+            if (w->key != 0 && c.type == w->key) {
+                video_item(w, &c, w->keyed);
+            } else if (c.type == video_fourcc("\xA9" "day")) {
+                video_item(w, &c, w->day);
+            }
+        } else if (c.type == video_fourcc("mvhd")) {
+            video_mvhd(w, &c);
+        } else if (c.type == video_fourcc("keys")) {
+            video_keys(w, &c);
+        } else if (c.type == video_fourcc("ilst") || c.type == video_fourcc("udta")) {
+            video_children(w, &c, c.at + c.header);
+        } else if (c.type == video_fourcc("meta")) {
+            video_meta(w, &c);
+        }
+        from += c.bytes;
+    }
+}
+
+static int video_info(const char* pathname, video_info_t* vi) {
+    memset(vi, 0, sizeof(*vi));
+    FILE* f = fopen(pathname, "rb");
+    if (f == null) { return errno; }
+    setvbuf(f, null, _IONBF, 0); // positional reads of headers: no read ahead
+    int r = _fseeki64(f, 0, SEEK_END) == 0 ? 0 : errno;
+    const int64_t bytes = r == 0 ? (int64_t)_ftelli64(f) : 0;
+    vi->bytes = bytes;
+    video_walk_t w = { .f = f, .vi = vi };
+    video_box_t b;
+    int64_t at = 0;
+    bool moov = false;
+    for (int32_t i = 0; r == 0 && !moov && video_box(f, at, bytes, &b); i++) {
+        // QuickTime files that predate ISO may start with wide, free or mdat
+        if (i == 0 && b.type != video_fourcc("ftyp") && b.type != video_fourcc("moov") &&
+            b.type != video_fourcc("mdat") && b.type != video_fourcc("wide") &&
+            b.type != video_fourcc("free") && b.type != video_fourcc("skip")) {
+            break;
+        }
+        if (b.type == video_fourcc("moov")) {
+            moov = true;
+            video_children(&w, &b, b.at + b.header);
+        }
+        at += b.bytes;
+    }
+    if (r == 0 && !moov) { r = EINVAL; }
+    const char* local = w.keyed[0] != 0 ? w.keyed : w.day;
+    if (local[0] != 0) { // camera clock wins over UTC of mvhd
+        memcpy(vi->created, local, sizeof(vi->created));
+        vi->utc = false;
+    }
+    fclose(f);
+    return r;
+}
+
+video_if video = {
+    .info = video_info
+};
+
+end_c
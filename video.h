@@ -0,0 +1,31 @@
+#pragma once
+#include "crt.h"
+
+begin_c
+
+// Creation date of ISO base media files (MP4, MOV, 3GP) without reading
+// the media: only box headers are read at computed offsets, so a moov box
+// at the end of a multi-GB file costs a handful of small reads. Sources in
+// order of preference:
+//     moov/meta keys "com.apple.quicktime.creationdate"  local time
+//     moov/udta/meta/ilst "\xA9day"                      local time
+//     moov/mvhd creation_time                            UTC
+// Local times keep the clock the camera showed (same as EXIF
+// DateTimeOriginal of photos), the time zone suffix is dropped.
+
+typedef struct video_info_s {
+    char created[20];  // "YYYY:MM:DD HH:MM:SS" (EXIF format) or ""
+    bool utc;          // created is from mvhd
+    double duration;   // seconds, 0 if unknown
+    int64_t bytes;     // file size
+} video_info_t;
+
+typedef struct {
+    // returns 0 (created may still be empty), errno or EINVAL when the
+    // file is not ISO base media or has no moov box
+    int (*info)(const char* pathname, video_info_t* vi);
+} video_if;
+
+extern video_if video;
+
+end_c